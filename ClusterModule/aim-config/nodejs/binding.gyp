@@ -19,6 +19,7 @@
 			
 			"include_dirs": [
 				"../../inc",
+				"../../../common/inc",
 				"../../aim-core/inc"
 				
 			],
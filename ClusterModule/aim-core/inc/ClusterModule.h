@@ -50,9 +50,11 @@ private:
   yarp::os::BufferedPort<yarp::os::Bottle> *portClusterCount;
   int portMethodBuf;
   yarp::os::BufferedPort<yarp::os::Bottle> *portMethod;
+  int portSnapshotBuf;
+  yarp::os::BufferedPort<yarp::os::Bottle> *portSnapshot;
 protected:
-  static const int channel_count = 5;
-  const char* channel[5];
+  static const int channel_count = 6;
+  const char* channel[6];
   // Read from this function and assume it means something
   // Remark: caller is responsible for evoking vector->clear()
   long_seq *readTrain(bool blocking=false);
@@ -72,6 +74,10 @@ protected:
   // Remark: check if result is not NULL
   int *readMethod(bool blocking=false);
   
+  // Read from this function and assume it means something
+  // Remark: check if result is not NULL
+  int *readSnapshot(bool blocking=false);
+  
 public:
   // Default constructor
   ClusterModule();
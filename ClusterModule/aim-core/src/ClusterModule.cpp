@@ -23,13 +23,14 @@ using namespace yarp::os;
 ClusterModule::ClusterModule():
   cliParam(0)
 {
-  const char* const channel[5] = {"readTrain", "readTest", "writeClass", "readClusterCount", "readMethod"};
+  const char* const channel[6] = {"readTrain", "readTest", "writeClass", "readClusterCount", "readMethod", "readSnapshot"};
   cliParam = new Param();
   portTrain = new BufferedPort<Bottle>();
   portTest = new BufferedPort<Bottle>();
   portClass = new BufferedPort<Bottle>();
   portClusterCount = new BufferedPort<Bottle>();
   portMethod = new BufferedPort<Bottle>();
+  portSnapshot = new BufferedPort<Bottle>();
 }
 
 ClusterModule::~ClusterModule() {
@@ -39,6 +40,7 @@ ClusterModule::~ClusterModule() {
   delete portClass;
   delete portClusterCount;
   delete portMethod;
+  delete portSnapshot;
 }
 
 void ClusterModule::Init(std::string & name) {
@@ -65,6 +67,10 @@ void ClusterModule::Init(std::string & name) {
   yarpPortName << "/clustermodule" << name << "/method";
   portMethod->open(yarpPortName.str().c_str());
   
+  yarpPortName.str(""); yarpPortName.clear();
+  yarpPortName << "/clustermodule" << name << "/snapshot";
+  portSnapshot->open(yarpPortName.str().c_str());
+  
 }
 
 long_seq* ClusterModule::readTrain(bool blocking) {
@@ -114,4 +120,13 @@ int* ClusterModule::readMethod(bool blocking) {
   return NULL;
 }
 
+int* ClusterModule::readSnapshot(bool blocking) {
+  Bottle *b = portSnapshot->read(blocking);
+  if (b != NULL) { 
+    portSnapshotBuf = b->get(0).asInt();
+    return &portSnapshotBuf;
+  }
+  return NULL;
+}
+
 } // namespace
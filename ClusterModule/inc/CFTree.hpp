@@ -0,0 +1,400 @@
+/**
+ * 456789------------------------------------------------------------------------------------------------------------120
+ *
+ * @brief Clustering feature tree (BIRCH) that summarizes a stream of samples within a fixed memory budget
+ * @file CFTree.hpp
+ *
+ * This file is created at Almende B.V. and Distributed Organisms B.V. It is open-source software and belongs to a
+ * larger suite of software that is meant for research on self-organization principles and multi-agent systems where
+ * learning algorithms are an important aspect.
+ *
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless, we personally strongly object
+ * against this software being used for military purposes, factory farming, animal experimentation, and "Universal
+ * Declaration of Human Rights" violations.
+ *
+ * Copyright (c) 2013 Anne C. van Rossum <anne@almende.org>
+ *
+ * @author    Anne C. van Rossum
+ * @date      Oct 15, 2026
+ * @project   Replicator
+ * @company   Almende B.V.
+ * @company   Distributed Organisms B.V.
+ * @case      Clustering
+ */
+
+#ifndef CFTREE_HPP_
+#define CFTREE_HPP_
+
+#include <Eigen/Core>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <cstddef>
+#include <iostream>
+#include <algorithm>
+#include <assert.hpp>
+
+/**
+ * The clustering feature tree of "BIRCH: an efficient data clustering method for very large databases" by Zhang,
+ * Ramakrishnan, and Livny (1996). A clustering feature summarizes a group of samples by their number (or total weight)
+ * N, their linear sum LS, and the sum of their squared norms SS. Two features are merged by adding these, and the
+ * centroid LS/N and the radius sqrt(SS/N - |LS/N|^2) follow from them.
+ *
+ * The leaves of the tree hold the features of the groups, the inner nodes hold per child the sum of its features.
+ * A sample descends to the leaf with the nearest centroids and is absorbed by the nearest leaf feature if the radius
+ * stays below a threshold, otherwise it starts a new feature. A node with too many entries is split in two around
+ * its farthest pair. An insertion is O(Bd log_B M) for M leaf features and nodes of B entries.
+ *
+ * If the tree grows beyond its memory budget, the threshold is raised and the tree is rebuilt from its leaf features
+ * (not from the samples), so the samples are read once and memory does not depend on their number. The new threshold
+ * is chosen such that about half of the leaf features can be merged with their nearest neighbour (see
+ * raise_threshold). The rebuild needs a copy of the leaf features, so the peak is about twice the budget.
+ *
+ * The leaf features, their centroids with their number of samples as weight, are the input for weighted k-means or
+ * EM, see summaries(). The outlier handling and the refinement phases of BIRCH are not implemented.
+ */
+class CFTree {
+public:
+	typedef double value_t;
+	typedef Eigen::Matrix<value_t,Eigen::Dynamic,1> vector_t; // column_vector
+
+	//! A clustering feature: the number (weight) of samples, their sum, and the sum of their squared norms
+	struct Feature {
+		value_t n;
+		vector_t ls;
+		value_t ss;
+
+		void add(const Feature & other) {
+			n += other.n;
+			ls += other.ls;
+			ss += other.ss;
+		}
+
+		//! The root mean squared distance of the samples to their centroid
+		value_t radius() const {
+			value_t r2 = ss / n - ls.squaredNorm() / (n * n);
+			return r2 > 0 ? std::sqrt(r2) : 0;
+		}
+	};
+
+	/**
+	 * A tree for samples of dimension "dimension" that uses at most about "memory" bytes. Inner nodes have at most
+	 * "branching" entries, leaves at most "leaf_capacity" features.
+	 */
+	CFTree(size_t dimension, size_t memory = 64 << 20, size_t branching = 50, size_t leaf_capacity = 50) {
+		ASSERT_GT (branching, 1);
+		ASSERT_GT (leaf_capacity, 1);
+		this->dimension = dimension;
+		this->memory_budget = memory;
+		this->branching = branching;
+		this->leaf_capacity = leaf_capacity;
+		threshold = 0;
+		samples = 0;
+		rebuild_count = 0;
+		clear();
+	}
+
+	~CFTree() {}
+
+	/**
+	 * Add a sample of "dimension" values with the given weight. If the tree exceeds its memory budget afterwards, the
+	 * threshold is raised and the tree rebuilt, see the class description.
+	 */
+	template<typename T>
+	void insert(const T *x, value_t weight = 1) {
+		Feature f;
+		f.n = weight;
+		f.ls = Eigen::Map<const Eigen::Matrix<T,Eigen::Dynamic,1> >(x, dimension).template cast<value_t>() * weight;
+		f.ss = f.ls.squaredNorm() / weight;
+		insert(f);
+		samples++;
+		while (memory() > memory_budget && leaf_features > 1) {
+			raise_threshold();
+			rebuild();
+		}
+	}
+
+	//! The number of leaf features
+	inline size_t size() const { return leaf_features; }
+
+	//! The current threshold on the radius of a leaf feature
+	inline value_t radius_threshold() const { return threshold; }
+
+	//! The number of times the tree has been rebuilt with a larger threshold
+	inline size_t rebuilds() const { return rebuild_count; }
+
+	/**
+	 * The (estimated) memory used by the tree in bytes: the nodes, with room for all their entries, and the linear
+	 * sums of the entries.
+	 */
+	size_t memory() const {
+		return nodes.size() * (sizeof(Node) + (std::max(branching, leaf_capacity) + 1) * sizeof(Entry)) +
+				entries * dimension * sizeof(value_t);
+	}
+
+	/**
+	 * The leaf features as weighted samples: the centroids, stored contiguously one per row (size() x dimension), and
+	 * per centroid the number of samples it summarizes. Can be given to KMeans::setData and
+	 * ExpectationMaximization::setData.
+	 */
+	template<typename T>
+	void summaries(std::vector<T> & centroids, std::vector<T> & weights) const {
+		centroids.clear();
+		weights.clear();
+		centroids.reserve(leaf_features * dimension);
+		weights.reserve(leaf_features);
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			if (!nodes[i].leaf) continue;
+			for (size_t e = 0; e < nodes[i].entries.size(); ++e) {
+				const Feature & f = nodes[i].entries[e].feature;
+				for (size_t j = 0; j < dimension; ++j) {
+					centroids.push_back(T(f.ls[j] / f.n));
+				}
+				weights.push_back(T(f.n));
+			}
+		}
+	}
+
+	void print() const {
+		std::cout << "CF-tree summarizes " << samples << " samples in " << leaf_features << " features (" <<
+				nodes.size() << " nodes, about " << memory() / 1024 << " kB) with radius threshold " << threshold <<
+				" after " << rebuild_count << " rebuilds" << std::endl;
+	}
+
+protected:
+	//! An entry of a node: a leaf feature, or the sum of the features of a child node
+	struct Entry {
+		Feature feature;
+		size_t child;
+	};
+
+	struct Node {
+		bool leaf;
+		std::vector<Entry> entries;
+	};
+
+	//! Start with an empty leaf as root
+	void clear() {
+		nodes.clear();
+		root = new_node(true);
+		leaf_features = 0;
+		entries = 0;
+	}
+
+	size_t new_node(bool leaf) {
+		nodes.push_back(Node());
+		nodes.back().leaf = leaf;
+		nodes.back().entries.reserve((leaf ? leaf_capacity : branching) + 1);
+		return nodes.size() - 1;
+	}
+
+	//! The radius of the union of two features
+	inline static value_t merged_radius(const Feature & a, const Feature & b) {
+		value_t n = a.n + b.n;
+		value_t r2 = (a.ss + b.ss) / n - (a.ls + b.ls).squaredNorm() / (n * n);
+		return r2 > 0 ? std::sqrt(r2) : 0;
+	}
+
+	//! The squared distance between the centroids of two features
+	inline static value_t distance(const Feature & a, const Feature & b) {
+		return (a.ls / a.n - b.ls / b.n).squaredNorm();
+	}
+
+	//! The entry of "node" with the nearest centroid to that of "f"
+	size_t closest(size_t node, const Feature & f) const {
+		const std::vector<Entry> & e = nodes[node].entries;
+		size_t nearest = 0;
+		value_t min = std::numeric_limits<value_t>::max();
+		for (size_t i = 0; i < e.size(); ++i) {
+			value_t dist = distance(e[i].feature, f);
+			if (dist < min) {
+				min = dist;
+				nearest = i;
+			}
+		}
+		return nearest;
+	}
+
+	//! The sum of the features of all entries of "node"
+	Feature sum(size_t node) const {
+		const std::vector<Entry> & e = nodes[node].entries;
+		Feature f = e[0].feature;
+		for (size_t i = 1; i < e.size(); ++i) {
+			f.add(e[i].feature);
+		}
+		return f;
+	}
+
+	//! Entry with the given feature and child
+	static Entry entry(const Feature & feature, size_t child) {
+		Entry e;
+		e.feature = feature;
+		e.child = child;
+		return e;
+	}
+
+	//! Insert a feature at the root, a split of the root adds a level
+	void insert(const Feature & f) {
+		size_t sibling = insert(root, f);
+		if (sibling == none) return;
+		size_t old_root = root;
+		root = new_node(false);
+		nodes[root].entries.push_back(entry(sum(old_root), old_root));
+		nodes[root].entries.push_back(entry(sum(sibling), sibling));
+		entries += 2;
+	}
+
+	/**
+	 * Insert a feature in the subtree of "node". Returns the index of a new sibling of "node" if it has been split,
+	 * otherwise "none". Nodes are referred to by index, because a split can reallocate "nodes".
+	 */
+	size_t insert(size_t node, const Feature & f) {
+		if (nodes[node].leaf) {
+			if (!nodes[node].entries.empty()) {
+				Entry & nearest = nodes[node].entries[closest(node, f)];
+				if (merged_radius(nearest.feature, f) <= threshold) {
+					nearest.feature.add(f);
+					return none;
+				}
+			}
+			nodes[node].entries.push_back(entry(f, none));
+			leaf_features++;
+			entries++;
+			if (nodes[node].entries.size() > leaf_capacity) return split(node);
+			return none;
+		}
+		size_t i = closest(node, f);
+		size_t child = nodes[node].entries[i].child;
+		size_t sibling = insert(child, f);
+		if (sibling == none) {
+			nodes[node].entries[i].feature.add(f);
+			return none;
+		}
+		nodes[node].entries[i].feature = sum(child);
+		nodes[node].entries.push_back(entry(sum(sibling), sibling));
+		entries++;
+		if (nodes[node].entries.size() > branching) return split(node);
+		return none;
+	}
+
+	/**
+	 * Split "node" in two: the farthest pair of entries are the seeds, and every other entry goes to the node of the
+	 * nearest seed. Returns the index of the new node.
+	 */
+	size_t split(size_t node) {
+		std::vector<Entry> e;
+		e.swap(nodes[node].entries);
+		size_t sibling = new_node(nodes[node].leaf);
+		nodes[node].entries.reserve(e.size());
+		size_t a = 0, b = 1;
+		value_t max = -1;
+		for (size_t i = 0; i < e.size(); ++i) {
+			for (size_t j = i + 1; j < e.size(); ++j) {
+				value_t dist = distance(e[i].feature, e[j].feature);
+				if (dist > max) {
+					max = dist;
+					a = i;
+					b = j;
+				}
+			}
+		}
+		for (size_t i = 0; i < e.size(); ++i) {
+			bool to_a = (i == a) || (i != b && distance(e[i].feature, e[a].feature) <= distance(e[i].feature, e[b].feature));
+			nodes[to_a ? node : sibling].entries.push_back(e[i]);
+		}
+		return sibling;
+	}
+
+	/**
+	 * Raise the threshold to the median, over all leaf features, of the merged radius of a feature and its nearest
+	 * other feature in the same leaf. About half of the features can then be merged with their neighbour. If that is
+	 * not larger than the current threshold, the smallest larger radius is used, and if there is none, the threshold
+	 * is doubled.
+	 */
+	void raise_threshold() {
+		std::vector<value_t> radii;
+		radii.reserve(leaf_features);
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			const std::vector<Entry> & e = nodes[i].entries;
+			if (!nodes[i].leaf || e.size() < 2) continue;
+			for (size_t a = 0; a < e.size(); ++a) {
+				size_t nearest = a;
+				value_t min = std::numeric_limits<value_t>::max();
+				for (size_t b = 0; b < e.size(); ++b) {
+					if (b == a) continue;
+					value_t dist = distance(e[a].feature, e[b].feature);
+					if (dist < min) {
+						min = dist;
+						nearest = b;
+					}
+				}
+				radii.push_back(merged_radius(e[a].feature, e[nearest].feature));
+			}
+		}
+		value_t raised = 0;
+		if (!radii.empty()) {
+			std::nth_element(radii.begin(), radii.begin() + radii.size() / 2, radii.end());
+			raised = radii[radii.size() / 2];
+			if (raised <= threshold) {
+				raised = std::numeric_limits<value_t>::max();
+				for (size_t r = 0; r < radii.size(); ++r) {
+					if (radii[r] > threshold) raised = std::min(raised, radii[r]);
+				}
+			}
+		}
+		if (raised <= threshold || raised == std::numeric_limits<value_t>::max()) raised = 2 * threshold;
+		if (raised <= 0) raised = std::numeric_limits<value_t>::min();
+		threshold = raised;
+	}
+
+	//! Insert the leaf features of the tree in a new, empty, tree with the current threshold
+	void rebuild() {
+		std::vector<Feature> features;
+		features.reserve(leaf_features);
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			if (!nodes[i].leaf) continue;
+			for (size_t e = 0; e < nodes[i].entries.size(); ++e) {
+				features.push_back(nodes[i].entries[e].feature);
+			}
+		}
+		clear();
+		for (size_t i = 0; i < features.size(); ++i) {
+			insert(features[i]);
+		}
+		rebuild_count++;
+	}
+
+private:
+	//! The child index of a leaf entry, and the result of insert if there is no split
+	static const size_t none = (size_t)-1;
+
+	//! Dimension of the samples
+	size_t dimension;
+
+	//! Memory budget in bytes, see memory()
+	size_t memory_budget;
+
+	//! Maximum number of entries of an inner node and of a leaf
+	size_t branching;
+	size_t leaf_capacity;
+
+	//! A sample is absorbed by a leaf feature if the radius of the feature stays below this threshold
+	value_t threshold;
+
+	//! The nodes, referred to by index, and the index of the root
+	std::vector<Node> nodes;
+	size_t root;
+
+	//! The number of leaf features, and of entries in all nodes
+	size_t leaf_features;
+	size_t entries;
+
+	//! The number of samples inserted
+	size_t samples;
+
+	size_t rebuild_count;
+};
+
+#endif /* CFTREE_HPP_ */
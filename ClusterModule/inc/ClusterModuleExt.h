@@ -23,15 +23,23 @@
 #include <ClusterModule.h>
 
 #include <data.hpp>
+#include <ThreadPool.hpp>
+#include <MiniBatchKMeans.h>
+#include <OnlineExpectationMaximization.h>
+#include <ModelSnapshot.hpp>
 
 namespace rur {
 
-enum ClusterMethod { C_KMEANS, C_EM_GMM, NUMBER_OF_CLUSTER_METHODS };
+enum ClusterMethod { C_KMEANS, C_EM_GMM, C_KMEANS_STREAM, C_EM_STREAM, NUMBER_OF_CLUSTER_METHODS };
 
 class ClusterModuleExt: public ClusterModule {
 public:
 	typedef float value_t;
 
+	ClusterModuleExt();
+
+	~ClusterModuleExt();
+
 	void Init(std::string& name);
 
 	// The tick function will be called from the ClusterModuleMain file
@@ -41,6 +49,24 @@ public:
 	bool Stop();
 
 private:
+	// Load the data set for the batch methods
+	void LoadDataSet();
+
+	// Cluster a data set that is too large for the batch methods on its summaries, see CFTree
+	void ClusterSummaries();
+
+	// Train on the samples from the Train port, classify the ones from the Test port
+	void TickStream();
+
+	// Answer the Test port with the model snapshot
+	void TickSnapshot();
+
+	// Write the snapshot of the current model to snapshot_file
+	void WriteSnapshot();
+
+	// Returns true for the methods that learn from the Train port rather than from a data set
+	inline bool streaming() const { return cluster_method == C_KMEANS_STREAM || cluster_method == C_EM_STREAM; }
+
 	data<value_t> d;
 
 	int index;
@@ -49,7 +75,33 @@ private:
 
 	bool stop;
 
+	//! The number of clusters, 0 if it should be selected automatically (batch methods only)
 	int predefined_clusters;
+
+	//! Largest number of clusters considered by automatic selection
+	int max_clusters;
+
+	//! Data sets larger than this (in bytes) are summarized by a CF-tree of this size for the batch methods
+	size_t summary_memory;
+
+	//! Worker threads used by the clustering methods
+	ThreadPool pool;
+
+	//! Length of the samples on the Train and Test ports, set by the first training sample
+	size_t sample_dimension;
+
+	//! Buffer to convert samples from the ports
+	std::vector<value_t> sample;
+
+	//! Online k-means on the Train port, created on the first training sample
+	MiniBatchKMeans *stream_kmeans;
+
+	//! Online EM on the Train port, created on the first training sample
+	OnlineExpectationMaximization *stream_em;
+
+	//! The last trained model, or the one loaded from snapshot_file at startup
+	ModelSnapshot snapshot;
+	std::string snapshot_file;
 };
 
 }
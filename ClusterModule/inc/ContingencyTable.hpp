@@ -0,0 +1,232 @@
+/**
+ * 456789------------------------------------------------------------------------------------------------------------120
+ *
+ * @brief Contingency table of clusters versus ground truth labels, for the evaluation of a clustering
+ * @file ContingencyTable.hpp
+ *
+ * This file is created at Almende B.V. and Distributed Organisms B.V. It is open-source software and belongs to a
+ * larger suite of software that is meant for research on self-organization principles and multi-agent systems where
+ * learning algorithms are an important aspect.
+ *
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless, we personally strongly object
+ * against this software being used for military purposes, factory farming, animal experimentation, and "Universal
+ * Declaration of Human Rights" violations.
+ *
+ * Copyright (c) 2013 Anne C. van Rossum <anne@almende.org>
+ *
+ * @author    Anne C. van Rossum
+ * @date      Oct 15, 2026
+ * @project   Replicator
+ * @company   Almende B.V.
+ * @company   Distributed Organisms B.V.
+ * @case      Clustering
+ */
+
+#ifndef CONTINGENCYTABLE_HPP_
+#define CONTINGENCYTABLE_HPP_
+
+#include <vector>
+#include <map>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <assert.hpp>
+
+/**
+ * The table counts for every cluster k and every ground truth label l the number of samples n_kl that are assigned to
+ * k and carry label l. All pair-counting indices follow from the table rather than from comparing every pair of
+ * samples. With a_k the row sums, b_l the column sums, and C(n,2) = n(n-1)/2 the number of pairs:
+ *
+ *   pairs in the same cluster with the same label      \sum_kl C(n_kl,2)
+ *   pairs in the same cluster                          \sum_k C(a_k,2)
+ *   pairs with the same label                          \sum_l C(b_l,2)
+ *
+ * These three sums are kept up to date on every add(), remove(), and move(), in O(1), so the (adjusted) Rand index
+ * can be asked for after every iteration of an algorithm at no cost. The information theoretic measure and the purity
+ * need one pass over the table, O(KL). Building the table from scratch is O(N).
+ *
+ * Labels can be any number, they get a column in order of appearance.
+ */
+class ContingencyTable {
+public:
+	typedef double value_t;
+
+	ContingencyTable(size_t clusters = 0) {
+		reset(clusters);
+	}
+
+	//! Empty the table and set the number of clusters, the labels are forgotten as well
+	void reset(size_t clusters) {
+		this->clusters = clusters;
+		columns.clear();
+		label_values.clear();
+		cells.clear();
+		cluster_sizes.assign(clusters, 0);
+		label_sizes.clear();
+		total = 0;
+		pairs_cells = pairs_clusters = pairs_labels = 0;
+	}
+
+	//! Count a sample with the given ground truth label that is assigned to "cluster"
+	void add(size_t cluster, size_t label) {
+		ASSERT_LT (cluster, clusters);
+		size_t l = column(label);
+		size_t & n = cells[l * clusters + cluster];
+		pairs_cells += n++;
+		pairs_clusters += cluster_sizes[cluster]++;
+		pairs_labels += label_sizes[l]++;
+		total++;
+	}
+
+	//! Undo add(cluster, label)
+	void remove(size_t cluster, size_t label) {
+		ASSERT_LT (cluster, clusters);
+		size_t l = column(label);
+		size_t & n = cells[l * clusters + cluster];
+		ASSERT_GT (n, 0);
+		pairs_cells -= --n;
+		pairs_clusters -= --cluster_sizes[cluster];
+		pairs_labels -= --label_sizes[l];
+		total--;
+	}
+
+	//! A sample with the given label is reassigned from cluster "from" to cluster "to"
+	void move(size_t label, size_t from, size_t to) {
+		if (from == to) return;
+		remove(from, label);
+		add(to, label);
+	}
+
+	//! Number of samples in the table
+	inline size_t size() const { return total; }
+
+	/**
+	 * The Rand index, the fraction of pairs on which the clustering and the ground truth agree (both in the same
+	 * group, or both in different groups). In [0,1], with 1 for identical partitions.
+	 */
+	value_t randIndex() const {
+		value_t n = pairs(total);
+		if (n == 0) return 1;
+		return (n + 2 * value_t(pairs_cells) - value_t(pairs_clusters) - value_t(pairs_labels)) / n;
+	}
+
+	/**
+	 * The Rand index adjusted for chance (Hubert and Arabie, 1985). It is 0 in expectation for a random clustering
+	 * and 1 for identical partitions. It can be negative.
+	 */
+	value_t adjustedRandIndex() const {
+		value_t n = pairs(total);
+		if (n == 0) return 1;
+		value_t expected = value_t(pairs_clusters) * value_t(pairs_labels) / n;
+		value_t maximum = value_t(0.5) * (value_t(pairs_clusters) + value_t(pairs_labels));
+		if (maximum == expected) return 1;
+		return (value_t(pairs_cells) - expected) / (maximum - expected);
+	}
+
+	/**
+	 * The mutual information between clusters and labels normalized by the arithmetic mean of their entropies,
+	 * 2 I(K;L) / (H(K) + H(L)). In [0,1], with 1 for identical partitions.
+	 */
+	value_t normalizedMutualInformation() const {
+		if (!total) return 1;
+		const value_t N = total;
+		value_t h_clusters = 0, h_labels = 0, mutual_information = 0;
+		for (size_t k = 0; k < clusters; ++k) {
+			h_clusters -= entropy_term(cluster_sizes[k] / N);
+		}
+		for (size_t l = 0; l < label_sizes.size(); ++l) {
+			h_labels -= entropy_term(label_sizes[l] / N);
+			for (size_t k = 0; k < clusters; ++k) {
+				size_t n = cells[l * clusters + k];
+				if (!n) continue;
+				mutual_information += n / N * std::log(n * N / (value_t(cluster_sizes[k]) * label_sizes[l]));
+			}
+		}
+		if (h_clusters + h_labels == 0) return 1;
+		return std::max(value_t(0), 2 * mutual_information / (h_clusters + h_labels));
+	}
+
+	/**
+	 * The fraction of samples that carry the most frequent label of their cluster. In (0,1], note that it is 1 as
+	 * well if every sample has its own cluster.
+	 */
+	value_t purity() const {
+		if (!total) return 1;
+		size_t sum = 0;
+		for (size_t k = 0; k < clusters; ++k) {
+			size_t most = 0;
+			for (size_t l = 0; l < label_sizes.size(); ++l) {
+				most = std::max(most, cells[l * clusters + k]);
+			}
+			sum += most;
+		}
+		return sum / value_t(total);
+	}
+
+	//! Print the table, one row per label, and all quality measures
+	void print() const {
+		std::cout << "Contingency table of ground truth x prediction (" << label_sizes.size() << "x" << clusters << ")"
+				<< std::endl;
+		for (size_t l = 0; l < label_sizes.size(); ++l) {
+			std::cout << "label " << label_values[l] << ": ";
+			for (size_t k = 0; k < clusters; ++k) {
+				std::cout << std::setw(3) << cells[l * clusters + k] << ' ';
+			}
+			std::cout << std::endl;
+		}
+		std::cout << "Rand index is " << randIndex() << std::endl;
+		std::cout << "Adjusted Rand index is " << adjustedRandIndex() << std::endl;
+		std::cout << "Normalized mutual information is " << normalizedMutualInformation() << std::endl;
+		std::cout << "Purity is " << purity() << std::endl;
+	}
+
+protected:
+	inline static value_t pairs(size_t n) {
+		return value_t(n) * (value_t(n) - 1) / 2;
+	}
+
+	inline static value_t entropy_term(value_t p) {
+		return p > 0 ? p * std::log(p) : 0;
+	}
+
+	//! The column of a label, a new label gets a new (empty) column
+	size_t column(size_t label) {
+		std::map<size_t,size_t>::const_iterator iter = columns.find(label);
+		if (iter != columns.end()) return iter->second;
+		size_t l = label_sizes.size();
+		columns[label] = l;
+		label_values.push_back(label);
+		label_sizes.push_back(0);
+		cells.resize(cells.size() + clusters, 0);
+		return l;
+	}
+
+private:
+	//! Number of clusters, the number of rows
+	size_t clusters;
+
+	//! Column index per label value, and the label value per column
+	std::map<size_t,size_t> columns;
+	std::vector<size_t> label_values;
+
+	//! The counts n_kl, one column of K counts per label (L x K, row-major)
+	std::vector<size_t> cells;
+
+	//! Row sums a_k and column sums b_l
+	std::vector<size_t> cluster_sizes;
+	std::vector<size_t> label_sizes;
+
+	//! Total number of samples
+	size_t total;
+
+	//! The sums \sum C(n_kl,2), \sum C(a_k,2), and \sum C(b_l,2), kept up to date incrementally
+	size_t pairs_cells;
+	size_t pairs_clusters;
+	size_t pairs_labels;
+};
+
+#endif /* CONTINGENCYTABLE_HPP_ */
@@ -0,0 +1,221 @@
+/**
+ * 456789------------------------------------------------------------------------------------------------------------120
+ *
+ * @brief Covariance matrix with a full, diagonal, or spherical structure
+ * @file Covariance.hpp
+ *
+ * This file is created at Almende B.V. and Distributed Organisms B.V. It is open-source software and belongs to a
+ * larger suite of software that is meant for research on self-organization principles and multi-agent systems where
+ * learning algorithms are an important aspect.
+ *
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless, we personally strongly object
+ * against this software being used for military purposes, factory farming, animal experimentation, and "Universal
+ * Declaration of Human Rights" violations.
+ *
+ * Copyright (c) 2013 Anne C. van Rossum <anne@almende.org>
+ *
+ * @author    Anne C. van Rossum
+ * @date      Oct 15, 2026
+ * @project   Replicator
+ * @company   Almende B.V.
+ * @company   Distributed Organisms B.V.
+ * @case      Clustering
+ */
+
+#ifndef COVARIANCE_HPP_
+#define COVARIANCE_HPP_
+
+#include <Eigen/Core>
+#include <Eigen/Cholesky>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+#include <assert.hpp>
+
+/**
+ * The structure of a covariance matrix:
+ *   COV_FULL       a symmetric positive definite d x d matrix, O(d^2) per density evaluation, O(d^2) storage
+ *   COV_DIAGONAL   independent variances per dimension, O(d) per density evaluation, O(d) storage
+ *   COV_SPHERICAL  one variance for all dimensions, O(d) per density evaluation, O(1) storage
+ */
+enum CovarianceType { COV_FULL, COV_DIAGONAL, COV_SPHERICAL, NUMBER_OF_COVARIANCE_TYPES };
+
+/**
+ * A covariance matrix \Sigma with one of the structures in CovarianceType. After an update with estimate(), call
+ * factorize() before mahalanobis() or logDeterminant() are used. For a full matrix factorize() calculates the Cholesky
+ * factor L with \Sigma = LL', for the other structures it calculates the inverse variances.
+ */
+class Covariance {
+public:
+	typedef double value_t;
+	typedef Eigen::Matrix<value_t,Eigen::Dynamic,Eigen::Dynamic> matrix_t;
+	typedef Eigen::Matrix<value_t,Eigen::Dynamic,1> vector_t; // column_vector
+
+	Covariance(): type(COV_DIAGONAL), dimension(0), log_determinant(0) {}
+
+	//! Set to the d x d identity matrix with the given structure
+	void setIdentity(CovarianceType type, size_t d) {
+		this->type = type;
+		dimension = d;
+		switch (type) {
+		case COV_FULL:
+			full = matrix_t::Identity(d, d);
+			break;
+		case COV_DIAGONAL:
+			variances = vector_t::Ones(d);
+			break;
+		case COV_SPHERICAL: default:
+			variances = vector_t::Ones(1);
+			break;
+		}
+	}
+
+	/**
+	 * Set to scatter / sum_w, reduced to the structure of this covariance matrix: off-diagonal elements are dropped
+	 * for a diagonal matrix, and the variances are averaged for a spherical matrix. If sum_w is zero, the scatter is
+	 * used as is.
+	 */
+	void estimate(const matrix_t & scatter, value_t sum_w) {
+		ASSERT_EQ(scatter.rows(), dimension);
+		if (type == COV_FULL) {
+			full = (sum_w != 0) ? matrix_t(scatter / sum_w) : scatter;
+		} else {
+			estimateDiagonal(scatter.diagonal(), sum_w);
+		}
+	}
+
+	/**
+	 * As estimate(), but only the diagonal of the scatter matrix is given. This suffices for diagonal and spherical
+	 * covariance matrices, not for a full one.
+	 */
+	void estimateDiagonal(const vector_t & scatter_diagonal, value_t sum_w) {
+		ASSERT (type != COV_FULL);
+		ASSERT_EQ(scatter_diagonal.size(), dimension);
+		value_t divisor = (sum_w != 0) ? sum_w : 1;
+		if (type == COV_DIAGONAL) {
+			variances = scatter_diagonal / divisor;
+		} else {
+			variances = vector_t::Constant(1, scatter_diagonal.sum() / (divisor * dimension));
+		}
+	}
+
+	/**
+	 * Calculate the Cholesky factor (full) or the inverse variances (diagonal, spherical), and the log determinant.
+	 * A matrix that is not positive definite gets a small multiple of the identity added (to its factor only, the
+	 * matrix itself is left as estimated).
+	 */
+	void factorize() {
+		const size_t d = dimension;
+		if (type == COV_FULL) {
+			cholesky.compute(full);
+			value_t ridge = 1e-6 * std::max(value_t(1), full.diagonal().cwiseAbs().maxCoeff());
+			while (cholesky.info() != Eigen::Success) {
+				std::cout << "Covariance matrix is not positive definite, add " << ridge << " to its diagonal" << std::endl;
+				cholesky.compute(full + ridge * matrix_t::Identity(d, d));
+				ridge *= 10;
+			}
+			log_determinant = 2 * cholesky.matrixLLT().diagonal().array().log().sum();
+		} else {
+			vector_t factor = variances;
+			value_t floor = 1e-6 * std::max(value_t(1), variances.cwiseAbs().maxCoeff());
+			if (factor.minCoeff() <= 0) {
+				std::cout << "Covariance matrix is not positive definite, use at least " << floor << " as variance" << std::endl;
+				factor = factor.cwiseMax(floor);
+			}
+			inverse_variances = factor.cwiseInverse();
+			log_determinant = factor.array().log().sum();
+			if (type == COV_SPHERICAL) log_determinant *= d;
+		}
+	}
+
+	/**
+	 * The squared Mahalanobis distance diff' \Sigma^-1 diff, with diff the difference between a sample and the
+	 * location. For a full matrix a triangular solve: |L^-1 diff|^2.
+	 */
+	template<typename Derived>
+	value_t mahalanobis(const Eigen::MatrixBase<Derived> & diff) const {
+		switch (type) {
+		case COV_FULL:
+			return cholesky.matrixL().solve(diff).squaredNorm();
+		case COV_DIAGONAL:
+			return diff.cwiseAbs2().dot(inverse_variances);
+		case COV_SPHERICAL: default:
+			return diff.squaredNorm() * inverse_variances[0];
+		}
+	}
+
+	//! The logarithm of the determinant |\Sigma|, valid after factorize()
+	inline value_t logDeterminant() const { return log_determinant; }
+
+	//! Number of free parameters, e.g. for model selection criteria
+	size_t parameters() const {
+		switch (type) {
+		case COV_FULL:
+			return dimension * (dimension + 1) / 2;
+		case COV_DIAGONAL:
+			return dimension;
+		case COV_SPHERICAL: default:
+			return 1;
+		}
+	}
+
+	//! Number of values of the factorization: d x d for a full matrix, d for a diagonal one, and 1 for a spherical one
+	size_t factorSize() const {
+		switch (type) {
+		case COV_FULL:
+			return dimension * dimension;
+		case COV_DIAGONAL:
+			return dimension;
+		case COV_SPHERICAL: default:
+			return 1;
+		}
+	}
+
+	/**
+	 * Copy the factorization, valid after factorize(), to "factor" (factorSize() values): the Cholesky factor L
+	 * row-major (full), or the inverse variances (diagonal, spherical). See ModelSnapshot.
+	 */
+	void copyFactor(value_t *factor) const {
+		if (type == COV_FULL) {
+			Eigen::Map<Eigen::Matrix<value_t,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> >(factor, dimension,
+					dimension) = cholesky.matrixL().toDenseMatrix();
+		} else {
+			Eigen::Map<vector_t>(factor, inverse_variances.size()) = inverse_variances;
+		}
+	}
+
+	//! The covariance as dense d x d matrix (for printing)
+	matrix_t matrix() const {
+		switch (type) {
+		case COV_FULL:
+			return full;
+		case COV_DIAGONAL:
+			return variances.asDiagonal();
+		case COV_SPHERICAL: default:
+			return matrix_t::Identity(dimension, dimension) * variances[0];
+		}
+	}
+
+	inline CovarianceType structure() const { return type; }
+
+	inline size_t size() const { return dimension; }
+
+private:
+	CovarianceType type;
+
+	size_t dimension;
+
+	//! The full matrix and its Cholesky factor (COV_FULL)
+	matrix_t full;
+	Eigen::LLT<matrix_t> cholesky;
+
+	//! The variances, d of them (COV_DIAGONAL) or one (COV_SPHERICAL), and their inverses
+	vector_t variances;
+	vector_t inverse_variances;
+
+	value_t log_determinant;
+};
+
+#endif /* COVARIANCE_HPP_ */
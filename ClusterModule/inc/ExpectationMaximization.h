@@ -28,20 +28,32 @@
 #define EXPECTATIONMAXIMIZATION_H_
 
 #include <Eigen/LU>
+#include <Eigen/Cholesky>
 #include <cmath>
 #include <cassert>
 #include <cstdlib>
 #include <assert.hpp>
 #include <iomanip>
 #include <Print.hpp>
+#include <Covariance.hpp>
+#include <ContingencyTable.hpp>
+#include <ModelSnapshot.hpp>
+#include <ThreadPool.hpp>
 
 #include <map>
+#include <limits>
+#include <algorithm>
+#include <random>
 
-#define LINE_DETECTION
+// Fit lines in 2D rather than Gaussians: a component is a line plus the density of the residuals to it. Only the line
+// model is compiled in when this is defined, the covariance type then only shapes the density of the residuals.
+//#define LINE_DETECTION
 //#define VERBOSE
 #define ASSIGNMENT
 
-#define TEST_START_FROM_GROUND_TRUTH
+// For testing the line model on a data set of two lines of which the first half of the samples belong to the first line:
+// start from the ground truth lines and memberships, to see if EM diverges from it. Only meaningful for two components.
+//#define TEST_START_FROM_GROUND_TRUTH
 
 
 /**
@@ -54,6 +66,9 @@ class ExpectationMaximization {
 		typedef double value_t;
 		typedef Eigen::Matrix<value_t,Eigen::Dynamic,Eigen::Dynamic> matrix_t;
 		typedef Eigen::Matrix<value_t,Eigen::Dynamic,1> vector_t; // column_vector
+		typedef Eigen::Matrix<value_t,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> sample_matrix_t; // one row per item
+		typedef Eigen::Map<const sample_matrix_t> sample_map_t;
+		typedef Eigen::Map<const vector_t> vector_map_t;
 
 		struct Pair {
 			Pair(size_t ground_truth) {
@@ -66,11 +81,61 @@ class ExpectationMaximization {
 
 		// The hidden variables are these that define a Gaussian, we also add a weight for the mixture model
 		struct Gaussian {
-			matrix_t covariance;
+			Covariance covariance;
 			vector_t mean;
 			vector_t beta;
 			value_t weight;
 			std::vector<size_t> r_data;
+			//! Cached after each M-step (see prepare): log normalization constant
+			value_t log_normalization;
+		};
+
+		/**
+		 * The weighted sufficient statistics of one component: \sum_i r_i, \sum_i r_i x_i, and \sum_i r_i x_i x_i'. The
+		 * latter only if a full scatter matrix is required, otherwise only its diagonal. For line detection also with
+		 * weights r_i^2.
+		 */
+		struct Statistics {
+			value_t sum_w;
+			vector_t sum_x;
+			matrix_t sum_xx;
+			vector_t sum_xx_diagonal;
+#ifdef LINE_DETECTION
+			value_t sum_w2;
+			vector_t sum_x2;
+			matrix_t sum_xx2;
+#endif
+			void clear(size_t d, bool full) {
+				sum_w = 0;
+				sum_x.setZero(d);
+				if (full) sum_xx.setZero(d, d);
+				else sum_xx_diagonal.setZero(d);
+#ifdef LINE_DETECTION
+				sum_w2 = 0;
+				sum_x2.setZero(d);
+				sum_xx2.setZero(d, d);
+#endif
+			}
+			void add(const Statistics & other, bool full) {
+				sum_w += other.sum_w;
+				sum_x += other.sum_x;
+				if (full) sum_xx += other.sum_xx;
+				else sum_xx_diagonal += other.sum_xx_diagonal;
+#ifdef LINE_DETECTION
+				sum_w2 += other.sum_w2;
+				sum_x2 += other.sum_x2;
+				sum_xx2 += other.sum_xx2;
+#endif
+			}
+		};
+
+		/**
+		 * The results for one chunk of samples: the sufficient statistics per component, and the log-likelihood of
+		 * the samples in the chunk.
+		 */
+		struct Partial {
+			std::vector<Statistics> statistics;
+			value_t log_likelihood;
 		};
 
 		/*	struct Shape {
@@ -90,17 +155,29 @@ class ExpectationMaximization {
 
 		/**
 		 * The constructor requires a fixed number of clusters "K" and a fixed number of data items "D". It is a batch
-		 * process.
+		 * process. The covariance matrices of the components are full, diagonal (default), or spherical.
 		 */
-		ExpectationMaximization(int K, int D) {
+		ExpectationMaximization(int K, int D, CovarianceType covariance_type = COV_DIAGONAL) {
+#ifdef LINE_DETECTION
+			ASSERT_EQ(D, 2);
+#endif
 			long int seed = rdtsc();
 			//		seed = 51196996379962;
 			std::cout << "Use seed " << seed << std::endl;
-			srand(seed);
-
+			generator.seed(seed);
+
+			degrees_of_freedom = 4;
+			this->covariance_type = covariance_type;
+			dimension = D;
+			sample_count = 0;
+			sample_data = NULL;
+			sample_weights = NULL;
+			total_weight = 0;
+			once = 1;
 			mixture_model.resize(K);
 			for (int k = 0; k < K; ++k) {
 				init(k, D);
+				prepare(k);
 			}
 
 			for (int k = 0; k < mixture_model.size(); ++k) {
@@ -110,9 +187,13 @@ class ExpectationMaximization {
 				std::cout << "Init beta of model " << k << ": " << mixture_model[k].beta.transpose() << std::endl;
 			}
 			for (int k = 0; k < mixture_model.size(); ++k) {
-				std::cout << "Init covariance of model " << k << ": " << std::endl << mixture_model[k].covariance << std::endl;
+				std::cout << "Init covariance of model " << k << ": " << std::endl << mixture_model[k].covariance.matrix() << std::endl;
 			}
 			initialized = false;
+			tracking = false;
+			pool = NULL;
+			chunk_size = 0;
+			likelihood = -std::numeric_limits<value_t>::infinity();
 		}
 
 		~ExpectationMaximization() {}
@@ -124,13 +205,55 @@ class ExpectationMaximization {
 		void addSample(std::vector<float> & x, size_t label, size_t size = 0) {
 			if (!size) size = x.size();
 			ASSERT_LEQ(size, x.size());
-			vector_t v(size); 
-			v.setZero();
-			std::vector<double> x_double(x.begin(), x.end());
-			//v = vector_t::Map(x.data(), size, 1);
-			v = vector_t::Map(x_double.data(), size, 1); // create column-vector
-			data_set.push_back(v);
+			ASSERT_EQ(size, dimension);
+			samples.insert(samples.end(), x.begin(), x.begin() + size);
 			labels.push_back(Pair(label));
+			sample_count++;
+			sample_data = samples.data();
+			sample_weights = NULL;
+			total_weight = sample_count;
+		}
+
+		/**
+		 * Use "count" samples of which the values are stored contiguously at "x", one sample per row, instead of
+		 * adding them one by one. No copy is made, so several instances can use the same data (concurrently). The
+		 * data should outlive this instance. There are no ground truth labels, so evaluate() is not available.
+		 *
+		 * Optionally each sample has a weight, e.g. the number of samples it summarizes (see CFTree). The
+		 * responsibilities of a sample are multiplied by its weight in the M-step, and its log-likelihood as well.
+		 */
+		void setData(const value_t *x, size_t count, const value_t *weights = NULL) {
+			samples.clear();
+			labels.clear();
+			tracking = false;
+			sample_data = x;
+			sample_weights = weights;
+			sample_count = count;
+			total_weight = weights ? vector_map_t(weights, count).sum() : count;
+		}
+
+		//! The ground truth labels of the samples given by setData(), one per sample, for evaluate() and setTracking()
+		void setLabels(const std::vector<size_t> & ground_truth) {
+			ASSERT_EQ(ground_truth.size(), sample_count);
+			labels.assign(ground_truth.begin(), ground_truth.end());
+		}
+
+		/**
+		 * Seed the random generator of this instance, and draw the random initial components again. The generator is
+		 * not shared with other instances, so instances can be initialized concurrently, each reproducibly by its own
+		 * seed.
+		 */
+		void setSeed(unsigned int seed) {
+			generator.seed(seed);
+			for (int k = 0; k < mixture_model.size(); ++k) {
+				init(k, dimension);
+				prepare(k);
+			}
+		}
+
+		//! Sample "i" as column vector, no copy is made
+		inline vector_map_t sample(size_t i) const {
+			return vector_map_t(sample_data + i * dimension, dimension);
 		}
 
 		void init() {
@@ -138,22 +261,13 @@ class ExpectationMaximization {
 				std::cerr << "Already initialized. Not doing it again." << std::endl;
 				return;
 			}
-			size_t S = data_set.size();
-			probabilities.clear();
-			probabilities.resize(S);
-			for (int i = 0; i < S; ++i) {
-				probabilities[i].clear();
-				probabilities[i].resize(mixture_model.size());
-			}
+			size_t S = sample_count;
+			probabilities.setZero(S, mixture_model.size());
 #ifdef ASSIGNMENT
-			assignments.clear();
-			assignments.resize(S);
-			for (int i = 0; i < S; ++i) {
-				assignments[i].clear();
-				assignments[i].resize(mixture_model.size());
-			}
+			assignments.setZero(S, mixture_model.size());
 #endif
 			initialized = true;
+			if (tracking) build_table(std::vector<size_t>(sample_count, 0));
 			//testClosest();
 		}
 
@@ -181,10 +295,9 @@ class ExpectationMaximization {
 				std::cerr << "Not yet initialized, skip clustering step." << std::endl;
 				return;
 			}
-			static int once = 1;
 			if (!once) {	
-				for (int i = 0; i < data_set.size(); i++) {
-					std::cout << "Sample[i=" << i << "]: " << data_set[i][0] << "," << data_set[i][1] << std::endl;
+				for (int i = 0; i < sample_count; i++) {
+					std::cout << "Sample[i=" << i << "]: " << sample(i)[0] << "," << sample(i)[1] << std::endl;
 					std::cout << "Label: " << labels[i].ground_truth << std::endl;
 				}
 				once++;
@@ -193,6 +306,7 @@ class ExpectationMaximization {
 			std::cout << "Expectation step" << std::endl;
 #endif
 			calculate_probabilities();
+			if (tracking) update_table();
 #ifdef VERBOSE
 			std::cout << "Maximization step" << std::endl;
 #endif
@@ -202,11 +316,11 @@ class ExpectationMaximization {
 			if (once == 1) {
 				std::cout << "Set probabilities beforehand, to test if solution diverges from the ground truth" << std::endl;
 				for (int k = 0; k < mixture_model.size(); ++k) {
-					for (int i = 0; i < data_set.size()/2; ++i) {
-						probabilities[i][k] = (1-k)*0.70 + 0.15;
+					for (int i = 0; i < sample_count/2; ++i) {
+						probabilities(i,k) = (1-k)*0.70 + 0.15;
 					}
-					for (int i = data_set.size()/2; i < data_set.size(); ++i) {
-						probabilities[i][k] = k*0.70 + 0.15;
+					for (int i = sample_count/2; i < sample_count; ++i) {
+						probabilities(i,k) = k*0.70 + 0.15;
 					}
 				}
 				//
@@ -215,69 +329,128 @@ class ExpectationMaximization {
 #endif
 
 #ifdef ASSIGNMENT
-			for (int i = 0; i < data_set.size(); ++i) {
-				int k = 0, k_max = 0;
-				value_t max = probabilities[i][k];
-				for (k = 1; k < probabilities[i].size(); ++k) {
-					if (probabilities[i][k] > max) {
-						max = probabilities[i][k];
-						k_max = k;
-					}
-				}
-
-				for (k = 0; k < probabilities[i].size(); ++k) {
-					if (k == k_max) {
-						assignments[i][k] = 1;
-					} else {
-						assignments[i][k] = 0;
-					}
-				}
+			for (int i = 0; i < sample_count; ++i) {
+				sample_matrix_t::Index k_max;
+				probabilities.row(i).maxCoeff(&k_max);
+				assignments.row(i).setZero();
+				assignments(i,k_max) = 1;
 			}
+#ifdef VERBOSE
 			std::cout << "Assignments: " ;
-			for (int i = 0; i < data_set.size(); ++i) {
-				dobots::print(assignments[i].begin(), assignments[i].end());
+			for (int i = 0; i < sample_count; ++i) {
+				dobots::print(&assignments(i,0), &assignments(i,0) + assignments.cols());
 			}
+#endif
 #endif 
 
+			accumulate_statistics();
 			for (int k = 0; k < mixture_model.size(); ++k) {
 				calculate(k);
 			}
 		}
 
 		/**
-		 * After enough ticks feel free to evaluate the algorithm. In this case the Rand index is implemented. This 
-		 * takes into account false positives, false negatives, etc.
+		 * Use the given pool to run the E-step and the accumulation of the statistics for the M-step in parallel. The
+		 * samples are split in chunks that depend only on the number of samples, and the results of the chunks are
+		 * combined in chunk order, so the results do not depend on the number of threads. With NULL everything runs
+		 * on the calling thread. The pool is not owned and can be shared.
+		 */
+		void setThreadPool(ThreadPool *pool) {
+			this->pool = pool;
+		}
+
+		/**
+		 * The log-likelihood of the data under the model of the last E-step, \sum_i log \sum_k w_k p_k(x_i), with p_k
+		 * the t-distributions (see log_t_distribution). Note that the M-step uses Gaussian estimates, so it is not
+		 * guaranteed to increase every tick.
+		 */
+		inline value_t log_likelihood() const { return likelihood; }
+
+		/**
+		 * The index of the component that most probably generated the sample "x" of "dimension" values. The sample
+		 * does not have to be one of the samples that are clustered.
+		 */
+		size_t classify(const value_t *x) {
+			std::vector<value_t> log_probabilities(mixture_model.size());
+			generated_by(vector_map_t(x, dimension), log_probabilities.data());
+			return std::max_element(log_probabilities.begin(), log_probabilities.end()) - log_probabilities.begin();
+		}
+
+		/**
+		 * Store the mixture in "snapshot", to classify samples later without the data (see ModelSnapshot). With line
+		 * detection the lines of the components are stored as well.
+		 */
+		void snapshot(ModelSnapshot & snapshot) const {
+#ifdef LINE_DETECTION
+			const bool lines = true;
+#else
+			const bool lines = false;
+#endif
+			snapshot.createMixture(mixture_model.size(), dimension, covariance_type, degrees_of_freedom, lines);
+			for (size_t k = 0; k < mixture_model.size(); ++k) {
+				const Gaussian & g = mixture_model[k];
+				snapshot.setComponent(k, g.weight, g.mean, g.covariance, g.log_normalization);
+				if (lines) snapshot.setLine(k, g.beta);
+			}
+		}
+
+		/**
+		 * The number of free parameters of the mixture: K-1 weights, and per component its mean and covariance
+		 * matrix. For model selection criteria, together with log_likelihood().
+		 */
+		size_t parameters() const {
+			size_t p = mixture_model.size() - 1;
+			for (size_t k = 0; k < mixture_model.size(); ++k) {
+				p += dimension + mixture_model[k].covariance.parameters();
+			}
+			return p;
+		}
+
+		//! Number of components
+		inline size_t clusterCount() const { return mixture_model.size(); }
+
+		//! The mean of component "k"
+		inline const vector_t & clusterMean(size_t k) const { return mixture_model[k].mean; }
+
+		//! The covariance matrix of component "k"
+		inline const Covariance & clusterCovariance(size_t k) const { return mixture_model[k].covariance; }
+
+		/**
+		 * Keep the contingency table of components versus ground truth labels up to date, see quality(). Each tick the
+		 * samples are assigned to their most probable component under the responsibilities of its E-step, and only
+		 * the samples that changed component are moved in the table.
+		 */
+		void setTracking(bool enable) {
+			tracking = enable && labels.size() == sample_count;
+			if (tracking && initialized) build_table(std::vector<size_t>(sample_count, 0));
+		}
+
+		/**
+		 * The contingency table. Up to date after each tick with tracking (see setTracking), otherwise only after
+		 * evaluate().
+		 */
+		inline const ContingencyTable & quality() const { return table; }
+
+		/**
+		 * After enough ticks feel free to evaluate the algorithm. Each sample is assigned to the component that most
+		 * likely generated it, and compared with the ground truth through a contingency table, in one pass. The Rand
+		 * index, adjusted Rand index, normalized mutual information, and purity are printed.
 		 */
 		void evaluate() {
+			if (labels.size() != sample_count) {
+				std::cerr << "There are no ground truth labels to evaluate with" << std::endl;
+				return;
+			}
 			for (int k = 0; k < mixture_model.size(); ++k) {
 				mixture_model[k].r_data.clear();
 			}
 
-			for (int i = 0; i < data_set.size(); ++i) {
-				labels[i].prediction = generated_by(i);
-			}
-
-			size_t a, b, c, d; a = b = c = d = 0;
-			for (int i = 0; i < data_set.size(); ++i) {
-				for (int j = i+1; j < data_set.size(); ++j) {
-					if (labels[i].ground_truth == labels[j].ground_truth) {
-						if (labels[i].prediction == labels[j].prediction) {
-							a++;
-						} else {
-							c++;
-						}
-					} else {
-						if (labels[i].prediction == labels[j].prediction) {
-							d++;
-						} else {
-							b++;
-						}
-					}
-				}
+			std::vector<size_t> predictions(sample_count);
+			for (int i = 0; i < sample_count; ++i) {
+				labels[i].prediction = predictions[i] = generated_by(i);
 			}
-
-			value_t quality = (a+b) / value_t(a+b+c+d);
-			std::cout << "Rand index is " << quality << std::endl;
+			build_table(predictions);
+			table.print();
 		}
 
 		void print() {
@@ -315,7 +488,7 @@ class ExpectationMaximization {
 			}
 
 			for (int k = 0; k < mixture_model.size(); ++k) {
-				std::cout << "Final covariance of model " << k << ": " << std::endl << mixture_model[k].covariance << std::endl;
+				std::cout << "Final covariance of model " << k << ": " << std::endl << mixture_model[k].covariance.matrix() << std::endl;
 			}
 
 		}
@@ -348,9 +521,14 @@ class ExpectationMaximization {
 			//		std::cout << "Initialize k=" << k << " and d=" << d << std::endl;
 			assert (mixture_model.size());
 			mixture_model[k].r_data.clear();
-			mixture_model[k].mean.setRandom(d);
-			mixture_model[k].mean = (mixture_model[k].mean.array() + 1) / 2;
-			mixture_model[k].beta.setRandom(d);
+			// uniform in [0,1) for the mean and in [-1,1) for the line parameters
+			std::uniform_real_distribution<value_t> uniform(0, 1);
+			mixture_model[k].mean.resize(d);
+			mixture_model[k].beta.resize(d);
+			for (int j = 0; j < d; ++j) {
+				mixture_model[k].mean[j] = uniform(generator);
+				mixture_model[k].beta[j] = 2 * uniform(generator) - 1;
+			}
 
 #ifdef TEST_START_FROM_GROUND_TRUTH
 			std::cout << "Set beta to ground truth" << std::endl;
@@ -362,7 +540,7 @@ class ExpectationMaximization {
 				mixture_model[k].beta[1] = -1;
 			}
 #endif
-			mixture_model[k].covariance = matrix_t::Identity(d, d);
+			mixture_model[k].covariance.setIdentity(covariance_type, d);
 			//		mixture_model[k].covariance *= 0.1;
 			assert (mixture_model.size() != 0);
 			mixture_model[k].weight = 1.0/mixture_model.size();
@@ -459,39 +637,67 @@ class ExpectationMaximization {
 		 *   f(x_1,...x_d) = G((\tau+1)/2)/( G(\tau/2) sqrt(pi*\tau) * |\Sigma| )  * ( 1 -1/\tau * (x-\mu)' \Sigma^-1 (x-\mu ) ) ^ ((-\tau+1)/2)
 		 *
 		 * G is the Gamma function.
-		 */	
-		value_t t_distribution(const vector_t & x, const vector_t &mean, const matrix_t covariance, const value_t dof) {
-			value_t det = fabs(covariance.determinant());
-			assert (det >= 0.0);
-			assert (mean.size());
-			if (det < 0.0001) {
-				std::cout << "Determinant is zero, means that the matrix is rank deficient" << std::endl;
-				std::cout << "This means that the random variables are perfectly correlated" << std::endl;
-			}
-			value_t sq = std::pow(2.0*M_PI,mean.size()) * det ;
-			assert (sq >= 0.0);
-			value_t factor = std::sqrt( sq );
-#ifdef VERBOSE
-			//	std::cout << "Multiply by " << (value_t(1)/factor) << " which is 1/sqrt(" << std::pow(2.0*M_PI,mean.size())
-			//	<< "*" << det << ")" << std::endl;
-#endif
-			value_t result = (value_t(1)/factor) * t_distribution_Gamma_factor(dof) *
-				std::pow(1 + 1/dof * (value_t)((x-mean).transpose() * covariance.inverse() * (x-mean)) , -(dof+1)/2);
+		 *
+		 * Returns the logarithm of f. Everything that does not depend on x is cached per component "k" by prepare(k), so
+		 * per call only the Mahalanobis distance is calculated. For a full covariance matrix this is a triangular solve
+		 * on its Cholesky factor L, \Sigma = LL': (x-\mu)' \Sigma^-1 (x-\mu) = |L^-1 (x-\mu)|^2, which is O(d^2)
+		 * rather than O(d^3). For diagonal and spherical covariance matrices it is O(d).
+		 */
+		template<typename Derived, typename Location>
+		value_t log_t_distribution(const Eigen::MatrixBase<Derived> & x, const Eigen::MatrixBase<Location> & location,
+				int k) {
+			const Gaussian & g = mixture_model[k];
+			value_t mahalanobis = g.covariance.mahalanobis(x - location);
+			value_t result = g.log_normalization -
+				(degrees_of_freedom+1)/2 * std::log1p(mahalanobis / degrees_of_freedom);
 
 #ifdef VERBOSE
-			std::cout << "Student-t distance between (" << mean.transpose() << ") and data (" << x.transpose() <<
+			std::cout << "Student-t log density between (" << location.transpose() << ") and data (" << x.transpose() <<
 				") is " << result << std::endl;
 #endif
-
-			int large_number = 1000;
-			if ((result != result) || (result > large_number)) {
-#ifdef VERBOSE
-				std::cout << "Return " << large_number << " as large number" << std::endl;
-#endif
-				return 1000;
+			// as before, cap the density (in case of a degenerate covariance matrix)
+			const value_t log_large_number = std::log(1000.0);
+			if ((result != result) || (result > log_large_number)) {
+				return log_large_number;
 			}
 			return result;
+		}
+
+		//! Count the given predictions in the contingency table, O(N)
+		void build_table(const std::vector<size_t> & predictions) {
+			table.reset(mixture_model.size());
+			for (size_t i = 0; i < sample_count; ++i) {
+				table.add(predictions[i], labels[i].ground_truth);
+			}
+			tracked = predictions;
+		}
 
+		//! Move the samples of which the most probable component changed in the contingency table
+		void update_table() {
+			for (size_t i = 0; i < sample_count; ++i) {
+				sample_matrix_t::Index k_max;
+				probabilities.row(i).maxCoeff(&k_max);
+				if ((size_t)k_max == tracked[i]) continue;
+				table.move(labels[i].ground_truth, tracked[i], k_max);
+				tracked[i] = k_max;
+			}
+		}
+
+		/**
+		 * Calculate the quantities of component "k" that do not depend on the data: the factorization of its
+		 * covariance matrix (see Covariance::factorize) and the logarithm of the normalization constant of the
+		 * t-distribution,
+		 *
+		 *   log( G((\tau+1)/2)/( G(\tau/2) sqrt(pi*\tau)) ) - 1/2 log( (2*PI)^d |\Sigma| )
+		 *
+		 * Call after each update of the covariance matrix.
+		 */
+		void prepare(int k) {
+			Gaussian & g = mixture_model[k];
+			const int d = g.covariance.size();
+			g.covariance.factorize();
+			g.log_normalization = std::log(t_distribution_Gamma_factor(degrees_of_freedom)) -
+				value_t(0.5) * (d * std::log(2.0*M_PI) + g.covariance.logDeterminant());
 		}
 
 #ifndef LINE_DETECTION
@@ -500,20 +706,24 @@ class ExpectationMaximization {
 		 * This is part of the expectation step. It calculates the probability that data item "i" is indeed generated 
 		 * by kernel "k". Use it in lock-step with the maximization step.
 		 *
-		 * For one item "i" it iterates over all clusters k, and calculates:
-		 *   prob_cluster[k] = cluster_weight * gaussian_distance(i, k)
+		 * For one item "i" it iterates over all clusters k, and calculates (in log space):
+		 *   log_prob_cluster[k] = log(cluster_weight) + log_distance(i, k)
 		 * 
 		 * This function needs to be called for all items "i".
 		 */
-		void generated_by(int i, std::vector<value_t> &clusters) {
-			assert (i < data_set.size());
+		void generated_by(int i, value_t *clusters) {
+			assert (i < sample_count);
+			generated_by(sample(i), clusters);
+		}
 
-			// calculate the contribution to "i" for every model
+		//! As generated_by(i, clusters) for a sample "x" that is given by value
+		template<typename Derived>
+		void generated_by(const Eigen::MatrixBase<Derived> & x, value_t *clusters) {
+			// calculate the contribution to "x" for every model
 			for (int m = 0; m < mixture_model.size(); ++m) {
 				//			std::cout << "Covariance: " << std::endl << mixture_model[m].covariance << std::endl;
-				clusters[m] = mixture_model[m].weight *
-					t_distribution(data_set[i], mixture_model[m].mean, mixture_model[m].covariance, 4);
-					//gaussian_kernel(data_set[i], mixture_model[m].mean, mixture_model[m].covariance);
+				clusters[m] = std::log(mixture_model[m].weight) +
+					log_t_distribution(x, mixture_model[m].mean, m);
 #ifdef VERBOSE
 				//			std::cout << "Generated " << i << " by cluster " << m << " as " << clusters[m] <<
 				//					" from weight " << mixture_model[m].weight <<
@@ -556,9 +766,12 @@ class ExpectationMaximization {
 		 *
 		 * Function is checked. 
 		 *
+		 * The point "x" and the result "cl" can be fixed-size vectors, so no memory is allocated per call.
+		 *
 		 * @todo Vertical and horizontal lines
 		 */
-		void closest(const vector_t & beta, const vector_t &x, vector_t & cl) {
+		template<typename DerivedX, typename DerivedCl>
+		void closest(const vector_t & beta, const Eigen::MatrixBase<DerivedX> & x, Eigen::MatrixBase<DerivedCl> & cl) {
 			assert (beta.size() == 2);
 			assert(cl.size() == 2);
 			value_t a = beta[1];
@@ -579,20 +792,25 @@ class ExpectationMaximization {
 #ifdef LINE_DETECTION
 		/**
 		 * Calculate the probability that a data point is generated by each of the clusters. Hence, returns a vector 
-		 * of length K, for each cluster a probability.
+		 * of length K, for each cluster the logarithm of a (not normalized) probability.
 		 */
-		void generated_by(int i, std::vector<value_t> &clusters) {
-			assert(i < data_set.size());
+		void generated_by(int i, value_t *clusters) {
+			assert(i < sample_count);
+			generated_by(sample(i), clusters);
+		}
 
+		//! As generated_by(i, clusters) for a sample "y" that is given by value, the points are on the stack
+		template<typename Derived>
+		void generated_by(const Eigen::MatrixBase<Derived> & y, value_t *clusters) {
+			assert (y.size() == 2);
+			const Eigen::Matrix<value_t,2,1> x = y;
+			Eigen::Matrix<value_t,2,1> cl;
 			for (int m = 0; m < mixture_model.size(); ++m) {
 				// error residual for i vs m:
 				//mixture_model[m].mean = distance(data_set[i], mixture_model[m].pnt0, mixture_model[m].pnt1);
-				vector_t cl(2);
-				closest(mixture_model[m].beta, data_set[i], cl);
+				closest(mixture_model[m].beta, x, cl);
 				// now use the error residual as input for the Gaussian model
-				clusters[m] = mixture_model[m].weight *
-					t_distribution(data_set[i], cl, mixture_model[m].covariance, 4);
-//					gaussian_kernel(data_set[i], cl, mixture_model[m].covariance);
+				clusters[m] = std::log(mixture_model[m].weight) + log_t_distribution(x, cl, m);
 			}
 		}
 #endif
@@ -605,13 +823,17 @@ class ExpectationMaximization {
 		 *
 		 *   h_s(t) = w_s p_s(x; \mu_s, \Sigma_s) / { sum_i w_i p_i(x; \mu_i, \Sigma_i) }
 		 *
-		 * To calculate this we first calculate "w_i p_i(x; \mu_i, \Sigma_i)" for all "i" and then uses these values to 
-		 * calculate the fraction.
+		 * To calculate this we first calculate "log w_i p_i(x; \mu_i, \Sigma_i)" for all "i" and then uses these values to 
+		 * calculate the fraction. The largest term is subtracted before exponentiation (log-sum-exp), so the fraction 
+		 * does not underflow, not even in high dimensions where the densities themselves are tiny.
 		 *
 		 * This is called the expectation step in Expectation-Maximization. 
 		 *
 		 * It is called here "calculate_probabilities" because the result is a NxK matrix of membership weights, where 
 		 * each row sums to one.
+		 *
+		 * The samples are processed per chunk (in parallel if there is a thread pool). The log-likelihood is summed
+		 * per chunk and the chunk sums are added in chunk order.
 		 */
 		void calculate_probabilities() {
 #ifdef VERBOSE
@@ -620,54 +842,70 @@ class ExpectationMaximization {
 				std::cout << "Calculate for cluster " << k << std::endl;
 				std::cout << "Weight " << mixture_model[k].weight << std::endl;
 				std::cout << "Mean " << mixture_model[k].mean.transpose() << std::endl;
-				std::cout << "Covariance " << std::endl << mixture_model[k].covariance << std::endl;
-				std::cout << " with determinant " << mixture_model[k].covariance.determinant() << std::endl;
+				std::cout << "Covariance " << std::endl << mixture_model[k].covariance.matrix() << std::endl;
+				std::cout << " with log normalization " << mixture_model[k].log_normalization << std::endl;
 			}
 #endif
-			const int data_set_size = probabilities.size();
-			//std::cout << "Data size: " << data_set_size << std::endl;
+			const size_t chunks = chunk_count();
+			partials.resize(chunks);
+			run(chunks, [this] (size_t c) {
+				partials[c].log_likelihood = calculate_probabilities(c * chunk_size,
+						std::min((c + 1) * chunk_size, sample_count));
+			});
+			likelihood = 0;
+			for (size_t c = 0; c < chunks; ++c) {
+				likelihood += partials[c].log_likelihood;
+			}
+		}
+
+		/**
+		 * The E-step for the samples in [begin, end). Returns their log-likelihood.
+		 */
+		value_t calculate_probabilities(size_t begin, size_t end) {
+			const int K = probabilities.cols();
+			value_t log_likelihood = 0;
 
 			// get probabilities that item "i" is generated by all of the k clusters 
-			// probabilities[i] is a vector of size "k"
+			// probabilities.row(i) is a vector of size "k"
 			// probabilities is the same size as the entire dataset of points
-			//std::cout << "Get for each data point, probability that it is generated by all of the clusters" << std::endl;
-			for (int i = 0; i < data_set_size; ++i) {
-				generated_by(i, probabilities[i]);
+			for (size_t i = begin; i < end; ++i) {
+				generated_by(i, &probabilities(i,0));
 			}
 
 			// sum all "probabilities" and divide the individual "probabilities" so the result is an actual 
-			// normalized probability
-			//std::cout << "Sum all probabilities (per cluster) to get means" << std::endl;
-			for (int i = 0; i < probabilities.size(); ++i) {
+			// normalized probability, the maximum log probability is subtracted first
+			for (size_t i = begin; i < end; ++i) {
 				value_t sum = 0;
-				ASSERT_EQ(mixture_model.size(), probabilities[i].size());
-				for (int k = 0; k < probabilities[i].size(); ++k) {
-					sum += probabilities[i][k];
+				ASSERT_EQ(mixture_model.size(), K);
+				value_t max = probabilities.row(i).maxCoeff();
+				for (int k = 0; k < K; ++k) {
+					probabilities(i,k) = (max == -std::numeric_limits<value_t>::infinity()) ? 0 :
+						std::exp(probabilities(i,k) - max);
+					sum += probabilities(i,k);
 				}
 				if (sum != 0) {
-					for (int k = 0; k < probabilities[i].size(); ++k) {
-						probabilities[i][k] = probabilities[i][k] / sum;
-						ASSERT_LEQ(probabilities[i][k], 1.0);
-						ASSERT_GEQ(probabilities[i][k], 0.0);
+					log_likelihood += (sample_weights ? sample_weights[i] : 1) * (max + std::log(sum));
+					for (int k = 0; k < K; ++k) {
+						probabilities(i,k) = probabilities(i,k) / sum;
+						ASSERT_LEQ(probabilities(i,k), 1.0);
+						ASSERT_GEQ(probabilities(i,k), 0.0);
 					}
 #ifdef EXCESSIVE_TESTS
 					// for testing, check that the total sum is 1, each cluster has a part of this cake
-					sum = 0;
-					for (int k = 0; k < probabilities[i].size(); ++k) {
-						sum += probabilities[i][k];
-					}
+					sum = probabilities.row(i).sum();
 					ASSERT_ALMOST_EQ(sum, 1, 0.01);
 #endif
 				}
 
 #ifdef VERBOSE
-				std::cout << "Calculated probability of " << data_set[i].transpose() << " (for cluster k=[0..." << probabilities[i].size()-1 << "]): [ ";
-				for (int k = 0; k < probabilities[i].size(); ++k) {
-					std::cout << std::setw(4) << std::fixed << std::setprecision(3) << probabilities[i][k] << ' ';
+				std::cout << "Calculated probability of " << sample(i).transpose() << " (for cluster k=[0..." << K-1 << "]): [ ";
+				for (int k = 0; k < K; ++k) {
+					std::cout << std::setw(4) << std::fixed << std::setprecision(3) << probabilities(i,k) << ' ';
 				}
 				std::cout << ']' << std::endl;
 #endif
 			}
+			return log_likelihood;
 		}
 
 		/**
@@ -675,22 +913,154 @@ class ExpectationMaximization {
 		 * probabilities and returning the kernel for which the probability is at its maximum value.
 		 */
 		int generated_by(int i) {
-			int k = 0, k_max = 0;
-			value_t max = probabilities[i][k];
-			for (k = 1; k < probabilities[i].size(); ++k) {
-				if (probabilities[i][k] > max) {
-					max = probabilities[i][k];
-					k_max = k;
-				}
-			}
+			sample_matrix_t::Index k_max;
+			probabilities.row(i).maxCoeff(&k_max);
 			mixture_model[k_max].r_data.push_back(i);
 			return k_max;
 		}
 
+		/**
+		 * Accumulate the weighted sufficient statistics of all components in one pass over the data. The data is
+		 * processed in tiles of rows, so a tile is read once from memory for all K components:
+		 *
+		 *   \sum_i r_ik,  \sum_i r_ik x_i,  \sum_i r_ik x_i x_i'
+		 *
+		 * The second sum is one matrix product (R' X) per tile. The third is a symmetric rank-n update per component
+		 * with the rows of the tile scaled by sqrt(r_ik), so no d x d temporary is created per sample. For diagonal and
+		 * spherical covariance matrices only the diagonal of the third sum is needed, this is one matrix product as
+		 * well (R' (X.*X)).
+		 *
+		 * For line detection the same sums are collected as well with weights r_ik^2.
+		 *
+		 * With sample weights (see setData) the rows of R are multiplied by the weights of the samples in the tile.
+		 *
+		 * Each chunk of samples (see calculate_probabilities) gets its own statistics, and these are added in chunk
+		 * order.
+		 */
+		void accumulate_statistics() {
+			const size_t K = mixture_model.size();
+			const bool full = full_scatter();
+			const size_t chunks = chunk_count();
+			partials.resize(chunks);
+			run(chunks, [this] (size_t c) {
+				accumulate(partials[c], c * chunk_size, std::min((c + 1) * chunk_size, sample_count));
+			});
+			statistics.resize(K);
+			for (size_t k = 0; k < K; ++k) {
+				statistics[k].clear(dimension, full);
+				for (size_t c = 0; c < chunks; ++c) {
+					statistics[k].add(partials[c].statistics[k], full);
+				}
+			}
+		}
+
+		/**
+		 * Accumulate the statistics of the samples in [begin, end) in "partial", see accumulate_statistics().
+		 */
+		void accumulate(Partial & partial, size_t begin, size_t end) {
+			const size_t K = mixture_model.size();
+			const size_t d = dimension;
+			const bool full = full_scatter();
+			std::vector<Statistics> & statistics = partial.statistics;
+			statistics.resize(K);
+			for (size_t k = 0; k < K; ++k) {
+				statistics[k].clear(d, full);
+			}
+
+#ifdef ASSIGNMENT
+			// introduce an assignment step, probabilities[i][k] will be set to 0 and 1
+			// or perhaps 0 versus a normalized probability in a multi-component setting
+			const sample_matrix_t & weights = assignments;
+#else
+			const sample_matrix_t & weights = probabilities;
+#endif
+			matrix_t sum_x(K, d), sum_xx_diagonal(K, d);
+			sum_x.setZero();
+			sum_xx_diagonal.setZero();
+			sample_matrix_t weighted;
+			for (size_t b = begin; b < end; b += block_size) {
+				const size_t n = std::min((size_t)block_size, end - b);
+				sample_map_t x(sample_data + b * d, n, d);
+				const value_t *tile = &weights(b,0);
+				if (sample_weights) {
+					weighted = sample_map_t(tile, n, K).array().colwise() * vector_map_t(sample_weights + b, n).array();
+					tile = weighted.data();
+				}
+				sample_map_t r(tile, n, K);
+				sum_x.noalias() += r.transpose() * x;
+				if (!full) {
+					sum_xx_diagonal.noalias() += r.transpose() * x.cwiseAbs2();
+				}
+				for (size_t k = 0; k < K; ++k) {
+					Statistics & stat = statistics[k];
+					stat.sum_w += r.col(k).sum();
+					if (full) {
+						matrix_t y = x.array().colwise() * r.col(k).array().sqrt();
+						stat.sum_xx.selfadjointView<Eigen::Lower>().rankUpdate(y.transpose());
+					}
+#ifdef LINE_DETECTION
+					matrix_t y2 = x.array().colwise() * r.col(k).array();
+					stat.sum_w2 += r.col(k).squaredNorm();
+					stat.sum_x2 += y2.colwise().sum().transpose();
+					stat.sum_xx2.selfadjointView<Eigen::Lower>().rankUpdate(y2.transpose());
+#endif
+				}
+			}
+			for (size_t k = 0; k < K; ++k) {
+				statistics[k].sum_x = sum_x.row(k).transpose();
+				if (full) statistics[k].sum_xx = statistics[k].sum_xx.selfadjointView<Eigen::Lower>();
+				else statistics[k].sum_xx_diagonal = sum_xx_diagonal.row(k).transpose();
+#ifdef LINE_DETECTION
+				statistics[k].sum_xx2 = statistics[k].sum_xx2.selfadjointView<Eigen::Lower>();
+#endif
+			}
+		}
+
+		/**
+		 * The number of chunks the samples are split in for (parallel) processing. The chunk size depends only on the
+		 * number of samples and is a multiple of the tile size.
+		 */
+		size_t chunk_count() {
+			chunk_size = std::max((size_t)min_chunk_size, (sample_count / max_chunks + block_size) / block_size * block_size);
+			return (sample_count + chunk_size - 1) / chunk_size;
+		}
+
+		//! Run the job for all chunks, on the pool if there is one
+		void run(size_t chunks, const std::function<void(size_t)> & job) {
+			if (pool) {
+				pool->run(chunks, job);
+			} else {
+				for (size_t c = 0; c < chunks; ++c) job(c);
+			}
+		}
+
+		/**
+		 * The full scatter matrix is needed for a full covariance matrix and for line detection (of which the residual
+		 * is a linear combination of the dimensions).
+		 */
+		inline bool full_scatter() const {
+#ifdef LINE_DETECTION
+			return true;
+#else
+			return covariance_type == COV_FULL;
+#endif
+		}
+
+		/**
+		 * The weighted scatter matrix around "mean" of the affinely transformed samples A x + e, from the sufficient
+		 * statistics (with W = \sum_i w_i, S = \sum_i w_i x_i, Q = \sum_i w_i x_i x_i'):
+		 *
+		 *   \sum_i w_i (A x_i + e)(A x_i + e)' = A Q A' + A S e' + e S' A' + W e e'
+		 */
+		matrix_t scatter(const matrix_t & A, const vector_t & e, value_t W, const vector_t & S, const matrix_t & Q) {
+			vector_t AS = A * S;
+			return A * Q * A.transpose() + AS * e.transpose() + e * AS.transpose() + W * e * e.transpose();
+		}
+
 		/**
 		 * This is the "maximization" step in the Expectation-Maximization algorithm. It assigns for each cluster k its
 		 * new weight, mean, and covariance. The mixture weight is the support a specific mixture "k" has along all the
-		 * data points.
+		 * data points. Everything is calculated from the sufficient statistics, see accumulate_statistics().
 		 *
 		 * This does not work for line estimation. The outliers from other lines destroy the line estimation problem in
 		 * such way that it is impossible in such way that the EM algorithm even diverges from the ground truth, given
@@ -698,41 +1068,16 @@ class ExpectationMaximization {
 		 * interpretation of the weights, moves indeed outliers closer to the origin. 
 		 */
 		void calculate(int k) {
-			assert (data_set.size() != 0);
+			assert (sample_count != 0);
 
-			value_t sum_w = 0;
-			size_t d = data_set[0].size();
-			//		size_t d = probabilities.size();
-			vector_t sum_mu(d);
+			const Statistics & stat = statistics[k];
+			const size_t d = dimension;
+			const value_t sum_w = stat.sum_w;
+			matrix_t identity = matrix_t::Identity(d, d);
 			matrix_t sum_sigma(d,d);
 
-			sum_mu.setZero();
-			sum_sigma.setZero();
-#ifdef TWEAK1
-			sum_sigma.setIdentity();
-			sum_sigma *= 0.1;
-#endif
-
-#ifdef ASSIGNMENT
-			// introduce an assignment step, probabilities[i][k] will be set to 0 and 1
-			// or perhaps 0 versus a normalized probability in a multi-component setting
-
-#endif		
-			// sum probabilities for cluster "k" for the entire dataset, and calculate its support over the entire
-			// dataset
-			for (int i = 0; i < data_set.size(); ++i) {
-				value_t p = probabilities[i][k];
-#ifdef ASSIGNMENT
-				p *= assignments[i][k];
-				p = assignments[i][k];
-#endif
-				sum_w += p;
-				// incorporate (2D) point i with weight probabilities[i][k] in mean \mu
-				sum_mu += (p*data_set[i]);
-			}
-
-			// mixture weight is all probabilities per data point divided by the size of the dataset
-			mixture_model[k].weight = sum_w / (value_t)data_set.size();
+			// mixture weight is all probabilities per data point divided by the size (total weight) of the dataset
+			mixture_model[k].weight = sum_w / total_weight;
 #ifdef TWEAK2
 			// tweak in case the weights drop below a certain threshold
 			value_t threshold = 1.0/(mixture_model.size() * 10);
@@ -743,57 +1088,24 @@ class ExpectationMaximization {
 
 			// calculate new mean
 			if (sum_w != 0) {
-				mixture_model[k].mean = sum_mu / sum_w;
+				mixture_model[k].mean = stat.sum_x / sum_w;
 			} else {
-				mixture_model[k].mean = sum_mu;
+				mixture_model[k].mean = stat.sum_x;
 			}
-
+			const vector_t & mean = mixture_model[k].mean;
 
 #ifdef LINE_DETECTION
-			// shift to origin
-			for (int i = 0; i < data_set.size(); ++i) {
-				data_set[i] -= mixture_model[k].mean;
-			}
-
-#ifdef VERBOSE
-			vector_t tavg(d); tavg.setZero();
-			for (int i = 0; i < data_set.size(); ++i) {
-				value_t p = probabilities[i][k];
-#ifdef ASSIGNMENT
-				p *= assignments[i][k];
-				p = assignments[i][k];
-#endif
-				tavg += data_set[i]*p;
-			}
-			std::cout << "New average should be around origin, so sum should be zero: " << tavg.transpose() << std::endl;
-#endif
-
-			// calculate covariance matrix
-			value_t sxx = 0, sxy = 0, syy = 0;
-			for (int i = 0; i < data_set.size(); ++i) {
-				//vector_t dd = (probabilities[i][k]*data_set[i] - mixture_model[k].mean);
-				value_t p = probabilities[i][k];
-#ifdef ASSIGNMENT
-				p *= assignments[i][k];
-				p = assignments[i][k];
-#endif
-				vector_t dd = p*data_set[i];
-				//std::cout << "diff [k=" << k << "][i=" << i << "]: " << dd.transpose() << std::endl;
-				sxx += dd[0]*dd[0];
-				syy += dd[1]*dd[1];
-				sxy += dd[0]*dd[1];
-			}
+			// second-order moment of the samples shifted to the origin, with squared weights
+			matrix_t moment = scatter(identity, -mean, stat.sum_w2, stat.sum_x2, stat.sum_xx2);
 			// normalize as second-order moment
-			sxx = sxx / (value_t)(data_set.size() - 1);
-			syy = syy / (value_t)(data_set.size() - 1);
-			sxy = sxy / (value_t)(data_set.size() - 1);
-
+			value_t sxx = moment(0,0) / (total_weight - 1);
+			value_t syy = moment(1,1) / (total_weight - 1);
+			value_t sxy = moment(0,1) / (total_weight - 1);
 #endif
 
-
 #ifdef VERBOSE
-			std::cout << "weight [k=" << k << "]: " << sum_w << " / " << data_set.size() << std::endl;
-			std::cout << "mean [k=" << k << "]: (" << sum_mu.transpose() << ") / " << sum_w << std::endl;
+			std::cout << "weight [k=" << k << "]: " << sum_w << " / " << total_weight << std::endl;
+			std::cout << "mean [k=" << k << "]: (" << stat.sum_x.transpose() << ") / " << sum_w << std::endl;
 #endif
 
 			//#define TWEAK
@@ -821,54 +1133,43 @@ class ExpectationMaximization {
 			std::cout << "beta (D,s) for " << k << ": " << mixture_model[k].beta[0] << " " << mixture_model[k].beta[1] << std::endl;
 
 			std::cout << "mean (x,y) for " << k << ": " << mixture_model[k].mean[0] << " " << mixture_model[k].mean[1] << std::endl;
-#endif
 
-			// calculate new covariance matrix
-			for (int i = 0; i < data_set.size(); ++i) {
-				value_t p = probabilities[i][k];
-				ASSERT_LEQ(p, 1.0);
-				ASSERT_GEQ(p, 0.0);
-#ifdef ASSIGNMENT
-				p *= assignments[i][k];
-				p = assignments[i][k];
-#endif
-#ifdef LINE_DETECTION
-				vector_t cl(2);
-				closest(mixture_model[k].beta, data_set[i], cl);
-				matrix_t m = (data_set[i] - cl) * (data_set[i] - cl).transpose();
+			// calculate new covariance matrix of the residuals x - cl, with cl the closest point on the line (see
+			// closest), for the samples shifted to the origin. The closest point is an affine function of x,
+			// cl = P x + q, hence the residual is (I-P)(x - mean) - q
+			matrix_t P(d,d); vector_t q(d);
+			{
+				value_t la = mixture_model[k].beta[1], lb = -1, lc = mixture_model[k].beta[0];
+				value_t z = la*la + lb*lb;
+				P << lb*lb, -la*lb, -la*lb, la*la;
+				q << -la*lc, -lb*lc;
+				P /= z; q /= z;
+			}
+			matrix_t A = identity - P;
+			sum_sigma = scatter(A, -A * mean - q, sum_w, stat.sum_x, stat.sum_xx);
 #else
-				matrix_t m = (data_set[i] - mixture_model[k].mean) * (data_set[i] - mixture_model[k].mean).transpose();
+			// calculate new covariance matrix, for diagonal and spherical ones only the diagonal of the scatter matrix:
+			// \sum_i w_i (x_i - mean)^2 = Q - 2 mean S + W mean^2 (element-wise)
+			if (!full_scatter()) {
+				vector_t sum_sigma_diagonal = stat.sum_xx_diagonal - 2 * mean.cwiseProduct(stat.sum_x) +
+					sum_w * mean.cwiseAbs2();
+#ifdef TWEAK1
+				sum_sigma_diagonal.array() += 0.1;
 #endif
-				sum_sigma += (m * p);
-			}
-
-			if (sum_w != 0) {
-				mixture_model[k].covariance = sum_sigma / sum_w;
-			} else {
-				mixture_model[k].covariance = sum_sigma;
-			}
-
-#define DIAGONAL_COVARIANCE_MATRIX
-#ifdef DIAGONAL_COVARIANCE_MATRIX
-			//		std::cout << "Diagonalize covariance matrix (of size " << mixture_model[k].covariance.rows() << "x" 
-			//			<< mixture_model[k].covariance.cols() << ")" << std::endl;
-			for (int m = 0; m < mixture_model[k].covariance.rows(); ++m) {
-				for (int n = 0; n < mixture_model[k].covariance.cols(); ++n) {
-					if (m != n) {
-						mixture_model[k].covariance(m,n) = 0;
-					}
-				}
+				mixture_model[k].covariance.estimateDiagonal(sum_sigma_diagonal, sum_w);
+				prepare(k);
+				return;
 			}
+			sum_sigma = scatter(identity, -mean, sum_w, stat.sum_x, stat.sum_xx);
 #endif
-
-
-#ifdef LINE_DETECTION
-			// shift back
-			for (int i = 0; i < data_set.size(); ++i) {
-				data_set[i] += mixture_model[k].mean;
-			}
+#ifdef TWEAK1
+			sum_sigma += 0.1 * identity;
 #endif
 
+			// reduced to a diagonal or spherical matrix if that is the covariance type
+			mixture_model[k].covariance.estimate(sum_sigma, sum_w);
+
+			prepare(k);
 		}
 
 
@@ -878,23 +1179,71 @@ class ExpectationMaximization {
 		}
 
 	private:
+		//! Number of samples per tile in accumulate_statistics
+		static const size_t block_size = 256;
+
+		//! Bounds on the size and number of the chunks the samples are split in for (parallel) processing
+		static const size_t min_chunk_size = 16 * block_size;
+		static const size_t max_chunks = 256;
+
 		// there are K clusters, in this case a "mixture of k models"
 		std::vector<Gaussian> mixture_model;
 
-		// the data set
-		std::vector<vector_t> data_set;
+		//! The data set, stored contiguously, row-major, one sample per "dimension" values
+		std::vector<value_t> samples;
+		size_t sample_count;
+		size_t dimension;
+
+		//! The values of the samples, either in "samples" or given by setData (not owned)
+		const value_t *sample_data;
+
+		//! Per sample its weight, NULL if all samples count once (not owned, see setData), and the sum of the weights
+		const value_t *sample_weights;
+		value_t total_weight;
 
 		// storing the labels to check later what matches
 		std::vector<Pair> labels;
 
-		//! Per data item store the probability that it belongs to a given cluster k
-		std::vector<std::vector<value_t> > probabilities;
+		//! Components versus labels, and per sample the component as counted in the table
+		ContingencyTable table;
+		std::vector<size_t> tracked;
+
+		//! Keep the table up to date every tick
+		bool tracking;
+
+		//! Per data item store the probability that it belongs to a given cluster k (N x K, one row per data item)
+		sample_matrix_t probabilities;
 
 #ifdef ASSIGNMENT
-		//! Per data item set "1" to cluster that it is most probably member off, "0" to other clusters
-		std::vector<std::vector<value_t> > assignments;
+		//! Per data item set "1" to cluster that it is most probably member off, "0" to other clusters (N x K)
+		sample_matrix_t assignments;
 #endif
+
+		//! Per cluster the weighted sufficient statistics of the last E-step
+		std::vector<Statistics> statistics;
 		bool initialized;
+
+		//! Per chunk the statistics and log-likelihood, and the size of a chunk
+		std::vector<Partial> partials;
+		size_t chunk_size;
+
+		//! Pool for parallel processing, not owned
+		ThreadPool *pool;
+
+		//! Log-likelihood of the last E-step
+		value_t likelihood;
+
+		//! Set to 1 at construction and incremented at the first tick (see TEST_START_FROM_GROUND_TRUTH)
+		int once;
+
+		//! Degrees of freedom of the Student's t-distributions
+		value_t degrees_of_freedom;
+
+		//! Random generator for the initial components, per instance (see setSeed)
+		std::mt19937 generator;
+
+		//! Structure of the covariance matrices of all components
+		CovarianceType covariance_type;
 };
 
 
@@ -0,0 +1,185 @@
+/**
+ * 456789------------------------------------------------------------------------------------------------------------120
+ *
+ * @brief Mini-batch k-means for streams of data
+ * @file MiniBatchKMeans.h
+ *
+ * This file is created at Almende B.V. and Distributed Organisms B.V. It is open-source software and belongs to a
+ * larger suite of software that is meant for research on self-organization principles and multi-agent systems where
+ * learning algorithms are an important aspect.
+ *
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless, we personally strongly object
+ * against this software being used for military purposes, factory farming, animal experimentation, and "Universal
+ * Declaration of Human Rights" violations.
+ *
+ * Copyright (c) 2013 Anne C. van Rossum <anne@almende.org>
+ *
+ * @author    Anne C. van Rossum
+ * @date      Oct 15, 2026
+ * @project   Replicator
+ * @company   Almende B.V.
+ * @company   Distributed Organisms B.V.
+ * @case      Clustering
+ */
+
+#ifndef MINIBATCHKMEANS_H_
+#define MINIBATCHKMEANS_H_
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+#include <vector>
+#include <iostream>
+#include <cstddef>
+#include <assert.hpp>
+#include <ModelSnapshot.hpp>
+
+/**
+ * Online k-means on mini-batches, see "Web-scale k-means clustering" by Sculley (2010). Samples are collected in a
+ * batch of fixed size. When the batch is full, each sample in it is assigned to its nearest mean, after which each
+ * sample moves its mean towards it with a per-mean learning rate of 1/(number of samples the mean has seen so far).
+ * Only the batch and the means are kept in memory, never the stream itself.
+ *
+ * The means are initialized with the first K samples of the stream.
+ */
+class MiniBatchKMeans {
+public:
+	typedef float value_t;
+	typedef Eigen::Matrix<value_t,1,Eigen::Dynamic> vector_t; // row_vector
+	typedef Eigen::Matrix<value_t,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> sample_matrix_t; // one sample per row
+	typedef Eigen::Map<const vector_t> vector_map_t;
+
+	/**
+	 * Create K means of dimension D. The batch size should be at least K.
+	 */
+	MiniBatchKMeans(int K, int D, size_t batch_size = 256) {
+		ASSERT_GT (K, 0);
+		ASSERT_GEQ (batch_size, (size_t)K);
+		dimension = D;
+		means.setZero(K, D);
+		mean_norms.setZero(K);
+		counts.assign(K, 0);
+		initialized_means = 0;
+		batch.resize(batch_size, D);
+		batch_fill = 0;
+		batch_assignments.resize(batch_size);
+		batches = 0;
+	}
+
+	~MiniBatchKMeans() {}
+
+	/**
+	 * Add a sample to the current batch. The size is given as separate parameter, so it is possible to take only the
+	 * first N items from the sample. Returns true if the batch was full and the means have been updated.
+	 */
+	bool addSample(const std::vector<value_t> & x, size_t size = 0) {
+		if (!size) size = x.size();
+		ASSERT_LEQ (size, x.size());
+		ASSERT_EQ (size, dimension);
+		if (initialized_means < (size_t)means.rows()) {
+			means.row(initialized_means) = vector_map_t(x.data(), size);
+			mean_norms[initialized_means] = means.row(initialized_means).squaredNorm();
+			counts[initialized_means] = 1;
+			initialized_means++;
+			return false;
+		}
+		batch.row(batch_fill++) = vector_map_t(x.data(), size);
+		if (batch_fill < (size_t)batch.rows()) return false;
+		step();
+		return true;
+	}
+
+	/**
+	 * The index of the mean nearest to x, O(KD). Before K samples have been seen only the initialized means are
+	 * taken into account.
+	 */
+	size_t classify(const std::vector<value_t> & x) const {
+		ASSERT_EQ (x.size(), dimension);
+		return nearest(vector_map_t(x.data(), dimension));
+	}
+
+	//! Returns true if all K means have been initialized with a sample
+	inline bool initialized() const { return initialized_means == (size_t)means.rows(); }
+
+	//! Number of batches processed so far
+	inline size_t batchCount() const { return batches; }
+
+	//! Store the means in "snapshot", call only if initialized() (see ModelSnapshot)
+	void snapshot(ModelSnapshot & snapshot) const {
+		ASSERT (initialized());
+		snapshot.createMeans(means.rows(), dimension);
+		for (int k = 0; k < means.rows(); ++k) {
+			snapshot.setMean(k, means.row(k));
+		}
+	}
+
+	void print() {
+		std::cout << "Cluster means after " << batches << " batches: " << std::endl;
+		for (int k = 0; k < means.rows(); ++k) {
+			std::cout << "Cluster: " << k << " (" << counts[k] << " samples): " << means.row(k) << std::endl;
+		}
+	}
+
+protected:
+	/**
+	 * Nearest mean through |x-c|^2 = |x|^2 - 2 x.c + |c|^2, in which |x|^2 can be left out.
+	 */
+	template<typename Derived>
+	size_t nearest(const Eigen::MatrixBase<Derived> & x) const {
+		ASSERT_GT (initialized_means, 0);
+		const size_t K = initialized_means;
+		vector_t distances = mean_norms.head(K).transpose() - 2 * x * means.topRows(K).transpose();
+		sample_matrix_t::Index nearest_k;
+		distances.minCoeff(&nearest_k);
+		return nearest_k;
+	}
+
+	/**
+	 * Process a full batch. All samples are assigned first, with the means fixed (one matrix product for the entire
+	 * batch), then each sample moves its mean with a learning rate that decreases with the number of samples that
+	 * mean has seen.
+	 */
+	void step() {
+		sample_matrix_t products(batch_fill, means.rows());
+		products.noalias() = batch.topRows(batch_fill) * means.transpose();
+		for (size_t i = 0; i < batch_fill; ++i) {
+			sample_matrix_t::Index nearest_k;
+			(mean_norms.transpose() - 2 * products.row(i)).minCoeff(&nearest_k);
+			batch_assignments[i] = nearest_k;
+		}
+		for (size_t i = 0; i < batch_fill; ++i) {
+			size_t k = batch_assignments[i];
+			counts[k]++;
+			value_t eta = value_t(1) / counts[k];
+			means.row(k) = (1 - eta) * means.row(k) + eta * batch.row(i);
+		}
+		mean_norms = means.rowwise().squaredNorm();
+		batch_fill = 0;
+		batches++;
+	}
+
+private:
+	//! Dimension of the samples
+	size_t dimension;
+
+	//! The cluster means, one per row (K x D), and their squared norms
+	sample_matrix_t means;
+	Eigen::Matrix<value_t,Eigen::Dynamic,1> mean_norms;
+
+	//! Per mean the number of samples that have been assigned to it, defines its learning rate
+	std::vector<size_t> counts;
+
+	//! Number of means initialized with a sample from the stream
+	size_t initialized_means;
+
+	//! The current batch, the number of samples in it, and their assignments
+	sample_matrix_t batch;
+	size_t batch_fill;
+	std::vector<size_t> batch_assignments;
+
+	//! Number of batches processed
+	size_t batches;
+};
+
+#endif /* MINIBATCHKMEANS_H_ */
@@ -0,0 +1,529 @@
+/**
+ * 456789------------------------------------------------------------------------------------------------------------120
+ *
+ * @brief Selection of the number of clusters by information criteria
+ * @file ModelSelection.h
+ *
+ * This file is created at Almende B.V. and Distributed Organisms B.V. It is open-source software and belongs to a
+ * larger suite of software that is meant for research on self-organization principles and multi-agent systems where
+ * learning algorithms are an important aspect.
+ *
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless, we personally strongly object
+ * against this software being used for military purposes, factory farming, animal experimentation, and "Universal
+ * Declaration of Human Rights" violations.
+ *
+ * Copyright (c) 2013 Anne C. van Rossum <anne@almende.org>
+ *
+ * @author    Anne C. van Rossum
+ * @date      Oct 15, 2026
+ * @project   Replicator
+ * @company   Almende B.V.
+ * @company   Distributed Organisms B.V.
+ * @case      Clustering
+ */
+
+#ifndef MODELSELECTION_H_
+#define MODELSELECTION_H_
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <iostream>
+#include <algorithm>
+#include <assert.hpp>
+#include <ThreadPool.hpp>
+#include <kMeans.h>
+#include <ExpectationMaximization.h>
+
+/**
+ * Fit models with a different number of clusters K to the same data and score each fit with an information criterion,
+ * lower is better:
+ *
+ *   BIC = -2 log L + p log N        AIC = -2 log L + 2p
+ *
+ * with L the likelihood of the data under the fit and p its number of free parameters. For EM the likelihood is that
+ * of the mixture. For k-means the clusters are taken as identical spherical Gaussians with one variance estimated from
+ * the sum of squared distances, as in "X-means" by Pelleg and Moore (2000).
+ *
+ * A sweep fits all K in a range concurrently, one fit per thread of the pool, and keeps the best one. All fits use the
+ * same samples, no copies (see KMeans::setData). For large ranges X-means is faster: it starts with the smallest K and
+ * in each round splits every cluster in two if that improves the criterion locally, till no cluster is split anymore
+ * or the largest K is reached. The split tests of the clusters in a round run concurrently.
+ *
+ * Every fit has its own random generator, seeded by the seed of the selection plus the index of the fit, so the
+ * outcome is reproducible and does not depend on the threads. The best fit can be taken over with releaseKMeans() or
+ * releaseEM(), so it does not have to be fitted again.
+ *
+ * The samples can have weights, e.g. the number of samples they summarize (see CFTree). A sample of weight w counts as
+ * w samples in the fits and in the criterion.
+ */
+class ModelSelection {
+public:
+	typedef KMeans::value_t value_t;
+	typedef KMeans::sample_matrix_t sample_matrix_t;
+	typedef KMeans::sample_map_t sample_map_t;
+
+	enum Criterion { MS_BIC, MS_AIC, NUMBER_OF_CRITERIA };
+
+	//! The score of a fit with a given number of clusters
+	struct Score {
+		size_t clusters;
+		double log_likelihood;
+		size_t parameters;
+		double value;
+	};
+
+	/**
+	 * Select on "count" samples of dimension "dimension" stored contiguously at "samples", one sample per row, with
+	 * optionally a weight per sample. No copy is made, the samples should outlive this instance.
+	 */
+	ModelSelection(const value_t *samples, size_t count, size_t dimension, const value_t *weights = NULL) {
+		this->samples = samples;
+		this->weights = weights;
+		em_data = NULL;
+		em_weights = NULL;
+		initialize(count, dimension);
+	}
+
+	/**
+	 * Select with EM only (see sweepEM) on samples in the precision of EM, so they do not have to be converted. No
+	 * copy is made, the samples should outlive this instance, and the fits it releases.
+	 */
+	ModelSelection(const ExpectationMaximization::value_t *samples, size_t count, size_t dimension,
+			const ExpectationMaximization::value_t *weights = NULL) {
+		this->samples = NULL;
+		this->weights = NULL;
+		em_data = samples;
+		em_weights = weights;
+		initialize(count, dimension);
+	}
+
+	~ModelSelection() {
+		delete best_kmeans;
+		delete best_em;
+	}
+
+	//! Run the fits (or the split tests) concurrently on the pool, not owned
+	void setThreadPool(ThreadPool *pool) {
+		this->pool = pool;
+	}
+
+	void setCriterion(Criterion criterion) {
+		this->criterion = criterion;
+	}
+
+	//! Maximum number of iterations per fit
+	void setMaxIterations(size_t iterations) {
+		max_iterations = iterations;
+	}
+
+	//! Fit f of a selection uses the seed "seed + f" for its initial means or components
+	void setSeed(unsigned int seed) {
+		this->seed = seed;
+	}
+
+
+	/**
+	 * Select the number of k-means clusters in [k_min, k_max]: a sweep over the range if it has at most 16 values,
+	 * otherwise X-means. Returns the number of clusters of the best fit, see kmeans().
+	 */
+	size_t selectKMeans(size_t k_min, size_t k_max) {
+		if (k_max - k_min + 1 <= max_sweep) return sweepKMeans(k_min, k_max);
+		return xmeans(k_min, k_max);
+	}
+
+	/**
+	 * Fit k-means for every K in [k_min, k_max] concurrently and keep the best fit. Returns its number of clusters.
+	 */
+	size_t sweepKMeans(size_t k_min, size_t k_max) {
+		ASSERT_GT (k_min, 0);
+		ASSERT_LEQ (k_min, k_max);
+		const size_t fits = k_max - k_min + 1;
+		std::vector<KMeans*> models(fits);
+		for (size_t f = 0; f < fits; ++f) {
+			models[f] = create_kmeans(k_min + f, f);
+		}
+		scores.assign(fits, Score());
+		run(fits, [this, &models] (size_t f) {
+			models[f]->init();
+			fit(*models[f]);
+			scores[f] = score(*models[f]);
+		});
+		size_t best = select();
+		for (size_t f = 0; f < fits; ++f) {
+			if (f != best) delete models[f];
+		}
+		delete best_kmeans;
+		best_kmeans = models[best];
+		return scores[best].clusters;
+	}
+
+	/**
+	 * X-means in [k_min, k_max]. Each round every cluster is split in two by 2-means on its own samples, and the split
+	 * is kept if the criterion of the two children is lower than that of the parent. If more splits are found than
+	 * fit in k_max, those with the largest improvement are kept. The children are the initial means of the fit of the
+	 * next round. Of the fits of all rounds, the one with the lowest score on all samples is kept. Returns its number
+	 * of clusters, see kmeans().
+	 */
+	size_t xmeans(size_t k_min, size_t k_max) {
+		ASSERT_GT (k_min, 0);
+		ASSERT_LEQ (k_min, k_max);
+		scores.clear();
+		KMeans *model = create_kmeans(k_min, 0);
+		model->setThreadPool(pool);
+		model->init();
+		fit(*model);
+		scores.push_back(score(*model));
+		delete best_kmeans;
+		best_kmeans = model;
+		size_t best = 0;
+		while (model->clusterMeans().rows() < (int)k_max) {
+			const size_t K = model->clusterMeans().rows();
+			std::vector<std::vector<size_t> > members(K);
+			const std::vector<size_t> & assignments = model->clusterAssignments();
+			for (size_t i = 0; i < sample_count; ++i) {
+				members[assignments[i]].push_back(i);
+			}
+			std::vector<Split> splits(K);
+			run(K, [this, &members, &splits, model] (size_t k) {
+				splits[k] = split(members[k], model->clusterMeans().row(k));
+			});
+			std::vector<size_t> order;
+			for (size_t k = 0; k < K; ++k) {
+				if (splits[k].improvement > 0) order.push_back(k);
+			}
+			if (order.empty()) break;
+			std::sort(order.begin(), order.end(), [&splits] (size_t a, size_t b) {
+				return splits[a].improvement > splits[b].improvement;
+			});
+			order.resize(std::min(order.size(), k_max - K));
+			sample_matrix_t means(K + order.size(), dimension);
+			means.topRows(K) = model->clusterMeans();
+			for (size_t s = 0; s < order.size(); ++s) {
+				means.row(order[s]) = splits[order[s]].children.row(0);
+				means.row(K + s) = splits[order[s]].children.row(1);
+			}
+			if (model != best_kmeans) delete model;
+			model = create_kmeans(means.rows(), scores.size());
+			model->setThreadPool(pool);
+			model->init(means);
+			fit(*model);
+			scores.push_back(score(*model));
+			if (scores.back().value < scores[best].value) {
+				delete best_kmeans;
+				best_kmeans = model;
+				best = scores.size() - 1;
+			}
+		}
+		if (model != best_kmeans) delete model;
+		return scores[best].clusters;
+	}
+
+	/**
+	 * Fit a mixture with EM for every K in [k_min, k_max] concurrently and keep the best fit. All fits share the
+	 * samples, if they are not in the precision of EM they are converted once (see the constructors). EM runs a fixed
+	 * number of ticks, "ticks", per fit. Returns the number of components of the best fit, see em().
+	 *
+	 * The test settings of EM for the line model (LINE_DETECTION, TEST_START_FROM_GROUND_TRUTH) fix the number of
+	 * components and do not fit a Gaussian mixture, the sweep refuses to run with those and returns 0.
+	 */
+	size_t sweepEM(size_t k_min, size_t k_max, size_t ticks, CovarianceType covariance_type = COV_DIAGONAL) {
+		ASSERT_GT (k_min, 0);
+		ASSERT_LEQ (k_min, k_max);
+#if defined(LINE_DETECTION) || defined(TEST_START_FROM_GROUND_TRUTH)
+		std::cerr << "EM is compiled for the line model, the number of components can not be selected" << std::endl;
+		return 0;
+#endif
+		if (!em_data) {
+			em_samples.assign(samples, samples + sample_count * dimension);
+			if (weights) em_sample_weights.assign(weights, weights + sample_count);
+		}
+		const ExpectationMaximization::value_t *x = em_data ? em_data : em_samples.data();
+		const ExpectationMaximization::value_t *w = em_data ? em_weights :
+				(weights ? em_sample_weights.data() : NULL);
+		const size_t fits = k_max - k_min + 1;
+		std::vector<ExpectationMaximization*> models(fits);
+		for (size_t f = 0; f < fits; ++f) {
+			models[f] = new ExpectationMaximization(k_min + f, dimension, covariance_type);
+			models[f]->setData(x, sample_count, w);
+			models[f]->setSeed(seed + f);
+		}
+		scores.assign(fits, Score());
+		run(fits, [this, &models, ticks, k_min] (size_t f) {
+			ExpectationMaximization & em = *models[f];
+			em.init();
+			for (size_t t = 0; t < ticks; ++t) {
+				em.tick();
+			}
+			scores[f] = score(k_min + f, em.log_likelihood(), em.parameters());
+		});
+		size_t best = select();
+		for (size_t f = 0; f < fits; ++f) {
+			if (f != best) delete models[f];
+		}
+		delete best_em;
+		best_em = models[best];
+		return scores[best].clusters;
+	}
+
+	//! The best k-means fit of the last selection (owned by this instance), or NULL
+	inline KMeans *kmeans() const { return best_kmeans; }
+
+	//! The best EM fit of the last selection (owned by this instance), or NULL
+	inline ExpectationMaximization *em() const { return best_em; }
+
+	/**
+	 * Take over the best k-means fit of the last selection, or NULL. It uses the samples given to the constructor, and
+	 * should be deleted by the caller.
+	 */
+	KMeans *releaseKMeans() {
+		KMeans *model = best_kmeans;
+		best_kmeans = NULL;
+		return model;
+	}
+
+	/**
+	 * Take over the best EM fit of the last selection, or NULL. It should be deleted by the caller. It uses the samples
+	 * given to the constructor, so it can only be taken over if they are in the precision of EM, otherwise it uses the
+	 * converted copy of this instance and NULL is returned.
+	 */
+	ExpectationMaximization *releaseEM() {
+		if (!em_data) return NULL;
+		ExpectationMaximization *model = best_em;
+		best_em = NULL;
+		return model;
+	}
+
+	//! The scores of the fits of the last selection, for X-means one per round
+	inline const std::vector<Score> & results() const { return scores; }
+
+	void print() const {
+		std::cout << "Model selection by " << (criterion == MS_BIC ? "BIC" : "AIC") << ":" << std::endl;
+		for (size_t f = 0; f < scores.size(); ++f) {
+			std::cout << "K=" << scores[f].clusters << " log-likelihood " << scores[f].log_likelihood << " with " <<
+					scores[f].parameters << " parameters, score " << scores[f].value << std::endl;
+		}
+	}
+
+protected:
+	//! The result of a split test of one cluster
+	struct Split {
+		sample_matrix_t children;
+		double improvement;
+	};
+
+	//! Run the job for all indices, on the pool if there is one
+	void run(size_t jobs, const std::function<void(size_t)> & job) {
+		if (pool) {
+			pool->run(jobs, job);
+		} else {
+			for (size_t j = 0; j < jobs; ++j) job(j);
+		}
+	}
+
+	//! Set the parameters that both constructors have in common
+	void initialize(size_t count, size_t dimension) {
+		sample_count = count;
+		total_weight = 0;
+		for (size_t i = 0; i < count; ++i) {
+			total_weight += weight(i);
+		}
+		this->dimension = dimension;
+		criterion = MS_BIC;
+		max_iterations = 100;
+		max_sweep = 16;
+		seed = 5489u;
+		pool = NULL;
+		best_kmeans = NULL;
+		best_em = NULL;
+	}
+
+	//! A k-means instance on the shared samples for fit "f", it runs on the calling thread
+	KMeans *create_kmeans(size_t K, size_t f) {
+		ASSERT (samples != NULL);
+		KMeans *model = new KMeans(K, dimension);
+		model->setData(samples, sample_count, weights);
+		model->setAssignMethod(KMeans::A_HAMERLY);
+		model->setSeed(seed + f);
+		return model;
+	}
+
+	//! Tick till convergence or the maximum number of iterations
+	void fit(KMeans & model) {
+		for (size_t t = 0; t < max_iterations; ++t) {
+			model.tick();
+			if (model.converged()) break;
+		}
+	}
+
+	//! Weight of sample "i"
+	inline double weight(size_t i) const {
+		return weights ? weights[i] : (em_weights ? em_weights[i] : 1);
+	}
+
+	//! The criterion for "count" samples (their total weight), lower is better
+	double criterion_value(double log_likelihood, size_t parameters, double count) const {
+		double penalty = (criterion == MS_BIC) ? std::log(double(count)) : 2;
+		return -2 * log_likelihood + penalty * parameters;
+	}
+
+	Score score(size_t clusters, double log_likelihood, size_t parameters) const {
+		Score s;
+		s.clusters = clusters;
+		s.log_likelihood = log_likelihood;
+		s.parameters = parameters;
+		s.value = criterion_value(log_likelihood, parameters, total_weight);
+		return s;
+	}
+
+	/**
+	 * The log-likelihood of R samples in M dimensions under K identical spherical Gaussians with weights R_k / R,
+	 * and one variance estimated from the sum of squared distances to the means (SSE) with K degrees of freedom less:
+	 *
+	 *   \sigma^2 = SSE / (M (R - K))
+	 *   log L = \sum_k R_k log(R_k / R) - R M / 2 log(2 \pi \sigma^2) - M (R - K) / 2
+	 *
+	 * The number of parameters is KM means, K-1 weights, and one variance. With sample weights R_k is the total weight
+	 * of the samples in cluster k.
+	 */
+	double spherical_log_likelihood(const std::vector<double> & sizes, double sse, size_t & parameters) const {
+		const size_t K = sizes.size(), M = dimension;
+		double R = 0;
+		for (size_t k = 0; k < K; ++k) R += sizes[k];
+		parameters = K * M + K;
+		if (R <= K) return 0;
+		double variance = std::max(sse / (double(M) * (R - K)), std::numeric_limits<double>::min());
+		double log_likelihood = -0.5 * R * M * std::log(2 * M_PI * variance) - 0.5 * M * (R - K);
+		for (size_t k = 0; k < K; ++k) {
+			if (sizes[k] > 0) log_likelihood += sizes[k] * std::log(sizes[k] / R);
+		}
+		return log_likelihood;
+	}
+
+	//! The score of a k-means fit on all samples
+	Score score(const KMeans & model) const {
+		const sample_matrix_t & means = model.clusterMeans();
+		const std::vector<size_t> & assignments = model.clusterAssignments();
+		sample_map_t x = model.data();
+		std::vector<double> sizes(means.rows(), 0);
+		double sse = 0;
+		for (size_t i = 0; i < sample_count; ++i) {
+			sizes[assignments[i]] += weight(i);
+			sse += weight(i) * (x.row(i) - means.row(assignments[i])).squaredNorm();
+		}
+		size_t parameters;
+		double log_likelihood = spherical_log_likelihood(sizes, sse, parameters);
+		return score(means.rows(), log_likelihood, parameters);
+	}
+
+	/**
+	 * Test whether the cluster with the given members and mean is better described by two clusters. The children
+	 * start at the mean plus and minus the standard deviation in each dimension, and are improved by 2-means on the
+	 * members only. With sample weights the members count by their weight.
+	 */
+	template<typename Derived>
+	Split split(const std::vector<size_t> & members, const Eigen::MatrixBase<Derived> & mean) const {
+		Split result;
+		result.improvement = 0;
+		const size_t R = members.size();
+		if (R < 4) return result;
+		sample_map_t x(samples, sample_count, dimension);
+
+		Eigen::Matrix<double,1,Eigen::Dynamic> parent = mean.template cast<double>();
+		Eigen::Matrix<double,1,Eigen::Dynamic> deviation = Eigen::Matrix<double,1,Eigen::Dynamic>::Zero(dimension);
+		double parent_sse = 0, parent_weight = 0;
+		for (size_t m = 0; m < R; ++m) {
+			Eigen::Matrix<double,1,Eigen::Dynamic> diff = x.row(members[m]).template cast<double>() - parent;
+			double w = weight(members[m]);
+			deviation += w * diff.cwiseAbs2();
+			parent_sse += w * diff.squaredNorm();
+			parent_weight += w;
+		}
+		deviation = (deviation / parent_weight).cwiseSqrt();
+
+		Eigen::Matrix<double,2,Eigen::Dynamic> children(2, dimension);
+		children.row(0) = parent + deviation;
+		children.row(1) = parent - deviation;
+		std::vector<unsigned char> side(R, 2);
+		std::vector<double> sizes(2);
+		double children_sse = 0;
+		for (size_t t = 0; t < max_iterations; ++t) {
+			bool changed = false;
+			Eigen::Matrix<double,2,Eigen::Dynamic> sums = Eigen::Matrix<double,2,Eigen::Dynamic>::Zero(2, dimension);
+			sizes.assign(2, 0);
+			children_sse = 0;
+			for (size_t m = 0; m < R; ++m) {
+				Eigen::Matrix<double,1,Eigen::Dynamic> y = x.row(members[m]).template cast<double>();
+				double d0 = (y - children.row(0)).squaredNorm(), d1 = (y - children.row(1)).squaredNorm();
+				unsigned char s = (d1 < d0) ? 1 : 0;
+				if (s != side[m]) changed = true;
+				side[m] = s;
+				double w = weight(members[m]);
+				sums.row(s) += w * y;
+				sizes[s] += w;
+				children_sse += w * std::min(d0, d1);
+			}
+			if (sizes[0] <= 0 || sizes[1] <= 0) return result;
+			if (!changed) break;
+			children.row(0) = sums.row(0) / sizes[0];
+			children.row(1) = sums.row(1) / sizes[1];
+		}
+
+		size_t parent_parameters, children_parameters;
+		double parent_log_likelihood = spherical_log_likelihood(std::vector<double>(1, parent_weight), parent_sse,
+				parent_parameters);
+		double children_log_likelihood = spherical_log_likelihood(sizes, children_sse, children_parameters);
+		result.improvement = criterion_value(parent_log_likelihood, parent_parameters, parent_weight) -
+				criterion_value(children_log_likelihood, children_parameters, parent_weight);
+		result.children = children.cast<value_t>();
+		return result;
+	}
+
+	//! Index of the lowest score, the smallest number of clusters on a tie
+	size_t select() const {
+		size_t best = 0;
+		for (size_t f = 1; f < scores.size(); ++f) {
+			if (scores[f].value < scores[best].value) best = f;
+		}
+		return best;
+	}
+
+private:
+	//! The shared samples, not owned, in the precision of k-means or of EM, and a copy in the precision of EM if needed
+	const value_t *samples;
+	const ExpectationMaximization::value_t *em_data;
+	std::vector<ExpectationMaximization::value_t> em_samples;
+	size_t sample_count;
+
+	//! The weights of the samples as the samples, NULL if they all count once, and their sum
+	const value_t *weights;
+	const ExpectationMaximization::value_t *em_weights;
+	std::vector<ExpectationMaximization::value_t> em_sample_weights;
+	double total_weight;
+	size_t dimension;
+
+	Criterion criterion;
+
+	//! Maximum number of iterations of a fit
+	size_t max_iterations;
+
+	//! Largest range for which selectKMeans sweeps instead of running X-means
+	size_t max_sweep;
+
+	//! Seed of the first fit, see setSeed()
+	unsigned int seed;
+
+	//! Pool for the concurrent fits, not owned
+	ThreadPool *pool;
+
+	//! Scores of the last selection
+	std::vector<Score> scores;
+
+	//! Best fits of the last selection
+	KMeans *best_kmeans;
+	ExpectationMaximization *best_em;
+};
+
+#endif /* MODELSELECTION_H_ */
@@ -0,0 +1,360 @@
+/**
+ * 456789------------------------------------------------------------------------------------------------------------120
+ *
+ * @brief Snapshot of a trained cluster model in a versioned binary file that can be memory-mapped
+ * @file ModelSnapshot.hpp
+ *
+ * This file is created at Almende B.V. and Distributed Organisms B.V. It is open-source software and belongs to a
+ * larger suite of software that is meant for research on self-organization principles and multi-agent systems where
+ * learning algorithms are an important aspect.
+ *
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless, we personally strongly object
+ * against this software being used for military purposes, factory farming, animal experimentation, and "Universal
+ * Declaration of Human Rights" violations.
+ *
+ * Copyright (c) 2013 Anne C. van Rossum <anne@almende.org>
+ *
+ * @author    Anne C. van Rossum
+ * @date      Oct 15, 2026
+ * @project   Replicator
+ * @company   Almende B.V.
+ * @company   Distributed Organisms B.V.
+ * @case      Clustering
+ */
+
+#ifndef MODELSNAPSHOT_HPP_
+#define MODELSNAPSHOT_HPP_
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <assert.hpp>
+#include <Covariance.hpp>
+
+/**
+ * The parameters of a trained model that are needed to classify a sample, in a binary file:
+ *
+ *   header      magic "AIMMODEL", format version, size of a value, kind of model, covariance type, line flag, number
+ *               of clusters K, dimension D, and the degrees of freedom of the densities
+ *   K records   SNAPSHOT_MEANS:    the mean (D values)
+ *               SNAPSHOT_MIXTURE:  log weight, log normalization constant, mean (D), with lines the line parameters
+ *                                  beta (D), and the factorization of the covariance matrix (see Covariance::copyFactor)
+ *
+ * The factorization is stored rather than the covariance matrix, so classification does not have to factorize again.
+ * A snapshot is written to a temporary file that is renamed, so a half written snapshot is never read. It is loaded by
+ * memory-mapping the file and checking the header and the file size, the records are used in place. Loading and
+ * classifying the first sample is therefore independent of the amount of data the model has been trained on.
+ *
+ * A model fills a snapshot through its snapshot() method, see KMeans, MiniBatchKMeans, ExpectationMaximization, and
+ * OnlineExpectationMaximization. The classification is the same as that of the model: the nearest mean, or the
+ * component with the highest weighted density (Student's t with the given degrees of freedom, or Gaussian if zero).
+ */
+class ModelSnapshot {
+public:
+	typedef double value_t;
+	typedef Eigen::Matrix<value_t,Eigen::Dynamic,1> vector_t; // column_vector
+	typedef Eigen::Map<const vector_t> vector_map_t;
+	typedef Eigen::Map<const Eigen::Matrix<value_t,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> > factor_map_t;
+
+	enum SnapshotKind { SNAPSHOT_MEANS, SNAPSHOT_MIXTURE, NUMBER_OF_SNAPSHOT_KINDS };
+
+	ModelSnapshot() {
+		mapping = NULL;
+		mapping_size = 0;
+		clear();
+	}
+
+	~ModelSnapshot() {
+		unmap();
+	}
+
+	//! Forget the model
+	void clear() {
+		unmap();
+		buffer.clear();
+		values = NULL;
+		memset(&header, 0, sizeof(header));
+	}
+
+	//! Start a snapshot of K means of dimension D, set them with setMean()
+	void createMeans(size_t K, size_t D) {
+		create(SNAPSHOT_MEANS, K, D, COV_SPHERICAL, 0, false);
+	}
+
+	/**
+	 * Start a snapshot of a mixture of K components of dimension D, set them with setComponent() (and setLine()). The
+	 * densities are Student's t-distributions with the given degrees of freedom, or Gaussians if it is zero. With
+	 * "lines" the density is of the residual to the nearest point on the line of a component (2D only).
+	 */
+	void createMixture(size_t K, size_t D, CovarianceType type, value_t degrees_of_freedom, bool lines) {
+		create(SNAPSHOT_MIXTURE, K, D, type, degrees_of_freedom, lines);
+	}
+
+	//! Set mean "k" of a snapshot of means
+	template<typename Derived>
+	void setMean(size_t k, const Eigen::MatrixBase<Derived> & mean) {
+		ASSERT_EQ (header.kind, SNAPSHOT_MEANS);
+		ASSERT_EQ ((size_t)mean.size(), header.dimension);
+		value_t *r = &buffer[k * record_size()];
+		for (size_t j = 0; j < header.dimension; ++j) r[j] = mean(j);
+	}
+
+	/**
+	 * Set component "k" of a snapshot of a mixture. The covariance matrix should have been factorized (see
+	 * Covariance::factorize), and "log_normalization" is the logarithm of the normalization constant of the density.
+	 */
+	template<typename Derived>
+	void setComponent(size_t k, value_t weight, const Eigen::MatrixBase<Derived> & mean, const Covariance & covariance,
+			value_t log_normalization) {
+		ASSERT_EQ (header.kind, SNAPSHOT_MIXTURE);
+		ASSERT_EQ ((size_t)mean.size(), header.dimension);
+		ASSERT_EQ (covariance.structure(), (CovarianceType)header.covariance_type);
+		value_t *r = &buffer[k * record_size()];
+		r[0] = std::log(weight);
+		r[1] = log_normalization;
+		for (size_t j = 0; j < header.dimension; ++j) r[2 + j] = mean(j);
+		covariance.copyFactor(r + factor_offset());
+	}
+
+	//! Set the line parameters of component "k", see createMixture()
+	template<typename Derived>
+	void setLine(size_t k, const Eigen::MatrixBase<Derived> & beta) {
+		ASSERT (header.lines);
+		ASSERT_EQ ((size_t)beta.size(), header.dimension);
+		value_t *r = &buffer[k * record_size()];
+		for (size_t j = 0; j < header.dimension; ++j) r[2 + header.dimension + j] = beta(j);
+	}
+
+	/**
+	 * Write the snapshot to "file". Returns false (and reports it) if it cannot be written.
+	 */
+	bool write(const std::string & file) const {
+		if (!loaded()) return false;
+		std::string temporary = file + ".tmp";
+		FILE *f = fopen(temporary.c_str(), "wb");
+		bool success = (f != NULL);
+		if (success) {
+			size_t count = header.clusters * record_size();
+			success = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(values, sizeof(value_t), count, f) == count;
+			success = (fclose(f) == 0) && success;
+			success = success && (rename(temporary.c_str(), file.c_str()) == 0);
+			if (!success) remove(temporary.c_str());
+		}
+		if (!success) {
+			std::cerr << "Could not write model snapshot " << file << std::endl;
+		}
+		return success;
+	}
+
+	/**
+	 * Map the snapshot in "file". Returns false if it does not exist, or if it is not a valid snapshot of this version
+	 * (e.g. of dimension 0, or with lines in another dimension than 2), in which case the current model is cleared.
+	 */
+	bool load(const std::string & file) {
+		clear();
+		int fd = open(file.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat info;
+		Header h;
+		if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(h) || read(fd, &h, sizeof(h)) != sizeof(h)) {
+			close(fd);
+			return false;
+		}
+		header = h;
+		size_t expected = sizeof(h) + h.clusters * record_size() * sizeof(value_t);
+		if (memcmp(h.magic, "AIMMODEL", 8) || h.version != snapshot_version || h.value_size != sizeof(value_t) ||
+				h.kind >= NUMBER_OF_SNAPSHOT_KINDS || h.covariance_type >= NUMBER_OF_COVARIANCE_TYPES ||
+				!h.clusters || !h.dimension || h.lines > 1 ||
+				(h.lines && (h.kind != SNAPSHOT_MIXTURE || h.dimension != 2)) || (size_t)info.st_size != expected) {
+			close(fd);
+			std::cerr << "File " << file << " is not a model snapshot of version " << snapshot_version << std::endl;
+			clear();
+			return false;
+		}
+		void *addr = mmap(NULL, expected, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (addr == MAP_FAILED) {
+			clear();
+			return false;
+		}
+		mapping = addr;
+		mapping_size = expected;
+		values = (const value_t*)((const char*)addr + sizeof(h));
+		return true;
+	}
+
+	//! Returns true if there is a model, created or loaded
+	inline bool loaded() const { return values != NULL; }
+
+	inline size_t clusters() const { return header.clusters; }
+
+	inline size_t dimension() const { return header.dimension; }
+
+	inline SnapshotKind kind() const { return (SnapshotKind)header.kind; }
+
+	/**
+	 * The index of the nearest mean, or of the component with the highest weighted density, for the sample "x" of
+	 * dimension() values. O(KD) for means and for diagonal or spherical covariance matrices, O(KD^2) for full ones.
+	 */
+	template<typename T>
+	size_t classify(const T *x) const {
+		ASSERT (loaded());
+		vector_t y = Eigen::Map<const Eigen::Matrix<T,Eigen::Dynamic,1> >(x, header.dimension).template cast<value_t>();
+		size_t best = 0;
+		value_t max = -std::numeric_limits<value_t>::infinity();
+		for (size_t k = 0; k < header.clusters; ++k) {
+			value_t score = (header.kind == SNAPSHOT_MEANS) ? -(y - mean(k)).squaredNorm() : log_density(y, k);
+			if (score > max) {
+				max = score;
+				best = k;
+			}
+		}
+		return best;
+	}
+
+	void print() const {
+		if (!loaded()) {
+			std::cout << "No model snapshot" << std::endl;
+			return;
+		}
+		std::cout << "Model snapshot with " << header.clusters << (header.kind == SNAPSHOT_MEANS ? " means" :
+				" mixture components") << " of dimension " << header.dimension << (mapping ? " (mapped)" : "") << std::endl;
+		for (size_t k = 0; k < header.clusters; ++k) {
+			std::cout << "Cluster " << k << ": " << mean(k).transpose() << std::endl;
+		}
+	}
+
+protected:
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t value_size;
+		uint32_t kind;
+		uint32_t covariance_type;
+		uint32_t lines;
+		uint32_t reserved;
+		uint64_t clusters;
+		uint64_t dimension;
+		value_t degrees_of_freedom;
+	};
+
+	static const uint32_t snapshot_version = 1;
+
+	void create(SnapshotKind kind, size_t K, size_t D, CovarianceType type, value_t degrees_of_freedom, bool lines) {
+		ASSERT (!lines || D == 2);
+		clear();
+		memcpy(header.magic, "AIMMODEL", 8);
+		header.version = snapshot_version;
+		header.value_size = sizeof(value_t);
+		header.kind = kind;
+		header.covariance_type = type;
+		header.lines = lines;
+		header.clusters = K;
+		header.dimension = D;
+		header.degrees_of_freedom = degrees_of_freedom;
+		buffer.assign(K * record_size(), 0);
+		values = buffer.empty() ? NULL : &buffer[0];
+	}
+
+	void unmap() {
+		if (mapping) munmap(mapping, mapping_size);
+		mapping = NULL;
+		mapping_size = 0;
+	}
+
+	//! Offset of the factorization of the covariance matrix in a record of a mixture
+	inline size_t factor_offset() const {
+		return 2 + (header.lines ? 2 : 1) * header.dimension;
+	}
+
+	//! Number of values per cluster
+	size_t record_size() const {
+		const size_t D = header.dimension;
+		if (header.kind == SNAPSHOT_MEANS) return D;
+		switch (header.covariance_type) {
+		case COV_FULL:
+			return factor_offset() + D * D;
+		case COV_DIAGONAL:
+			return factor_offset() + D;
+		case COV_SPHERICAL: default:
+			return factor_offset() + 1;
+		}
+	}
+
+	inline vector_map_t mean(size_t k) const {
+		return vector_map_t(values + k * record_size() + (header.kind == SNAPSHOT_MEANS ? 0 : 2), header.dimension);
+	}
+
+	/**
+	 * Log of w_k p_k(y), as in ExpectationMaximization::generated_by (t-distribution, with its cap on degenerate
+	 * densities) or OnlineExpectationMaximization (Gaussian).
+	 */
+	value_t log_density(const vector_t & y, size_t k) const {
+		const size_t D = header.dimension;
+		const value_t *r = values + k * record_size();
+		const value_t *factor = r + factor_offset();
+		vector_t diff = y - mean(k);
+		if (header.lines) {
+			// residual to the closest point on the line y = beta[0] + x beta[1], see ExpectationMaximization::closest
+			value_t a = r[2 + D + 1], b = -1, c = r[2 + D], z = a*a + b*b;
+			diff[0] = y[0] - (b*(b*y[0]-a*y[1]) - a*c) / z;
+			diff[1] = y[1] - (a*(-b*y[0]+a*y[1]) - b*c) / z;
+		}
+		value_t mahalanobis;
+		switch (header.covariance_type) {
+		case COV_FULL:
+			mahalanobis = factor_map_t(factor, D, D).triangularView<Eigen::Lower>().solve(diff).squaredNorm();
+			break;
+		case COV_DIAGONAL:
+			mahalanobis = diff.cwiseAbs2().dot(vector_map_t(factor, D));
+			break;
+		case COV_SPHERICAL: default:
+			mahalanobis = diff.squaredNorm() * factor[0];
+			break;
+		}
+		const value_t dof = header.degrees_of_freedom;
+		if (dof <= 0) {
+			return r[0] + r[1] - value_t(0.5) * mahalanobis;
+		}
+		value_t result = r[1] - (dof + 1) / 2 * std::log1p(mahalanobis / dof);
+		const value_t log_large_number = std::log(1000.0);
+		if ((result != result) || (result > log_large_number)) {
+			result = log_large_number;
+		}
+		return r[0] + result;
+	}
+
+private:
+	// the records can be memory-mapped, hence no copies
+	ModelSnapshot(const ModelSnapshot &);
+	ModelSnapshot & operator=(const ModelSnapshot &);
+
+	Header header;
+
+	//! The records when created (not mapped)
+	std::vector<value_t> buffer;
+
+	//! The records, either in the buffer or in the mapping
+	const value_t *values;
+
+	//! The memory-mapped snapshot, if any
+	void *mapping;
+	size_t mapping_size;
+};
+
+#endif /* MODELSNAPSHOT_HPP_ */
@@ -0,0 +1,314 @@
+/**
+ * 456789------------------------------------------------------------------------------------------------------------120
+ *
+ * @brief Online (stepwise) Expectation-Maximization of a Gaussian mixture model for streams of data
+ * @file OnlineExpectationMaximization.h
+ *
+ * This file is created at Almende B.V. and Distributed Organisms B.V. It is open-source software and belongs to a
+ * larger suite of software that is meant for research on self-organization principles and multi-agent systems where
+ * learning algorithms are an important aspect.
+ *
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless, we personally strongly object
+ * against this software being used for military purposes, factory farming, animal experimentation, and "Universal
+ * Declaration of Human Rights" violations.
+ *
+ * Copyright (c) 2013 Anne C. van Rossum <anne@almende.org>
+ *
+ * @author    Anne C. van Rossum
+ * @date      Oct 15, 2026
+ * @project   Replicator
+ * @company   Almende B.V.
+ * @company   Distributed Organisms B.V.
+ * @case      Clustering
+ */
+
+#ifndef ONLINEEXPECTATIONMAXIMIZATION_H_
+#define ONLINEEXPECTATIONMAXIMIZATION_H_
+
+#include <Eigen/Core>
+#include <Eigen/Dense>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <iostream>
+#include <cstddef>
+#include <assert.hpp>
+#include <Covariance.hpp>
+#include <ModelSnapshot.hpp>
+
+/**
+ * Stepwise EM, see "On-line expectation-maximization algorithm for latent data models" by Cappé and Moulines (2009)
+ * and "Online EM for unsupervised models" by Liang and Klein (2009). Samples are collected in a batch of fixed size.
+ * When the batch is full, the E-step calculates the responsibilities of the components for the samples in the batch,
+ * and their average sufficient statistics \hat{s}. The running statistics are a decayed average of these:
+ *
+ *   s <- (1 - \eta_t) s + \eta_t \hat{s},    with \eta_t = (t + 2)^-\alpha and 0.5 < \alpha <= 1
+ *
+ * The M-step derives the weights, means, and covariance matrices from s, exactly like batch EM does from the sums
+ * over the entire data set. With \alpha = 1 every batch counts equally, with a smaller \alpha older batches are
+ * forgotten faster, so the mixture follows a drifting stream.
+ *
+ * A batch costs O(BKd^2) for full covariance matrices and O(BKd) for diagonal or spherical ones. Only the batch, and
+ * per component its statistics and parameters are kept in memory, never the stream itself.
+ *
+ * The first batch initializes the model: the means are the first K samples, the covariance matrices are the
+ * variances of the batch, and the weights are uniform.
+ */
+class OnlineExpectationMaximization {
+public:
+	typedef double value_t;
+	typedef Eigen::Matrix<value_t,Eigen::Dynamic,Eigen::Dynamic> matrix_t;
+	typedef Eigen::Matrix<value_t,Eigen::Dynamic,1> vector_t; // column_vector
+	typedef Eigen::Matrix<value_t,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> sample_matrix_t; // one row per item
+	typedef Eigen::Map<const Eigen::Matrix<float,Eigen::Dynamic,1> > input_map_t;
+
+	/**
+	 * Create a mixture of K components of dimension D. The batch size should be at least K.
+	 */
+	OnlineExpectationMaximization(int K, int D, size_t batch_size = 256, CovarianceType covariance_type = COV_DIAGONAL) {
+		ASSERT_GT (K, 0);
+		ASSERT_GEQ (batch_size, (size_t)K);
+		dimension = D;
+		this->covariance_type = covariance_type;
+		components.resize(K);
+		batch.resize(batch_size, D);
+		batch_fill = 0;
+		responsibilities.resize(batch_size, K);
+		batches = 0;
+		alpha = 0.7;
+		regularization = 1e-6;
+		batch_log_likelihood = -std::numeric_limits<value_t>::infinity();
+	}
+
+	~OnlineExpectationMaximization() {}
+
+	/**
+	 * Set the exponent of the step size \eta_t = (t + 2)^-\alpha, in (0.5, 1]. The default is 0.7.
+	 */
+	void setStepSize(value_t alpha) {
+		ASSERT (alpha > 0.5 && alpha <= 1);
+		this->alpha = alpha;
+	}
+
+	/**
+	 * Add a sample to the current batch. The size is given as separate parameter, so it is possible to take only the
+	 * first N items from the sample. Returns true if the batch was full and the model has been updated.
+	 */
+	bool addSample(const std::vector<float> & x, size_t size = 0) {
+		if (!size) size = x.size();
+		ASSERT_LEQ (size, x.size());
+		ASSERT_EQ (size, dimension);
+		batch.row(batch_fill++) = input_map_t(x.data(), size).cast<value_t>().transpose();
+		if (batch_fill < (size_t)batch.rows()) return false;
+		if (!batches) init();
+		step();
+		return true;
+	}
+
+	/**
+	 * The index of the component with the highest posterior probability for x, O(Kd^2) or O(Kd).
+	 */
+	size_t classify(const std::vector<float> & x) const {
+		ASSERT (initialized());
+		ASSERT_EQ (x.size(), dimension);
+		vector_t y = input_map_t(x.data(), dimension).cast<value_t>();
+		size_t k_max = 0;
+		value_t max = -std::numeric_limits<value_t>::infinity();
+		for (size_t k = 0; k < components.size(); ++k) {
+			value_t p = log_density(y, k);
+			if (p > max) {
+				max = p;
+				k_max = k;
+			}
+		}
+		return k_max;
+	}
+
+	//! Returns true if the first batch has been processed
+	inline bool initialized() const { return batches > 0; }
+
+	//! Number of batches processed so far
+	inline size_t batchCount() const { return batches; }
+
+	//! Average log-likelihood per sample of the last batch, under the model before it was updated with that batch
+	inline value_t log_likelihood() const { return batch_log_likelihood; }
+
+	//! Store the mixture in "snapshot", call only if initialized() (see ModelSnapshot)
+	void snapshot(ModelSnapshot & snapshot) const {
+		ASSERT (initialized());
+		snapshot.createMixture(components.size(), dimension, covariance_type, 0, false);
+		for (size_t k = 0; k < components.size(); ++k) {
+			const Component & c = components[k];
+			snapshot.setComponent(k, c.weight, c.mean, c.covariance, c.log_normalization);
+		}
+	}
+
+	void print() {
+		std::cout << "Mixture after " << batches << " batches (average log-likelihood " << batch_log_likelihood
+				<< "): " << std::endl;
+		for (size_t k = 0; k < components.size(); ++k) {
+			std::cout << "Component " << k << " with weight " << components[k].weight << ": " <<
+					components[k].mean.transpose() << std::endl;
+			std::cout << "Covariance " << std::endl << components[k].covariance.matrix() << std::endl;
+		}
+	}
+
+protected:
+	/**
+	 * A component with its parameters, and its decayed average sufficient statistics E[r], E[r x], and E[r x x'] (or
+	 * only the diagonal of the latter if the covariance matrix is not full).
+	 */
+	struct Component {
+		value_t weight;
+		vector_t mean;
+		Covariance covariance;
+		value_t log_normalization;
+
+		value_t s_w;
+		vector_t s_x;
+		matrix_t s_xx;
+		vector_t s_xx_diagonal;
+	};
+
+	//! Log of w_k N(x; \mu_k, \Sigma_k)
+	template<typename Derived>
+	inline value_t log_density(const Eigen::MatrixBase<Derived> & x, size_t k) const {
+		const Component & c = components[k];
+		return std::log(c.weight) + c.log_normalization - value_t(0.5) * c.covariance.mahalanobis(x - c.mean);
+	}
+
+	//! Cache the factorization and normalization constant of component "k"
+	void prepare(size_t k) {
+		Component & c = components[k];
+		c.covariance.factorize();
+		c.log_normalization = -value_t(0.5) * (dimension * std::log(2.0*M_PI) + c.covariance.logDeterminant());
+	}
+
+	/**
+	 * Initialize the model from the first batch. The statistics are set to what they would be for these parameters,
+	 * so the first step already averages with a sensible starting point.
+	 */
+	void init() {
+		const size_t K = components.size();
+		vector_t mean = batch.colwise().mean().transpose();
+		vector_t variance = (batch.rowwise() - mean.transpose()).colwise().squaredNorm().transpose() / batch.rows();
+		variance.array() += regularization * std::max(value_t(1), variance.maxCoeff());
+		for (size_t k = 0; k < K; ++k) {
+			Component & c = components[k];
+			c.weight = value_t(1) / K;
+			c.mean = batch.row(k).transpose();
+			c.covariance.setIdentity(covariance_type, dimension);
+			c.covariance.estimate(matrix_t(variance.asDiagonal()), 1);
+			c.s_w = c.weight;
+			c.s_x = c.weight * c.mean;
+			if (covariance_type == COV_FULL) {
+				c.s_xx = c.weight * (c.covariance.matrix() + c.mean * c.mean.transpose());
+			} else {
+				c.s_xx_diagonal = c.weight * (c.covariance.matrix().diagonal() + c.mean.cwiseAbs2());
+			}
+			prepare(k);
+		}
+	}
+
+	/**
+	 * Process a full batch: E-step on the batch, update of the decayed statistics, and M-step.
+	 */
+	void step() {
+		const size_t K = components.size();
+		const size_t n = batch.rows();
+		const value_t B = n;
+		const sample_matrix_t & x = batch;
+		const sample_matrix_t & r = responsibilities;
+
+		// E-step, responsibilities through log-sum-exp
+		value_t log_likelihood = 0;
+		for (size_t i = 0; i < n; ++i) {
+			for (size_t k = 0; k < K; ++k) {
+				responsibilities(i,k) = log_density(batch.row(i).transpose(), k);
+			}
+			value_t max = responsibilities.row(i).maxCoeff();
+			responsibilities.row(i) = (responsibilities.row(i).array() - max).exp();
+			value_t sum = responsibilities.row(i).sum();
+			responsibilities.row(i) /= sum;
+			log_likelihood += max + std::log(sum);
+		}
+		batch_log_likelihood = log_likelihood / B;
+
+		// stepwise update of the statistics with the batch averages
+		value_t eta = std::pow(value_t(batches + 2), -alpha);
+		matrix_t sum_x = r.transpose() * x;
+		matrix_t sum_xx_diagonal;
+		if (covariance_type != COV_FULL) {
+			sum_xx_diagonal = r.transpose() * x.cwiseAbs2();
+		}
+		for (size_t k = 0; k < K; ++k) {
+			Component & c = components[k];
+			c.s_w = (1 - eta) * c.s_w + eta * r.col(k).sum() / B;
+			c.s_x = (1 - eta) * c.s_x + eta * sum_x.row(k).transpose() / B;
+			if (covariance_type == COV_FULL) {
+				matrix_t y = x.array().colwise() * (r.col(k).array() / B).sqrt();
+				c.s_xx *= (1 - eta);
+				c.s_xx.selfadjointView<Eigen::Lower>().rankUpdate(y.transpose(), eta);
+				c.s_xx = c.s_xx.selfadjointView<Eigen::Lower>();
+			} else {
+				c.s_xx_diagonal = (1 - eta) * c.s_xx_diagonal + eta * sum_xx_diagonal.row(k).transpose() / B;
+			}
+		}
+
+		// M-step, a component without support keeps its parameters
+		value_t total = 0;
+		for (size_t k = 0; k < K; ++k) {
+			total += components[k].s_w;
+		}
+		for (size_t k = 0; k < K; ++k) {
+			Component & c = components[k];
+			c.weight = c.s_w / total;
+			if (c.s_w <= std::numeric_limits<value_t>::min()) continue;
+			c.mean = c.s_x / c.s_w;
+			if (covariance_type == COV_FULL) {
+				matrix_t scatter = c.s_xx - c.s_w * c.mean * c.mean.transpose();
+				scatter.diagonal().array() += regularization * c.s_w;
+				c.covariance.estimate(scatter, c.s_w);
+			} else {
+				vector_t scatter = c.s_xx_diagonal - c.s_w * c.mean.cwiseAbs2();
+				scatter.array() += regularization * c.s_w;
+				c.covariance.estimateDiagonal(scatter, c.s_w);
+			}
+			prepare(k);
+		}
+
+		batch_fill = 0;
+		batches++;
+	}
+
+private:
+	//! Dimension of the samples
+	size_t dimension;
+
+	//! Structure of the covariance matrices
+	CovarianceType covariance_type;
+
+	//! The mixture components
+	std::vector<Component> components;
+
+	//! The current batch, the number of samples in it, and their responsibilities (B x K)
+	sample_matrix_t batch;
+	size_t batch_fill;
+	sample_matrix_t responsibilities;
+
+	//! Number of batches processed
+	size_t batches;
+
+	//! Exponent of the step size
+	value_t alpha;
+
+	//! Added to the variances, relative to the support of a component
+	value_t regularization;
+
+	//! Average log-likelihood of the last batch
+	value_t batch_log_likelihood;
+};
+
+#endif /* ONLINEEXPECTATIONMAXIMIZATION_H_ */
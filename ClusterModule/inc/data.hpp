@@ -20,87 +20,422 @@
  * @case    Artificial Intelligence Framework
  */
 
+#ifndef DATA_HPP_
+#define DATA_HPP_
+
 #include <string>
-#include <locale>
-#include <sstream>
 #include <vector>
 #include <iterator>
 #include <iostream>
 #include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <stdint.h>
 
-struct comma_ws: std::ctype<char> {
-	static const mask* make_table() {
-		static std::vector<mask> v(classic_table(), classic_table() + table_size);
-		v[','] |= space;  // comma will be classified as whitespace
-		v[' '] |= space;  // space will also be classified as whitespace
-		v['.'] &= ~space; // dot is nothing
-		return &v[0];
-	}
-	comma_ws(std::size_t refs = 0) : ctype<char>(make_table(), false, refs) {}
-};
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <ThreadPool.hpp>
 
 /**
  * Data is just a set of vectors.
+ *
+ * The values of all vectors are stored contiguously, with per vector the offset of its first value. A data file is
+ * best loaded with load(), which memory-maps the file and parses it in parallel chunks of lines, with a parser that
+ * does not depend on the locale. Values are separated by commas and/or whitespace, and a line ends at the first token
+ * that is not a number. The result is written as binary cache next to the file (the file name with ".cache" appended)
+ * while parsing, a few chunks at a time, and then the cache is memory-mapped. The next time the cache is memory-mapped
+ * directly, as long as the size and the modification time of the file did not change. The memory used by the data
+ * is hence bounded by a few chunks, only if the cache can not be written the values are kept in memory.
  */
 template <typename T>
 class data {
 public:
 	data() {
-		set.clear();
 		index = -1;
+		mapping = NULL;
+		mapping_size = 0;
+		clear();
+	}
+	virtual ~data() {
+		unmap();
 	}
-	virtual ~data() {}
 
-	/*inline void test() {
-		if (set.size() == 0) {
-			std::cout << "Empty" << std::endl;
-			return;
-		}
-		int i = 0;
-		std::cout << "Size of first item is " << set[i].size() << std::endl;
+	/**
+	 * Load the data file "file", from its cache if that is up to date, otherwise by parsing the file (in parallel on
+	 * the pool if given) into the cache and mapping that. Returns false if the file cannot be read. Previous data is
+	 * discarded.
+	 */
+	bool load(const std::string & file, ThreadPool *pool = NULL) {
+		clear();
+		struct stat source;
+		if (stat(file.c_str(), &source) != 0) return false;
+		std::string cache = file + ".cache";
+		if (map_cache(cache, source)) return true;
 
-		std::cout << "Content is " << set[i][0];
-		for (int j = 1; j < set[i].size(); ++j) {
-			std::cout << ", " << set[i][j];
+		int fd = open(file.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		const char *text = NULL;
+		if (source.st_size > 0) {
+			void *addr = mmap(NULL, source.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (addr == MAP_FAILED) {
+				close(fd);
+				return false;
+			}
+			text = (const char*)addr;
 		}
-		std::cout << std::endl;
-	}*/
+		close(fd);
+		if (!parse_to_cache(text, text + source.st_size, pool, cache, source) || !map_cache(cache, source)) {
+			// without a cache the values are kept in memory
+			parse(text, text + source.st_size, pool);
+		}
+		if (text) munmap((void*)text, source.st_size);
+		return true;
+	}
 
+	/**
+	 * The next vector, wraps around at the end. The reference is to a buffer that is overwritten by the next call.
+	 */
 	std::vector<T> &pop() {
-		return set[(++index) % set.size()];
+		size_t i = (++index) % size();
+		current.assign(values + offsets[i], values + offsets[i+1]);
+		return current;
 	}
 
-	inline size_t size() { return set.size(); }
+	inline size_t size() { return rows; }
+
+	//! Number of values in vector "i", and a pointer to them
+	inline size_t length(size_t i) const { return offsets[i+1] - offsets[i]; }
+	inline const T *row(size_t i) const { return values + offsets[i]; }
+
+	//! Returns true if the data comes from a memory-mapped cache
+	inline bool mapped() const { return mapping != NULL; }
 
 private:
-	int index;
+	// the values can be memory-mapped, hence no copies
+	data(const data &);
+	data & operator=(const data &);
+
+	//! Header of the cache file, followed by the values, padded to a multiple of 8 bytes, and the offsets (rows + 1)
+	struct CacheHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t value_size;
+		uint64_t source_size;
+		int64_t source_time;
+		uint64_t rows;
+		uint64_t count;
+	};
+
+	static const uint32_t cache_version = 2;
+
+	//! Lines are parsed in chunks of about this many bytes
+	static const size_t parse_chunk_size = 1 << 20;
+
+	//! The values and offsets of the lines in one chunk of text
+	struct Chunk {
+		std::vector<T> values;
+		std::vector<uint64_t> lengths;
+	};
+
+	void clear() {
+		unmap();
+		index = -1;
+		buffer.clear();
+		offset_buffer.assign(1, 0);
+		offsets = &offset_buffer[0];
+		rows = 0;
+		values = NULL;
+	}
+
+	void unmap() {
+		if (mapping) munmap(mapping, mapping_size);
+		mapping = NULL;
+		mapping_size = 0;
+	}
+
+	//! Take the values and offsets from the buffers (after they have been filled)
+	void own() {
+		values = buffer.empty() ? NULL : &buffer[0];
+		offsets = &offset_buffer[0];
+		rows = offset_buffer.size() - 1;
+	}
+
+	//! Split the text in chunks of about parse_chunk_size bytes that end at a line end
+	static std::vector<const char*> split(const char *begin, const char *end) {
+		std::vector<const char*> bounds(1, begin);
+		while (bounds.back() != end) {
+			const char *p = bounds.back() + std::min((size_t)parse_chunk_size, size_t(end - bounds.back()));
+			while (p != end && *(p - 1) != '\n') ++p;
+			bounds.push_back(p);
+		}
+		return bounds;
+	}
+
+	//! Parse the chunks [first, last) of "bounds" into "results" (in parallel on the pool if given)
+	static void parse_chunks(const std::vector<const char*> & bounds, size_t first, size_t last,
+			std::vector<Chunk> & results, ThreadPool *pool) {
+		results.assign(last - first, Chunk());
+		ThreadPool::job_t job = [&bounds, &results, first] (size_t c) {
+			parse_lines(bounds[first + c], bounds[first + c + 1], results[c]);
+		};
+		if (pool) {
+			pool->run(last - first, job);
+		} else {
+			for (size_t c = 0; c < last - first; ++c) job(c);
+		}
+	}
+
+	inline static bool separator(char c) {
+		return c == ',' || c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+	/**
+	 * Parse a number in [p, end) without locale. Returns false if there is no number at p, or if it is directly
+	 * followed by something else than a separator or line end. Up to 19 significant digits are collected in an
+	 * integer, which is scaled by a power of ten afterwards.
+	 */
+	static bool number(const char *& p, const char *end, T & value) {
+		static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13,
+			1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+		const char *q = p;
+		bool negative = false;
+		if (q != end && (*q == '-' || *q == '+')) negative = (*q++ == '-');
+		uint64_t mantissa = 0;
+		int digits = 0, exponent = 0;
+		bool any = false;
+		for (; q != end && *q >= '0' && *q <= '9'; ++q, any = true) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*q - '0');
+				if (mantissa) digits++;
+			} else {
+				exponent++;
+			}
+		}
+		if (q != end && *q == '.') {
+			for (++q; q != end && *q >= '0' && *q <= '9'; ++q, any = true) {
+				if (digits < 19) {
+					mantissa = mantissa * 10 + (*q - '0');
+					if (mantissa) digits++;
+					exponent--;
+				}
+			}
+		}
+		if (!any) return false;
+		if (q != end && (*q == 'e' || *q == 'E')) {
+			const char *e = q + 1;
+			bool negative_exponent = false;
+			if (e != end && (*e == '-' || *e == '+')) negative_exponent = (*e++ == '-');
+			if (e != end && *e >= '0' && *e <= '9') {
+				int power = 0;
+				for (; e != end && *e >= '0' && *e <= '9'; ++e) {
+					if (power < 10000) power = power * 10 + (*e - '0');
+				}
+				exponent += negative_exponent ? -power : power;
+				q = e;
+			}
+		}
+		if (q != end && *q != '\n' && !separator(*q)) return false;
+		double result = mantissa;
+		if (exponent < 0 && exponent >= -22) result /= powers[-exponent];
+		else if (exponent > 0 && exponent <= 22) result *= powers[exponent];
+		else if (exponent) result *= std::pow(10.0, exponent);
+		value = T(negative ? -result : result);
+		p = q;
+		return true;
+	}
 
-	typedef std::vector<T> sample;
-	std::vector < sample > set;
+	//! Parse the lines in [begin, end), empty lines (or lines that start with something else than a number) are skipped
+	static void parse_lines(const char *begin, const char *end, Chunk & chunk) {
+		const char *p = begin;
+		while (p != end) {
+			size_t length = 0;
+			while (p != end && *p != '\n') {
+				if (separator(*p)) {
+					++p;
+					continue;
+				}
+				T value;
+				if (!number(p, end, value)) {
+					// like an input stream, stop at the first token that cannot be read
+					while (p != end && *p != '\n') ++p;
+					break;
+				}
+				chunk.values.push_back(value);
+				length++;
+			}
+			if (p != end) ++p;
+			if (length) chunk.lengths.push_back(length);
+		}
+	}
 
-	friend std::ostream &operator<<(std::ostream &out, data d) {
-		for (int i = 0; i < d.set.size(); ++i) {
-			if (d.set[i].size() > 0) {
-				out << d.set[i][0];
-				for (int j = 1; j < d.set[i].size(); ++j) {
-					out << ',' << d.set[i][j];
+	/**
+	 * Split the text in chunks that end at a line end, parse them (in parallel), and concatenate the results in
+	 * chunk order, in memory.
+	 */
+	void parse(const char *begin, const char *end, ThreadPool *pool) {
+		std::vector<const char*> bounds = split(begin, end);
+		const size_t chunks = bounds.size() - 1;
+		std::vector<Chunk> results;
+		parse_chunks(bounds, 0, chunks, results, pool);
+		size_t count = 0, lines = 0;
+		for (size_t c = 0; c < chunks; ++c) {
+			count += results[c].values.size();
+			lines += results[c].lengths.size();
+		}
+		buffer.reserve(count);
+		offset_buffer.reserve(lines + 1);
+		for (size_t c = 0; c < chunks; ++c) {
+			buffer.insert(buffer.end(), results[c].values.begin(), results[c].values.end());
+			for (size_t r = 0; r < results[c].lengths.size(); ++r) {
+				offset_buffer.push_back(offset_buffer.back() + results[c].lengths[r]);
+			}
+		}
+		own();
+	}
+
+	/**
+	 * Parse the text as parse(), but a round of as many chunks as there are threads at a time, of which the values are
+	 * appended to the cache file and the offsets to a temporary file. At the end the offsets are appended to the
+	 * values, and the header is written. The cache is written to a temporary file that is renamed, so a cache is never
+	 * read half written. A failure (for example a read-only directory) is reported, and false is returned.
+	 */
+	bool parse_to_cache(const char *begin, const char *end, ThreadPool *pool, const std::string & cache,
+			const struct stat & source) const {
+		std::string temporary = cache + ".tmp", temporary_offsets = cache + ".offsets.tmp";
+		FILE *f = fopen(temporary.c_str(), "w+b");
+		FILE *o = f ? fopen(temporary_offsets.c_str(), "w+b") : NULL;
+		CacheHeader h;
+		memset(&h, 0, sizeof(h));
+		bool success = (o != NULL) && fwrite(&h, sizeof(h), 1, f) == 1;
+		uint64_t offset = 0;
+		success = success && fwrite(&offset, sizeof(offset), 1, o) == 1;
+
+		std::vector<const char*> bounds = split(begin, end);
+		const size_t chunks = bounds.size() - 1, round = pool ? pool->size() : 1;
+		std::vector<Chunk> results;
+		for (size_t first = 0; first < chunks && success; first += round) {
+			parse_chunks(bounds, first, std::min(first + round, chunks), results, pool);
+			for (size_t c = 0; c < results.size() && success; ++c) {
+				const Chunk & chunk = results[c];
+				success = chunk.values.empty() ||
+						fwrite(&chunk.values[0], sizeof(T), chunk.values.size(), f) == chunk.values.size();
+				for (size_t r = 0; r < chunk.lengths.size() && success; ++r) {
+					offset += chunk.lengths[r];
+					success = fwrite(&offset, sizeof(offset), 1, o) == 1;
 				}
-				out << std::endl;
+				h.rows += chunk.lengths.size();
+			}
+		}
+		h.count = offset;
+
+		// pad the values, append the offsets, and write the header
+		const char padding[sizeof(uint64_t)] = { 0 };
+		size_t pad = padded(h.count * sizeof(T)) - h.count * sizeof(T);
+		success = success && (!pad || fwrite(padding, 1, pad, f) == pad) && fseek(o, 0, SEEK_SET) == 0;
+		std::vector<char> block(1 << 20);
+		for (size_t n; success && (n = fread(&block[0], 1, block.size(), o)) > 0; ) {
+			success = fwrite(&block[0], 1, n, f) == n;
+		}
+		memcpy(h.magic, "AIMDATA", 8);
+		h.version = cache_version;
+		h.value_size = sizeof(T);
+		h.source_size = source.st_size;
+		h.source_time = source.st_mtime;
+		success = success && fseek(f, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, f) == 1;
+		if (o) fclose(o);
+		remove(temporary_offsets.c_str());
+		if (f) success = (fclose(f) == 0) && success;
+		success = success && (rename(temporary.c_str(), cache.c_str()) == 0);
+		if (!success) {
+			remove(temporary.c_str());
+			std::cerr << "Could not write cache " << cache << std::endl;
+		}
+		return success;
+	}
+
+	//! Number of bytes rounded up to a multiple of the size of an offset
+	static inline size_t padded(size_t bytes) {
+		return (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+	}
+
+	/**
+	 * Map the cache if it exists and belongs to "source". Returns false otherwise.
+	 */
+	bool map_cache(const std::string & cache, const struct stat & source) {
+		int fd = open(cache.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat info;
+		CacheHeader h;
+		if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(h) || read(fd, &h, sizeof(h)) != sizeof(h)) {
+			close(fd);
+			return false;
+		}
+		size_t expected = sizeof(h) + padded(h.count * sizeof(T)) + (h.rows + 1) * sizeof(uint64_t);
+		if (memcmp(h.magic, "AIMDATA", 8) || h.version != cache_version || h.value_size != sizeof(T) ||
+				h.source_size != (uint64_t)source.st_size || h.source_time != (int64_t)source.st_mtime ||
+				(size_t)info.st_size != expected) {
+			close(fd);
+			return false;
+		}
+		void *addr = mmap(NULL, expected, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (addr == MAP_FAILED) return false;
+		mapping = addr;
+		mapping_size = expected;
+		values = (const T*)((const char*)addr + sizeof(h));
+		offsets = (const uint64_t*)((const char*)addr + sizeof(h) + padded(h.count * sizeof(T)));
+		rows = h.rows;
+		return true;
+	}
+
+	int index;
+
+	//! The values when parsed (not mapped)
+	std::vector<T> buffer;
+
+	//! Start of each vector in values, and the end of the last one, and the number of vectors
+	const uint64_t *offsets;
+	size_t rows;
+
+	//! The offsets when parsed (not mapped)
+	std::vector<uint64_t> offset_buffer;
+
+	//! All values, either in the buffer or in the mapping
+	const T *values;
+
+	//! The memory-mapped cache, if any
+	void *mapping;
+	size_t mapping_size;
+
+	//! Returned by pop()
+	std::vector<T> current;
+
+	friend std::ostream &operator<<(std::ostream &out, const data & d) {
+		for (size_t i = 0; i < d.rows; ++i) {
+			const T *v = d.row(i);
+			out << v[0];
+			for (size_t j = 1; j < d.length(i); ++j) {
+				out << ',' << v[j];
 			}
+			out << std::endl;
 		}
 		return out;
 	}
 
+	/**
+	 * Read the data from a stream. This reads the entire stream into memory and parses it like load(), but
+	 * sequentially and without cache.
+	 */
 	friend std::istream &operator>>(std::istream &in, data &d) {
-		std::string buffer;
-		while (std::getline(in, buffer)) {
-			std::stringstream ss(buffer);
-			std::vector<T> t;
-			ss.imbue(std::locale(std::locale(), new comma_ws));
-			std::copy(std::istream_iterator<T>(ss), std::istream_iterator<T>(), std::back_inserter(t));
-			if (!t.empty())
-				d.set.push_back(t);
-		}
+		std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		d.clear();
+		d.parse(text.data(), text.data() + text.size(), NULL);
 		return in;
 	}
 };
+
+#endif /* DATA_HPP_ */
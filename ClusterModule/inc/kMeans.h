@@ -34,7 +34,14 @@
 #include <set>
 #include <cmath>
 #include <cstddef>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+#include <random>
 #include <assert.hpp>
+#include <ThreadPool.hpp>
+#include <ContingencyTable.hpp>
+#include <ModelSnapshot.hpp>
 
 template<typename _Tp>
 struct sqr : public std::unary_function<_Tp, _Tp> {
@@ -52,9 +59,33 @@ public:
 	typedef Eigen::Matrix<value_t,1,Eigen::Dynamic> vector_t; // row_vector
 	typedef Eigen::Matrix<value_t,Eigen::Dynamic,Eigen::Dynamic> matrix_t; // matrix
 	typedef Eigen::Matrix<value_t,Eigen::Dynamic,1> column_vector_t;
+	typedef Eigen::Matrix<value_t,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> sample_matrix_t; // one sample per row
+	typedef Eigen::Map<const sample_matrix_t> sample_map_t;
 
 	typedef Eigen::Matrix<size_t,1,Eigen::Dynamic> index_vector_t; // row
 
+	/**
+	 * The assignment step can be accelerated by keeping bounds on the distance of each sample to the means and using
+	 * the triangle inequality to skip distance calculations that cannot change the assignment. The result is the
+	 * same as for Lloyd's iteration: all methods decide with the same squared distance (see squared_distance) and
+	 * take the mean with the lowest index on an exact tie. The bounds are on the (not squared) distance with a margin
+	 * for rounding errors, and a mean is only skipped if the bounds separate it strictly, so also not on a tie.
+	 *   A_LLOYD    calculates all N x K distances each iteration (tiled, see assign_block)
+	 *   A_HAMERLY  keeps one upper and one lower bound per sample, O(N) extra memory
+	 *   A_ELKAN    keeps one upper and K lower bounds per sample, O(NK) extra memory, skips the most calculations
+	 */
+	enum AssignMethod { A_LLOYD, A_HAMERLY, A_ELKAN, NUMBER_OF_ASSIGN_METHODS };
+
+	/**
+	 * The initial means can be chosen in different ways.
+	 *   S_RANDOM            uniformly random in [0,1] for each dimension, independent of the data
+	 *   S_KMEANS_PLUS_PLUS  k-means++, each next mean is a sample picked with probability proportional to its squared
+	 *                       distance to the nearest mean so far, K passes over the data
+	 *   S_KMEANS_PARALLEL   k-means||, oversamples about 2K samples per pass in a few passes, and reduces these to K
+	 *                       means with a weighted k-means++, for large data sets
+	 */
+	enum SeedMethod { S_RANDOM, S_KMEANS_PLUS_PLUS, S_KMEANS_PARALLEL, NUMBER_OF_SEED_METHODS };
+
 	struct Pair {
 		Pair(size_t ground_truth) {
 			this->prediction = 0;
@@ -64,13 +95,6 @@ public:
 		size_t ground_truth;
 	};
 
-	// Cluster has a mean and references a subset of vectors in the data set
-	struct Cluster {
-		vector_t mean;
-		std::vector<size_t> r_data;
-//		index_vector_t r_data;
-	};
-
 	void test() {
 		// in Eigen broadcasting can be used, see
 		// http://stackoverflow.com/questions/18403478/how-can-i-apply-bsxfun-like-functionality-at-eigen
@@ -134,28 +158,139 @@ public:
 		long int seed = rdtsc();
 		// seed = 58564383378988; gives 0.8737
 		std::cout << "Use seed " << seed << std::endl;
-		srand(seed);
-		clusters.resize(K);
-		distances.resize(K);
+		generator.seed(seed);
+		dimension = D;
+		sample_count = 0;
+		sample_data = NULL;
+		sample_weights = NULL;
+		means.resize(K, D);
 		for (int k = 0; k < K; ++k) {
 			init(k, D);
 		}
+		max_mean_norm = 0;
+		assign_method = A_LLOYD;
+		seed_method = S_KMEANS_PLUS_PLUS;
+		bounds_valid = false;
+		pool = NULL;
+		changes = 0;
+		max_drift = 0;
+		ticked = false;
+		max_changes_fraction = 0;
+		max_shift = 0;
+		tracking = false;
 	}
 
 	~KMeans() {}
 
+	/**
+	 * One Lloyd iteration. The samples are split in chunks. For each chunk the assignment step is done per tile of
+	 * samples (see assign_block), or through one of the bounded methods (see AssignMethod), and the sums and counts
+	 * per cluster are accumulated for that chunk only. The partial sums are added in chunk order to get the new means.
+	 *
+	 * If a thread pool is set, the chunks are processed in parallel. The chunks do not depend on the number of
+	 * threads, hence neither does the result.
+	 */
 	void tick() {
-		for (int k = 0; k < clusters.size(); ++k) {
-			clear(k);
-		}
-		for (int i = 0; i < data_set.size(); ++i) {
-			assign(i);
+		if (assign_method != A_LLOYD) {
+			calculate_mean_distances();
+			if (!bounds_valid) {
+				upper_bounds.resize(sample_count);
+				lower_bounds.resize(assign_method == A_ELKAN ? sample_count * means.rows() : sample_count);
+			}
 		}
-		for (int k = 0; k < clusters.size(); ++k) {
-			update(k);
+		const size_t chunks = chunk_count();
+		partials.resize(chunks);
+		const bool exact = !bounds_valid;
+		run(chunks, [this, exact] (size_t c) {
+			size_t begin = c * chunk_size, end = std::min(begin + chunk_size, sample_count);
+			size_t changed = 0;
+			switch (assign_method) {
+			case A_LLOYD: default:
+				for (size_t b = begin; b < end; b += block_size) {
+					changed += assign_block(b, std::min(b + block_size, end));
+				}
+				break;
+			case A_HAMERLY:
+				if (exact) changed = assign_exact(begin, end);
+				else changed = assign_hamerly(begin, end);
+				break;
+			case A_ELKAN:
+				if (exact) changed = assign_exact(begin, end);
+				else changed = assign_elkan(begin, end);
+				break;
+			}
+			accumulate(partials[c], begin, end);
+			partials[c].changes = changed;
+			if (tracking) collect_moves(partials[c], begin, end);
+		});
+		bounds_valid = (assign_method != A_LLOYD);
+		update();
+		if (tracking) update_table();
+		if (bounds_valid) {
+			run(chunks, [this] (size_t c) {
+				update_bounds(c * chunk_size, std::min((c + 1) * chunk_size, sample_count));
+			});
 		}
 	}
 
+	/**
+	 * Use the given pool to run the iterations in parallel. With NULL everything runs on the calling thread. The pool
+	 * is not owned by KMeans and can be shared.
+	 */
+	void setThreadPool(ThreadPool *pool) {
+		this->pool = pool;
+	}
+
+	/**
+	 * Returns true if the last tick changed at most a fraction "max_changes_fraction" of the assignments, or moved no
+	 * mean further than "max_shift". With both zero (the default) this is the case if the assignments are stable, and
+	 * further ticks will not change anything anymore.
+	 */
+	bool converged() const {
+		return (changes <= max_changes_fraction * sample_count) || (max_drift <= max_shift);
+	}
+
+	/**
+	 * Set the criteria for converged().
+	 */
+	void setConvergence(double max_changes_fraction, value_t max_shift) {
+		this->max_changes_fraction = max_changes_fraction;
+		this->max_shift = max_shift;
+	}
+
+	//! The number of assignments that changed in the last tick
+	inline size_t changed() const { return changes; }
+
+	/**
+	 * Keep the contingency table of clusters versus ground truth labels up to date after every tick, see quality().
+	 * Only the samples that changed cluster are moved in the table, so this costs little compared to a tick.
+	 */
+	void setTracking(bool enable) {
+		tracking = enable && labelled();
+		if (tracking) build_table();
+	}
+
+	/**
+	 * The contingency table of the current assignments. Up to date after each tick with tracking (see setTracking),
+	 * otherwise only after evaluate().
+	 */
+	inline const ContingencyTable & quality() const { return table; }
+
+	/**
+	 * Select the method to choose the initial means, used in init().
+	 */
+	void setSeedMethod(SeedMethod method) {
+		seed_method = method;
+	}
+
+	/**
+	 * Select the method for the assignment step. Bounds are (re)initialized on the next tick.
+	 */
+	void setAssignMethod(AssignMethod method) {
+		assign_method = method;
+		bounds_valid = false;
+	}
+
 	/**
 	 * Add a sample, size is given as separate parameter, so it is possible to take only the first N items from the
 	 * sample rather than the entire vector.
@@ -163,50 +298,128 @@ public:
 	void addSample(std::vector<value_t> & x, size_t label, size_t size = 0) {
 		if (!size) size = x.size();
 		ASSERT_LEQ (size, x.size());
-		vector_t v(size); v.setZero();
-		v = vector_t::Map(x.data(), 1, size); // create row-vector
-		data_set.push_back(v);
+		ASSERT_EQ (size, dimension);
+		samples.insert(samples.end(), x.begin(), x.begin() + size);
 		labels.push_back(Pair(label));
+		sample_count++;
+		sample_data = samples.data();
+		sample_weights = NULL;
+	}
+
+	/**
+	 * Use "count" samples of which the values are stored contiguously at "x", one sample per row, instead of adding
+	 * them one by one. No copy is made, so several instances can cluster the same data (concurrently). The data
+	 * should outlive this instance. There are no ground truth labels, so evaluate() is not available till they are
+	 * given by setLabels().
+	 *
+	 * Optionally each sample has a weight, e.g. the number of samples it summarizes (see CFTree). A sample with weight
+	 * w counts as w samples in the means and in the seeding.
+	 */
+	void setData(const value_t *x, size_t count, const value_t *weights = NULL) {
+		samples.clear();
+		labels.clear();
+		tracking = false;
+		sample_data = x;
+		sample_weights = weights;
+		sample_count = count;
 	}
 
+	//! The ground truth labels of the samples given by setData(), one per sample, to evaluate() the clustering
+	void setLabels(const std::vector<size_t> & ground_truth) {
+		ASSERT_EQ (ground_truth.size(), sample_count);
+		labels.assign(ground_truth.begin(), ground_truth.end());
+	}
+
+	/**
+	 * Seed the random generator of this instance, and draw the random initial means again. The generator is not
+	 * shared with other instances, so instances can be initialized concurrently, each reproducibly by its own seed.
+	 */
+	void setSeed(unsigned int seed) {
+		generator.seed(seed);
+		for (int k = 0; k < means.rows(); ++k) {
+			init(k, dimension);
+		}
+	}
+
+	/**
+	 * Call after all samples have been added. Chooses the initial means according to the seed method.
+	 */
 	void init() {
-		size_t D = data_set.size();
+		reset();
+		if (!sample_count) return;
+		switch (seed_method) {
+		case S_RANDOM: default:
+			break;
+		case S_KMEANS_PLUS_PLUS:
+			seed_plus_plus();
+			break;
+		case S_KMEANS_PARALLEL:
+			seed_parallel();
+			break;
+		}
+		update_norms();
+	}
+
+	/**
+	 * Call after all samples have been added. Starts from the given means (K x D) rather than choosing them.
+	 */
+	void init(const sample_matrix_t & initial_means) {
+		ASSERT_EQ (initial_means.rows(), means.rows());
+		ASSERT_EQ (initial_means.cols(), means.cols());
+		reset();
+		means = initial_means;
+		update_norms();
 	}
 
 	std::vector<Pair> & result() {
 		return labels;
 	}
 
-	void evaluate() {
-		for (int k = 0; k < clusters.size(); ++k) {
-			for (int i = 0; i < clusters[k].r_data.size(); ++i) {
-				labels[clusters[k].r_data[i]].prediction = k;
-				//				std::cout << "Cluster " << k << ", data item " << clusters[k].r_data[i] << std::endl;
-			}
-		}
+	//! The cluster means, one per row (K x D)
+	inline const sample_matrix_t & clusterMeans() const { return means; }
 
-		size_t a, b, c, d; a = b = c = d = 0;
-		for (int i = 0; i < data_set.size(); ++i) {
-			for (int j = i+1; j < data_set.size(); ++j) {
-				if (labels[i].ground_truth == labels[j].ground_truth) {
-					if (labels[i].prediction == labels[j].prediction) {
-						a++;
-					} else {
-						c++;
-					}
-				} else {
-					if (labels[i].prediction == labels[j].prediction) {
-						d++;
-					} else {
-						b++;
-					}
-				}
-			}
+	//! Per sample the index of the cluster it is assigned to (by the last tick)
+	inline const std::vector<size_t> & clusterAssignments() const { return assignments; }
+
+	/**
+	 * The index of the mean nearest to the sample "x" of "dimension" values, O(KD). The sample does not have to be one
+	 * of the samples that are clustered.
+	 */
+	size_t classify(const value_t *x) const {
+		sample_matrix_t::Index nearest_k;
+		(means.rowwise() - Eigen::Map<const vector_t>(x, dimension)).rowwise().squaredNorm().minCoeff(&nearest_k);
+		return nearest_k;
+	}
+
+	//! Store the means in "snapshot", to classify samples later without the data (see ModelSnapshot)
+	void snapshot(ModelSnapshot & snapshot) const {
+		snapshot.createMeans(means.rows(), dimension);
+		for (int k = 0; k < means.rows(); ++k) {
+			snapshot.setMean(k, means.row(k));
 		}
+	}
 
-		value_t quality = (a+b) / value_t(a+b+c+d);
-		std::cout << "Rand index is (" << a << "+" << b << ") /" << a+b+c+d << " = " << quality << std::endl;
-		//std::cout << "Rand index is " << quality << std::endl;
+	/**
+	 * The samples as one contiguous row-major matrix, one sample per row. No copy is made.
+	 */
+	sample_map_t data() const {
+		return sample_map_t(sample_data, sample_count, dimension);
+	}
+
+	/**
+	 * Compare the assignments with the ground truth labels through a contingency table (see ContingencyTable), in one
+	 * pass over the samples, and print the Rand index, adjusted Rand index, normalized mutual information and purity.
+	 */
+	void evaluate() {
+		if (!labelled()) {
+			std::cerr << "There are no ground truth labels to evaluate with" << std::endl;
+			return;
+		}
+		for (size_t i = 0; i < sample_count; ++i) {
+			labels[i].prediction = assignments[i];
+		}
+		build_table();
+		table.print();
 	}
 
 	/**
@@ -214,16 +427,15 @@ public:
 	 */
 	void print() {
 		// print clusters
-		for (int k = 0; k < clusters.size(); ++k) {
-			std::set<size_t> l;
-			l.clear();
-			for (int i = 0; i < clusters[k].r_data.size(); ++i) {
-				l.insert(labels[clusters[k].r_data[i]].ground_truth);
-			}
+		std::vector<std::set<size_t> > l(means.rows());
+		for (size_t i = 0; i < sample_count && labelled(); ++i) {
+			l[assignments[i]].insert(labels[i].ground_truth);
+		}
+		for (int k = 0; k < means.rows(); ++k) {
 			std::cout << "Cluster " << k << " corresponds with ";
-			if (l.size()) {
+			if (l[k].size()) {
 				std::set<size_t>::iterator iter;
-				for (iter = l.begin(); iter != l.end(); ++iter) {
+				for (iter = l[k].begin(); iter != l[k].end(); ++iter) {
 					std::cout << *iter << " ";
 				}
 			} else {
@@ -234,79 +446,661 @@ public:
 
 		// print means
 		std::cout << "Cluster means: " << std::endl;
-		for (int k = 0; k < clusters.size(); ++k) {
-			std::cout << "Cluster: " << k << ": " << clusters[k].mean << std::endl;
+		for (int k = 0; k < means.rows(); ++k) {
+			std::cout << "Cluster: " << k << ": " << means.row(k) << std::endl;
 		}
 	}
 protected:
+	//! Forget the assignments and bounds, start as if no tick has been done yet
+	void reset() {
+		calculate_centre();
+		assignments.clear();
+		assignments.resize(sample_count, 0);
+		bounds_valid = false;
+		changes = sample_count;
+		max_drift = std::numeric_limits<value_t>::max();
+		ticked = false;
+		if (tracking) build_table();
+	}
+
+	//! Returns true if there is a ground truth label for every sample
+	inline bool labelled() const { return labels.size() == sample_count; }
+
+	//! The sums and counts (total weights) per cluster for one chunk of samples
+	struct Partial {
+		sample_matrix_t sums;
+		std::vector<double> counts;
+		size_t changes;
+		//! Samples of which the assignment differs from the one in the contingency table (only with tracking)
+		std::vector<size_t> moved;
+	};
+
+	//! Uniform random number in [0,1), from the generator of this instance
+	inline double uniform() {
+		return generator() / 4294967296.0;
+	}
+
+	/**
+	 * Pick an index with a probability proportional to its weight, times "factors" if given. Returns the last index
+	 * with a nonzero weight if rounding makes the cumulative sum fall short.
+	 */
+	size_t pick(const std::vector<value_t> & weights, double sum, const value_t *factors = NULL) {
+		double r = uniform() * sum, cumulative = 0;
+		size_t last = 0;
+		for (size_t i = 0; i < weights.size(); ++i) {
+			double weight = factors ? double(weights[i]) * factors[i] : weights[i];
+			if (weight <= 0) continue;
+			cumulative += weight;
+			last = i;
+			if (cumulative > r) break;
+		}
+		return last;
+	}
+
+	/**
+	 * Set "nearest" to the squared distance of each sample to the nearest of the given "candidates" (one per row), or
+	 * to the previous value in "nearest" if that is smaller. Returns the sum, weighted by the sample weights if there
+	 * are any, added per chunk in chunk order.
+	 */
+	double nearest_distances(const sample_matrix_t & candidates, std::vector<value_t> & nearest) {
+		const size_t chunks = chunk_count();
+		std::vector<double> chunk_sums(chunks, 0);
+		run(chunks, [this, &candidates, &nearest, &chunk_sums] (size_t c) {
+			sample_map_t x = data();
+			size_t end = std::min((c + 1) * chunk_size, sample_count);
+			for (size_t i = c * chunk_size; i < end; ++i) {
+				for (int j = 0; j < candidates.rows(); ++j) {
+					nearest[i] = std::min(nearest[i], (x.row(i) - candidates.row(j)).squaredNorm());
+				}
+				chunk_sums[c] += sample_weights ? double(nearest[i]) * sample_weights[i] : nearest[i];
+			}
+		});
+		double sum = 0;
+		for (size_t c = 0; c < chunks; ++c) sum += chunk_sums[c];
+		return sum;
+	}
+
+	/**
+	 * The k-means++ seeding by Arthur and Vassilvitskii (2007). The first mean is a random sample, each next mean is
+	 * a sample picked with probability proportional to its squared distance to the nearest mean chosen so far. This
+	 * is O(log K)-competitive with the optimal clustering in expectation. With sample weights the probabilities are
+	 * multiplied by the weights.
+	 */
+	void seed_plus_plus() {
+		sample_map_t x = data();
+		std::vector<value_t> nearest(sample_count, std::numeric_limits<value_t>::max());
+		means.row(0) = x.row(generator() % sample_count);
+		for (int k = 1; k < means.rows(); ++k) {
+			double sum = nearest_distances(means.middleRows(k - 1, 1), nearest);
+			means.row(k) = x.row(pick(nearest, sum, sample_weights));
+		}
+	}
+
+	/**
+	 * The k-means|| seeding by Bahmani et al. (2012). In each of a few rounds every sample is picked independently
+	 * with probability l * d^2 / sum(d^2), with an oversampling factor of l = 2K. The candidates are weighted by the
+	 * number (total weight) of samples nearest to them and reduced to K means by a weighted k-means++.
+	 */
+	void seed_parallel() {
+		const size_t K = means.rows();
+		const size_t rounds = 5;
+		const double oversampling = 2.0 * K;
+		sample_map_t x = data();
+		std::vector<value_t> nearest(sample_count, std::numeric_limits<value_t>::max());
+
+		std::vector<size_t> picked;
+		picked.push_back(generator() % sample_count);
+		sample_matrix_t candidates = x.row(picked[0]);
+		double sum = nearest_distances(candidates, nearest);
+		for (size_t r = 0; r < rounds && sum > 0; ++r) {
+			std::vector<size_t> round;
+			for (size_t i = 0; i < sample_count; ++i) {
+				double weight = sample_weights ? sample_weights[i] : 1;
+				if (uniform() * sum < oversampling * weight * nearest[i]) round.push_back(i);
+			}
+			if (round.empty()) continue;
+			candidates.resize(round.size(), dimension);
+			for (size_t j = 0; j < round.size(); ++j) {
+				candidates.row(j) = x.row(round[j]);
+			}
+			sum = nearest_distances(candidates, nearest);
+			picked.insert(picked.end(), round.begin(), round.end());
+		}
+
+		// weight each candidate with the number of samples that have it as nearest candidate
+		const size_t C = picked.size();
+		candidates.resize(C, dimension);
+		for (size_t j = 0; j < C; ++j) {
+			candidates.row(j) = x.row(picked[j]);
+		}
+		const size_t chunks = chunk_count();
+		std::vector<std::vector<value_t> > chunk_weights(chunks, std::vector<value_t>(C, 0));
+		run(chunks, [this, &x, &candidates, &chunk_weights] (size_t c) {
+			size_t end = std::min((c + 1) * chunk_size, sample_count);
+			for (size_t i = c * chunk_size; i < end; ++i) {
+				sample_matrix_t::Index j;
+				(candidates.rowwise() - x.row(i)).rowwise().squaredNorm().minCoeff(&j);
+				chunk_weights[c][j] += sample_weights ? sample_weights[i] : 1;
+			}
+		});
+		std::vector<value_t> weights(C, 0);
+		double total_weight = 0;
+		for (size_t c = 0; c < chunks; ++c) {
+			for (size_t j = 0; j < C; ++j) weights[j] += chunk_weights[c][j];
+		}
+		for (size_t j = 0; j < C; ++j) total_weight += weights[j];
+
+		// weighted k-means++ on the candidates, if there are fewer candidates than means, the rest stays random
+		std::vector<value_t> nearest_candidate(C, std::numeric_limits<value_t>::max()), probability(C);
+		size_t j = pick(weights, total_weight);
+		for (size_t k = 0; k < std::min(K, C); ++k) {
+			means.row(k) = candidates.row(j);
+			double total = 0;
+			for (size_t i = 0; i < C; ++i) {
+				nearest_candidate[i] = std::min(nearest_candidate[i], (candidates.row(i) - means.row(k)).squaredNorm());
+				probability[i] = weights[i] * nearest_candidate[i];
+				total += probability[i];
+			}
+			if (total <= 0) break;
+			j = pick(probability, total);
+		}
+	}
+
 	void init(int k, int d) {
-		clusters[k].r_data.clear();
-		clusters[k].mean.setRandom(d);
-		clusters[k].mean = (clusters[k].mean.array() + 1) / 2;
+		for (int j = 0; j < d; ++j) {
+			means(k, j) = uniform();
+		}
 	}
 
-	void assign(int i) {
-		ASSERT (clusters.size());
+	/**
+	 * Assign the samples [begin, end) to their nearest mean. Rather than calculating K separate squared norms per
+	 * sample, the distances for the entire tile are obtained at once through the identity:
+	 *
+	 *   |x-c|^2 = |x|^2 - 2 x.c + |c|^2
+	 *
+	 * The x.c term for all samples in the tile and all means is a single (cache-blocked) matrix product. The |x|^2
+	 * term is the same for every mean and hence does not influence which mean is nearest, so it is left out.
+	 *
+	 * In floating point the identity cancels badly if the samples are far from the origin compared to their spread,
+	 * so the samples and means are first centred around the centre of the data (see calculate_centre). The error of
+	 * the product is then bounded by a small multiple of the machine epsilon times |x|^2 + |c|^2. If the nearest and
+	 * second nearest mean are closer together than that bound, the sample is assigned by the exact distances instead,
+	 * so the outcome is the same as with squared_distance for every mean.
+	 *
+	 * The tile is chosen such that the block of distances (block_size x K) stays in cache.
+	 */
+	size_t assign_block(size_t begin, size_t end) {
+		ASSERT (means.rows());
+		ASSERT_LEQ (end, sample_count);
+		const size_t n = end - begin;
+		const size_t K = means.rows();
+		sample_matrix_t x = sample_map_t(sample_data + begin * dimension, n, dimension).rowwise() - centre;
+		sample_matrix_t block_distances(n, K);
+		block_distances.noalias() = x * centred_means.transpose();
+		const value_t tolerance = tie_tolerance();
+		size_t changed = 0;
+		for (size_t i = 0; i < n; ++i) {
+			size_t nearest_k = 0;
+			value_t nearest = std::numeric_limits<value_t>::max(), second = nearest;
+			for (size_t k = 0; k < K; ++k) {
+				value_t dist = mean_norms[k] - 2 * block_distances(i, k);
+				if (dist < nearest) {
+					second = nearest;
+					nearest = dist;
+					nearest_k = k;
+				} else if (dist < second) {
+					second = dist;
+				}
+			}
+			if (second - nearest <= tolerance * (x.row(i).squaredNorm() + max_mean_norm)) {
+				nearest_k = nearest_exact(begin + i);
+			}
+			if (assignments[begin + i] != nearest_k) changed++;
+			assignments[begin + i] = nearest_k;
+		}
+		return changed;
+	}
+
+	/**
+	 * Relative bound on the error of a distance through the matrix product in assign_block. A dot product of D terms
+	 * has an error of at most about D epsilon |x| |c|, the factor 4 covers the norms, the subtraction, and both of the
+	 * distances that are compared.
+	 */
+	inline value_t tie_tolerance() const {
+		return 4 * (dimension + 2) * std::numeric_limits<value_t>::epsilon();
+	}
+
+	/**
+	 * Squared Euclidean distance between sample "i" and mean "k" by subtracting them first, so without cancellation.
+	 * All assignment methods decide with this distance, see assign_block and distance.
+	 */
+	inline value_t squared_distance(size_t i, size_t k) const {
+		return (sample_map_t(sample_data + i * dimension, 1, dimension) - means.row(k)).squaredNorm();
+	}
+
+	/**
+	 * Relative margin on the bounds of the bounded methods, for the rounding errors in the squared distances, their
+	 * square roots, the distances between the means, the drifts, and the updates of the bounds.
+	 */
+	inline value_t bound_margin() const {
+		return tie_tolerance();
+	}
+
+	//! Upper bound on the distance for a squared distance of squared_distance, used by the bounded methods
+	inline value_t upper_bound(value_t squared) const {
+		return std::sqrt(squared) * (1 + bound_margin());
+	}
+
+	//! Lower bound on the distance for a squared distance of squared_distance, used by the bounded methods
+	inline value_t lower_bound(value_t squared) const {
+		return std::sqrt(squared) * (1 - bound_margin());
+	}
+
+	//! The mean nearest to sample "i" by squared_distance, the lowest index on a tie, O(KD)
+	size_t nearest_exact(size_t i) const {
+		size_t nearest_k = 0;
+		value_t nearest = std::numeric_limits<value_t>::max();
+		for (int k = 0; k < means.rows(); ++k) {
+			value_t dist = squared_distance(i, k);
+			if (dist < nearest) {
+				nearest = dist;
+				nearest_k = k;
+			}
+		}
+		return nearest_k;
+	}
+
+	/**
+	 * The centre of the data, the (weighted) average of all samples, which assign_block subtracts from the samples and
+	 * means. The sums are in double, per chunk, and added in chunk order.
+	 */
+	void calculate_centre() {
+		centre.setZero(dimension);
+		if (!sample_count) return;
+		const size_t chunks = chunk_count();
+		std::vector<Eigen::Matrix<double,1,Eigen::Dynamic> > chunk_sums(chunks);
+		std::vector<double> chunk_weights(chunks, 0);
+		run(chunks, [this, &chunk_sums, &chunk_weights] (size_t c) {
+			sample_map_t x = data();
+			size_t end = std::min((c + 1) * chunk_size, sample_count);
+			chunk_sums[c].setZero(dimension);
+			for (size_t i = c * chunk_size; i < end; ++i) {
+				double weight = sample_weights ? sample_weights[i] : 1;
+				chunk_sums[c] += weight * x.row(i).cast<double>();
+				chunk_weights[c] += weight;
+			}
+		});
+		Eigen::Matrix<double,1,Eigen::Dynamic> sum = Eigen::Matrix<double,1,Eigen::Dynamic>::Zero(dimension);
+		double weight = 0;
+		for (size_t c = 0; c < chunks; ++c) {
+			sum += chunk_sums[c];
+			weight += chunk_weights[c];
+		}
+		if (weight > 0) centre = (sum / weight).cast<value_t>();
+	}
+
+	//! Centre the means and calculate their squared norms for assign_block, after every change of the means
+	void update_norms() {
+		if (centre.size() != (int)dimension) centre.setZero(dimension);
+		centred_means = means.rowwise() - centre;
+		mean_norms = centred_means.rowwise().squaredNorm().transpose();
+		max_mean_norm = means.rows() ? mean_norms.maxCoeff() : 0;
+	}
+
+	/**
+	 * Calculate the distances between all means and, per mean, half the distance to its nearest other mean. A sample
+	 * that is closer to its mean than this half distance can not be closer to any other mean.
+	 */
+	void calculate_mean_distances() {
+		const size_t K = means.rows();
+		mean_distances.resize(K, K);
+		half_nearest_mean.resize(K);
+		const value_t margin = bound_margin();
+		for (size_t k = 0; k < K; ++k) {
+			mean_distances(k, k) = 0;
+			for (size_t j = k + 1; j < K; ++j) {
+				mean_distances(k, j) = mean_distances(j, k) = (means.row(k) - means.row(j)).norm() * (1 - margin);
+			}
+		}
+		for (size_t k = 0; k < K; ++k) {
+			value_t nearest = std::numeric_limits<value_t>::max();
+			for (size_t j = 0; j < K; ++j) {
+				if (j != k) nearest = std::min(nearest, mean_distances(k, j));
+			}
+			half_nearest_mean[k] = nearest / 2;
+		}
+	}
+
+	/**
+	 * Calculate all distances for the samples [begin, end) and initialize the bounds. This is done on the first
+	 * iteration of the bounded methods.
+	 */
+	size_t assign_exact(size_t begin, size_t end) {
+		const size_t K = means.rows();
+		size_t changed = 0;
+		for (size_t i = begin; i < end; ++i) {
+			value_t nearest = std::numeric_limits<value_t>::max();
+			value_t second = std::numeric_limits<value_t>::max();
+			size_t nearest_k = 0;
+			for (size_t k = 0; k < K; ++k) {
+				value_t dist = squared_distance(i, k);
+				if (assign_method == A_ELKAN) lower_bounds[i * K + k] = lower_bound(dist);
+				if (dist < nearest) {
+					second = nearest;
+					nearest = dist;
+					nearest_k = k;
+				} else if (dist < second) {
+					second = dist;
+				}
+			}
+			if (assignments[i] != nearest_k) changed++;
+			assignments[i] = nearest_k;
+			upper_bounds[i] = upper_bound(nearest);
+			if (assign_method == A_HAMERLY) lower_bounds[i] = lower_bound(second);
+		}
+		return changed;
+	}
+
+	/**
+	 * Hamerly's method. Per sample there is an upper bound on the distance to its assigned mean and a lower bound on
+	 * the distance to every other mean. Only if the bounds overlap, the distances are recalculated.
+	 */
+	size_t assign_hamerly(size_t begin, size_t end) {
+		const size_t K = means.rows();
+		size_t changed = 0;
+		for (size_t i = begin; i < end; ++i) {
+			size_t a = assignments[i];
+			value_t bound = std::max(half_nearest_mean[a], lower_bounds[i]);
+			if (upper_bounds[i] < bound) continue;
+			// tighten the upper bound, and check again
+			value_t nearest = squared_distance(i, a);
+			upper_bounds[i] = upper_bound(nearest);
+			if (upper_bounds[i] < bound) continue;
+
+			value_t second = std::numeric_limits<value_t>::max();
+			size_t nearest_k = a;
+			for (size_t k = 0; k < K; ++k) {
+				if (k == a) continue;
+				value_t dist = squared_distance(i, k);
+				if (dist < nearest || (dist == nearest && k < nearest_k)) {
+					second = nearest;
+					nearest = dist;
+					nearest_k = k;
+				} else if (dist < second) {
+					second = dist;
+				}
+			}
+			if (a != nearest_k) changed++;
+			assignments[i] = nearest_k;
+			upper_bounds[i] = upper_bound(nearest);
+			lower_bounds[i] = lower_bound(second);
+		}
+		return changed;
+	}
+
+	/**
+	 * Elkan's method. Per sample there is an upper bound on the distance to its assigned mean and a lower bound on
+	 * the distance to each of the means. A mean "k" is only considered if its lower bound and half the distance
+	 * between the assigned mean and "k" are both below the upper bound.
+	 */
+	size_t assign_elkan(size_t begin, size_t end) {
+		const size_t K = means.rows();
+		size_t changed = 0;
+		for (size_t i = begin; i < end; ++i) {
+			size_t a = assignments[i];
+			if (upper_bounds[i] < half_nearest_mean[a]) continue;
+			value_t *lower = &lower_bounds[i * K];
+			// squared distance to the assigned mean, once the upper bound has been tightened
+			value_t nearest = 0;
+			bool tight = false;
+			for (size_t k = 0; k < K; ++k) {
+				if (k == a) continue;
+				if (upper_bounds[i] < lower[k]) continue;
+				if (upper_bounds[i] < mean_distances(a, k) / 2) continue;
+				if (!tight) {
+					nearest = squared_distance(i, a);
+					upper_bounds[i] = upper_bound(nearest);
+					lower[a] = lower_bound(nearest);
+					tight = true;
+					if (upper_bounds[i] < lower[k] || upper_bounds[i] < mean_distances(a, k) / 2) continue;
+				}
+				value_t dist = squared_distance(i, k);
+				lower[k] = lower_bound(dist);
+				if (dist < nearest || (dist == nearest && k < a)) {
+					a = k;
+					nearest = dist;
+					upper_bounds[i] = upper_bound(dist);
+				}
+			}
+			if (assignments[i] != a) changed++;
+			assignments[i] = a;
+		}
+		return changed;
+	}
 
-//#define CALCULATE_MIN_IN_LOOP
+	/**
+	 * After the means moved by "drifts", the upper bounds grow with the drift of the assigned mean and the lower
+	 * bounds shrink with the drift of the corresponding mean (Elkan), or the largest drift of any other mean (Hamerly).
+	 */
+	void update_bounds(size_t begin, size_t end) {
+		const size_t K = means.rows();
+		const value_t margin = bound_margin();
+		if (assign_method == A_ELKAN) {
+			for (size_t i = begin; i < end; ++i) {
+				upper_bounds[i] = (upper_bounds[i] + drifts[assignments[i]]) * (1 + margin);
+				value_t *lower = &lower_bounds[i * K];
+				for (size_t k = 0; k < K; ++k) {
+					lower[k] = std::max(value_t(0), (lower[k] - drifts[k]) * (1 - margin));
+				}
+			}
+		} else {
+			// largest and second largest drift, the latter is used for samples assigned to the fastest mean
+			size_t fastest = 0;
+			value_t largest = 0, second = 0;
+			for (size_t k = 0; k < K; ++k) {
+				if (drifts[k] > largest) {
+					second = largest;
+					largest = drifts[k];
+					fastest = k;
+				} else if (drifts[k] > second) {
+					second = drifts[k];
+				}
+			}
+			for (size_t i = begin; i < end; ++i) {
+				upper_bounds[i] = (upper_bounds[i] + drifts[assignments[i]]) * (1 + margin);
+				lower_bounds[i] = (lower_bounds[i] - ((assignments[i] == fastest) ? second : largest)) * (1 - margin);
+			}
+		}
+	}
 
-#ifdef CALCULATE_MIN_IN_LOOP
-		struct NearestCluster {
-			value_t dist;
-			size_t k;
-			void swap(NearestCluster &other) {
-				NearestCluster temp;
-				temp.dist = dist; temp.k = k;
-				dist = other.dist; k = other.k;
-				other.dist = temp.dist; other.k = temp.k;
+	/**
+	 * Sum the samples [begin, end) per cluster they are assigned to, multiplied by their weights if there are any.
+	 */
+	void accumulate(Partial & partial, size_t begin, size_t end) {
+		partial.sums.setZero(means.rows(), dimension);
+		partial.counts.assign(means.rows(), 0);
+		sample_map_t x = data();
+		if (sample_weights) {
+			for (size_t i = begin; i < end; ++i) {
+				partial.sums.row(assignments[i]) += sample_weights[i] * x.row(i);
+				partial.counts[assignments[i]] += sample_weights[i];
 			}
-		} nearest, next;
-		int k = 0;
-		nearest.dist = (data_set[i] - clusters[k].mean).squaredNorm();
-		nearest.k = k;
-		for (k = 1; k < clusters.size(); ++k) {
-			next.dist = (data_set[i] - clusters[k].mean).squaredNorm();
-			next.k = k;
-			if (next.dist < nearest.dist) next.swap(nearest);
+			return;
 		}
-		ASSERT ((nearest.k >= 0) && (nearest.k < clusters.size()));
-		clusters[nearest.k].r_data.push_back(i);
-#else // is shorter, but actually slower
-		for (int k = 0; k < clusters.size(); ++k) {
-			distances[k] = (data_set[i] - clusters[k].mean).squaredNorm();
+		for (size_t i = begin; i < end; ++i) {
+			partial.sums.row(assignments[i]) += x.row(i);
+			partial.counts[assignments[i]]++;
 		}
-		int nearest_k = std::min_element(distances.begin(), distances.end()) - distances.begin();
-		ASSERT ((nearest_k >= 0) && (nearest_k < clusters.size()));
-		clusters[nearest_k].r_data.push_back(i);
-#endif
 	}
 
 	/**
-	 * Calculate centroid of observations in cluster "k". Currently we keep adding till we summed all items belonging
-	 * to this cluster. The division over the number of clusters is at the end.
+	 * The number of chunks the samples are split in. It depends on the number of samples only, not on the threads.
 	 */
-	void update(int k) {
-		ASSERT ((k >= 0) && (k < clusters.size()));
-		if (clusters[k].r_data.size() == 0) return;
-		clusters[k].mean.setZero(); // set to 0 for all values
-		for (int i = 0; i < clusters[k].r_data.size(); ++i) {
-			clusters[k].mean += data_set[clusters[k].r_data[i]];
+	size_t chunk_count() {
+		chunk_size = std::max((size_t)min_chunk_size, (sample_count / max_chunks + block_size) / block_size * block_size);
+		return (sample_count + chunk_size - 1) / chunk_size;
+	}
+
+	//! Run the job for all chunks, on the pool if there is one
+	void run(size_t chunks, const std::function<void(size_t)> & job) {
+		if (pool) {
+			pool->run(chunks, job);
+		} else {
+			for (size_t c = 0; c < chunks; ++c) job(c);
 		}
-		clusters[k].mean /= clusters[k].r_data.size();
 	}
 
-	// delete all data references in clusters
-	void clear(int k) {
-		clusters[k].r_data.clear();
+	//! Count the current assignments in the contingency table, O(N)
+	void build_table() {
+		table.reset(means.rows());
+		for (size_t i = 0; i < sample_count; ++i) {
+			table.add(assignments[i], labels[i].ground_truth);
+		}
+		tracked = assignments;
+	}
+
+	//! Collect the samples in [begin, end) that moved to another cluster since the table was last updated
+	void collect_moves(Partial & partial, size_t begin, size_t end) {
+		partial.moved.clear();
+		for (size_t i = begin; i < end; ++i) {
+			if (assignments[i] != tracked[i]) partial.moved.push_back(i);
+		}
+	}
+
+	//! Move the collected samples in the contingency table, in chunk order
+	void update_table() {
+		for (size_t c = 0; c < partials.size(); ++c) {
+			for (size_t m = 0; m < partials[c].moved.size(); ++m) {
+				size_t i = partials[c].moved[m];
+				table.move(labels[i].ground_truth, tracked[i], assignments[i]);
+				tracked[i] = assignments[i];
+			}
+		}
+	}
+
+	/**
+	 * Calculate the centroids of the observations in each cluster. The partial sums of the chunks are added in chunk
+	 * order. The division over the number of items is at the end. A cluster without items keeps its mean.
+	 */
+	void update() {
+		sums.setZero(means.rows(), dimension);
+		counts.assign(means.rows(), 0);
+		changes = 0;
+		for (size_t c = 0; c < partials.size(); ++c) {
+			changes += partials[c].changes;
+		}
+		// the first assignments after init are all new
+		if (!ticked) changes = sample_count;
+		ticked = true;
+		for (size_t c = 0; c < partials.size(); ++c) {
+			sums += partials[c].sums;
+			for (size_t k = 0; k < counts.size(); ++k) {
+				counts[k] += partials[c].counts[k];
+			}
+		}
+		drifts.assign(means.rows(), 0);
+		for (int k = 0; k < means.rows(); ++k) {
+			if (counts[k] == 0) continue;
+			vector_t mean = sums.row(k) / value_t(counts[k]);
+			drifts[k] = (mean - means.row(k)).norm();
+			means.row(k) = mean;
+		}
+		max_drift = *std::max_element(drifts.begin(), drifts.end());
+		update_norms();
 	}
+
 private:
-	std::vector<Cluster> clusters;
+	//! Number of samples that are assigned in one go, see assign_block
+	static const size_t block_size = 256;
+
+	//! Bounds on the size and number of the chunks the samples are split in for (parallel) processing
+	static const size_t min_chunk_size = 16 * block_size;
+	static const size_t max_chunks = 256;
+
+	//! Dimension of the samples
+	size_t dimension;
+
+	//! Number of samples in the data set
+	size_t sample_count;
+
+	//! The data set, stored contiguously, row-major, one sample per "dimension" values
+	std::vector<value_t> samples;
+
+	//! The values of the samples, either in "samples" or given by setData (not owned)
+	const value_t *sample_data;
+
+	//! Per sample its weight, NULL if all samples count once (not owned, see setData)
+	const value_t *sample_weights;
+
+	//! Random generator for the seeding, per instance (see setSeed)
+	std::mt19937 generator;
+
+	//! The cluster means, one per row (K x D)
+	sample_matrix_t means;
+
+	//! The centre of the data, and the means relative to it (see assign_block)
+	vector_t centre;
+	sample_matrix_t centred_means;
 
-	std::vector<vector_t> data_set;
+	//! The squared norms of the centred means, |c|^2, and the largest of them
+	vector_t mean_norms;
+	value_t max_mean_norm;
 
-	std::vector<value_t> distances;
+	//! Per sample the index of the cluster it is assigned to
+	std::vector<size_t> assignments;
+
+	//! Per chunk the sum and number of samples per cluster, and the size of a chunk
+	std::vector<Partial> partials;
+	size_t chunk_size;
+
+	//! Scratch space for the update step, sum and number (total weight) of samples per cluster
+	sample_matrix_t sums;
+	std::vector<double> counts;
+
+	//! Pool for parallel processing, not owned
+	ThreadPool *pool;
 
 	std::vector<Pair> labels;
+
+	//! Clusters versus labels, and per sample the assignment as counted in the table
+	ContingencyTable table;
+	std::vector<size_t> tracked;
+
+	//! Keep the table up to date every tick
+	bool tracking;
+
+	//! The method used for the assignment step
+	AssignMethod assign_method;
+
+	//! The method used to choose the initial means
+	SeedMethod seed_method;
+
+	//! Number of changed assignments and the largest distance a mean moved in the last tick
+	size_t changes;
+	value_t max_drift;
+
+	//! False till the first tick after init
+	bool ticked;
+
+	//! Convergence criteria, see converged()
+	double max_changes_fraction;
+	value_t max_shift;
+
+	//! The bounds below are only valid after one iteration with a bounded method
+	bool bounds_valid;
+
+	//! Per sample an upper bound on the distance to its assigned mean
+	std::vector<value_t> upper_bounds;
+
+	//! Per sample a lower bound on the distance to any other mean (Hamerly), or to each mean (Elkan, N x K)
+	std::vector<value_t> lower_bounds;
+
+	//! Distances between the means (K x K), and half the distance of each mean to its nearest other mean
+	matrix_t mean_distances;
+	std::vector<value_t> half_nearest_mean;
+
+	//! The distance each mean moved in the last update step
+	std::vector<value_t> drifts;
 };
 
 
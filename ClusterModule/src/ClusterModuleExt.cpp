@@ -27,13 +27,51 @@
 
 #include <kMeans.h>
 #include <ExpectationMaximization.h>
+#include <ModelSelection.h>
+#include <CFTree.hpp>
+#include <ContingencyTable.hpp>
 
 using namespace rur;
 
 enum DataSet { D_ABALONE, D_GAUSSIAN, D_IRIS, D_LINES, NUMBER_OF_DATASETS };
 
+ClusterModuleExt::ClusterModuleExt() {
+	stream_kmeans = NULL;
+	stream_em = NULL;
+	sample_dimension = 0;
+}
+
+ClusterModuleExt::~ClusterModuleExt() {
+	if (stream_kmeans) delete stream_kmeans;
+	if (stream_em) delete stream_em;
+}
+
 void ClusterModuleExt::Init(std::string& name) {
-	std::ifstream f;
+	index = 0;
+
+	stop = false;
+
+	predefined_clusters = 2;
+	max_clusters = 32;
+	summary_memory = 64 << 20;
+	snapshot_file = "cluster.model";
+
+	//cluster_method = C_EM_GMM;
+	cluster_method = C_KMEANS;
+	// the streaming methods are selected on the Method port
+	//cluster_method = C_KMEANS_STREAM;
+	//cluster_method = C_EM_STREAM;
+
+	// a model of a previous run answers the Test port right away, the data set is only loaded to train again
+	if (snapshot.load(snapshot_file)) {
+		std::cout << "Loaded model snapshot from " << snapshot_file << std::endl;
+		snapshot.print();
+	} else if (!streaming()) {
+		LoadDataSet();
+	}
+}
+
+void ClusterModuleExt::LoadDataSet() {
 	DataSet dataset;
 	dataset = D_ABALONE;
 	dataset = D_GAUSSIAN;
@@ -71,96 +109,384 @@ void ClusterModuleExt::Init(std::string& name) {
 	break;
 	}
 
-	f.open(file.c_str());
-	if (f.is_open()) {
-		f >> d;
-	} else {
+	if (!d.load(file, &pool)) {
 		std::cerr << "File " << file << " does not exist " << std::endl;
+	} else if (d.mapped()) {
+		std::cout << "Loaded " << d.size() << " samples from cache" << std::endl;
 	}
 
 	//	d.test();
+}
 
-	index = 0;
+/**
+ * Copy the samples of the data set "d" without their labels (the last value of each row) contiguously, one sample per
+ * row, in the precision of the clustering method, and the labels. This is the only copy of the data the batch methods
+ * make, all fits (also those of model selection) use it. Returns the dimension of the samples.
+ */
+template<typename T>
+static size_t CopySamples(data<ClusterModuleExt::value_t> & d, std::vector<T> & samples, std::vector<size_t> & labels) {
+	size_t S = d.size();
+	size_t D = d.length(0) - 1;
+	samples.reserve(S * D);
+	labels.reserve(S);
+	for (size_t s = 0; s < S; ++s) {
+		samples.insert(samples.end(), d.row(s), d.row(s) + D);
+		labels.push_back(d.row(s)[D]);
+	}
+	return D;
+}
 
-	stop = false;
+/**
+ * For a data set of which the samples take more than "summary_memory" bytes, the batch methods do not copy the samples
+ * (nor keep an N x K matrix of probabilities). The samples are summarized in one pass by a CF-tree (BIRCH) within the
+ * same budget, and k-means or EM runs on the centroids of the leaves, weighted by the number of samples they summarize,
+ * as does the selection of the number of clusters. The result is evaluated in a second pass over the data set, in which
+ * each sample is assigned to its nearest mean or most probable component and counted in a contingency table. The data
+ * set itself is parsed into a cache file a few chunks at a time and memory-mapped (see data::load), also the first
+ * time, so the memory used does not depend on the number of samples.
+ */
+void ClusterModuleExt::ClusterSummaries() {
+	size_t S = d.size();
+	size_t D = d.length(0) - 1;
+	CFTree tree(D, summary_memory);
+	for (size_t s = 0; s < S; ++s) {
+		tree.insert(d.row(s));
+	}
+	tree.print();
+
+	if (cluster_method == C_EM_GMM) {
+#if defined(LINE_DETECTION) || defined(TEST_START_FROM_GROUND_TRUTH)
+		std::cerr << "EM is compiled for the line model, which does not run on summaries" << std::endl;
+		return;
+#endif
+		typedef ExpectationMaximization::value_t em_value_t;
+		std::vector<em_value_t> centroids, weights;
+		tree.summaries(centroids, weights);
+		int T = 3; // time span
+		ExpectationMaximization *expmax;
+		if (!predefined_clusters) {
+			// the best fit on the summaries is kept as it is, rather than fitted again
+			ModelSelection selection(centroids.data(), weights.size(), D, weights.data());
+			selection.setThreadPool(&pool);
+			size_t K = selection.sweepEM(1, max_clusters, T);
+			selection.print();
+			expmax = selection.releaseEM();
+			std::cout << "Selected " << K << " clusters" << std::endl;
+			expmax->setThreadPool(&pool);
+		} else {
+			expmax = new ExpectationMaximization(predefined_clusters, D);
+			expmax->setThreadPool(&pool);
+			expmax->setData(centroids.data(), weights.size(), weights.data());
+			expmax->init();
+			for (int t = 0; t < T; ++t) {
+				expmax->tick();
+				std::cout << "Step " << t << ", log-likelihood is " << expmax->log_likelihood() << std::endl;
+			}
+		}
+		expmax->print();
+
+		ContingencyTable table(expmax->clusterCount());
+		std::vector<em_value_t> x(D);
+		for (size_t s = 0; s < S; ++s) {
+			x.assign(d.row(s), d.row(s) + D);
+			table.add(expmax->classify(x.data()), d.row(s)[D]);
+		}
+		table.print();
+		expmax->snapshot(snapshot);
+		delete expmax;
+	} else {
+		std::vector<value_t> centroids, weights;
+		tree.summaries(centroids, weights);
+		KMeans *kmeans;
+		if (!predefined_clusters) {
+			// the best fit on the summaries is kept as it is, rather than fitted again
+			ModelSelection selection(centroids.data(), weights.size(), D, weights.data());
+			selection.setThreadPool(&pool);
+			selection.selectKMeans(1, max_clusters);
+			selection.print();
+			kmeans = selection.releaseKMeans();
+			std::cout << "Selected " << kmeans->clusterMeans().rows() << " clusters" << std::endl;
+		} else {
+			kmeans = new KMeans(predefined_clusters, D);
+			kmeans->setAssignMethod(KMeans::A_HAMERLY);
+			kmeans->setThreadPool(&pool);
+			kmeans->setData(centroids.data(), weights.size(), weights.data());
+			kmeans->init();
 
-	cluster_method = C_EM_GMM;
-	//cluster_method = C_KMEANS;
+			int T = 400; // maximum time span, stops earlier when the assignments do not change anymore
+			int t;
+			for (t = 0; t < T; ++t) {
+				kmeans->tick();
+				if (kmeans->converged()) break;
+			}
+			std::cout << "Stopped after " << std::min(t + 1, T) << " iterations" << std::endl;
+		}
+		kmeans->print();
+
+		ContingencyTable table(kmeans->clusterMeans().rows());
+		for (size_t s = 0; s < S; ++s) {
+			table.add(kmeans->classify(d.row(s)), d.row(s)[D]);
+		}
+		table.print();
+		kmeans->snapshot(snapshot);
+		delete kmeans;
+	}
+	WriteSnapshot();
+}
+
+/**
+ * Write the model to the snapshot file: the current model of the streaming methods, or the model that has been
+ * trained last by the batch methods. See ModelSnapshot for the format.
+ */
+void ClusterModuleExt::WriteSnapshot() {
+	if (cluster_method == C_EM_STREAM && stream_em && stream_em->initialized()) {
+		stream_em->snapshot(snapshot);
+	} else if (cluster_method == C_KMEANS_STREAM && stream_kmeans && stream_kmeans->initialized()) {
+		stream_kmeans->snapshot(snapshot);
+	}
+	if (!snapshot.loaded()) {
+		std::cerr << "There is no trained model to write a snapshot of yet" << std::endl;
+		return;
+	}
+	if (snapshot.write(snapshot_file)) {
+		std::cout << "Wrote model snapshot to " << snapshot_file << std::endl;
+	}
+}
+
+/**
+ * Samples on the Test port are answered on the Class port by the model snapshot, without any training.
+ */
+void ClusterModuleExt::TickSnapshot() {
+	long_seq *test = readTest();
+	if (test->empty()) return;
+	if (test->size() != snapshot.dimension()) {
+		std::cerr << "Test sample should have the same size as the model snapshot (" << snapshot.dimension() << ")!"
+				<< std::endl;
+	} else {
+		sample.assign(test->begin(), test->end());
+		writeClass(snapshot.classify(sample.data()));
+	}
+	test->clear();
+}
+
+/**
+ * Samples on the Train port are used to update the model in batches, the means (mini-batch k-means) or the mixture
+ * (online EM). Samples on the Test port (of the same length) are answered on the Class port with the index of the
+ * nearest mean or the most probable component. Only one batch is kept in memory.
+ */
+void ClusterModuleExt::TickStream() {
+	if (!predefined_clusters) {
+		std::cerr << "The streaming methods need a number of clusters on the ClusterCount port" << std::endl;
+		readTrain()->clear();
+		readTest()->clear();
+		return;
+	}
+	long_seq *train = readTrain();
+	if (!train->empty()) {
+		if (!sample_dimension) {
+			sample_dimension = train->size();
+		}
+		if (train->size() != sample_dimension) {
+			std::cerr << "New sample arrived with deviating size!" << std::endl;
+		} else {
+			int batch_size = std::max(256, predefined_clusters);
+			sample.assign(train->begin(), train->end());
+			if (cluster_method == C_EM_STREAM) {
+				if (!stream_em) {
+					stream_em = new OnlineExpectationMaximization(predefined_clusters, sample_dimension, batch_size);
+				}
+				if (stream_em->addSample(sample) && !(stream_em->batchCount() % 100)) {
+					stream_em->print();
+				}
+			} else {
+				if (!stream_kmeans) {
+					stream_kmeans = new MiniBatchKMeans(predefined_clusters, sample_dimension, batch_size);
+				}
+				if (stream_kmeans->addSample(sample) && !(stream_kmeans->batchCount() % 100)) {
+					stream_kmeans->print();
+				}
+			}
+		}
+		train->clear();
+	}
+
+	bool ready = (cluster_method == C_EM_STREAM) ? (stream_em && stream_em->initialized()) :
+			(stream_kmeans && stream_kmeans->initialized());
+	// till the model is trained well enough, a snapshot of a previous run answers
+	if (!ready && snapshot.loaded()) {
+		TickSnapshot();
+		return;
+	}
+	long_seq *test = readTest();
+	if (!test->empty()) {
+		if (!ready) {
+			std::cerr << "Not enough training samples yet to classify a test sample" << std::endl;
+		} else if (test->size() != sample_dimension) {
+			std::cerr << "Test sample should have the same size as the training samples!" << std::endl;
+		} else {
+			sample.assign(test->begin(), test->end());
+			if (cluster_method == C_EM_STREAM) {
+				writeClass(stream_em->classify(sample));
+			} else {
+				writeClass(stream_kmeans->classify(sample));
+			}
+		}
+		test->clear();
+	}
 }
 
 //! Replace with your own functionality
 void ClusterModuleExt::Tick() {
+	int *method = readMethod();
+	if (method && (*method >= 0) && (*method < NUMBER_OF_CLUSTER_METHODS)) {
+		cluster_method = (ClusterMethod)*method;
+		// train again rather than answer with the snapshot
+		snapshot.clear();
+	}
+
+	int *cluster_count = readClusterCount();
+	// a count of 0 selects the number of clusters automatically
+	if (cluster_count && (*cluster_count >= 0) && (*cluster_count != predefined_clusters)) {
+		predefined_clusters = *cluster_count;
+		// start over with the new number of clusters
+		if (stream_kmeans) delete stream_kmeans;
+		stream_kmeans = NULL;
+		if (stream_em) delete stream_em;
+		stream_em = NULL;
+		snapshot.clear();
+	}
+
+	int *write = readSnapshot();
+	if (write && *write) {
+		WriteSnapshot();
+	}
+
+	if (!streaming()) {
+		if (snapshot.loaded()) {
+			TickSnapshot();
+			return;
+		}
+		if (!d.size()) {
+			LoadDataSet();
+		}
+	}
 
 	switch(cluster_method) {
+	case C_KMEANS_STREAM: case C_EM_STREAM: {
+		TickStream();
+		return;
+	}
+	break;
 	default: case C_KMEANS: {
-		std::vector<value_t> & item = d.pop();
-		int D = item.size() - 1; // dimensionality of data samples (length of vector minus field for label)
+		if (d.size() && d.size() * (d.length(0) - 1) * sizeof(value_t) > summary_memory) {
+			ClusterSummaries();
+			break;
+		}
+		// the samples without labels, used by the fits of model selection and by the model that is kept
+		std::vector<value_t> samples;
+		std::vector<size_t> labels;
+		size_t D = CopySamples(d, samples, labels);
+		size_t S = labels.size();
 		std::cout << "Dimensionality is " << D << std::endl;
 
-		int K = predefined_clusters;
-		KMeans kmeans(K, D);
+		KMeans *kmeans;
+		if (!predefined_clusters) {
+			// the best fit is kept as it is, rather than fitted again
+			ModelSelection selection(samples.data(), S, D);
+			selection.setThreadPool(&pool);
+			selection.selectKMeans(1, max_clusters);
+			selection.print();
+			kmeans = selection.releaseKMeans();
+			std::cout << "Selected " << kmeans->clusterMeans().rows() << " clusters" << std::endl;
+		} else {
+			kmeans = new KMeans(predefined_clusters, D);
+			kmeans->setAssignMethod(KMeans::A_HAMERLY);
+			kmeans->setThreadPool(&pool);
 
-//		kmeans.test();
-//		stop = true;
-//		return;
+//			kmeans->test();
+//			stop = true;
+//			return;
 
-		int S = d.size(); // # samples
-		std::cout << "Load all " << S << " samples" << std::endl;
-		for (int s = 0; s < S; ++s) {
-			kmeans.addSample(item, item[D], D);
-			item = d.pop();
-		}
+			std::cout << "Use all " << S << " samples" << std::endl;
+			kmeans->setData(samples.data(), S);
 
-		kmeans.init();
+			// k-means|| needs a few passes over the data instead of K
+			kmeans->setSeedMethod(S > 100000 ? KMeans::S_KMEANS_PARALLEL : KMeans::S_KMEANS_PLUS_PLUS);
+			kmeans->init();
 
-		int T = 400; // time span
-		std::cout << "Wait, it will take " << T/10 << " dots" << std::endl;
-		for (int t = 0; t < T; ++t) {
-			if (!(t%10)) std::cout << '.'; flush(std::cout);
-			kmeans.tick();
+			int T = 400; // maximum time span, stops earlier when the assignments do not change anymore
+			std::cout << "Wait, it will take at most " << T/10 << " dots" << std::endl;
+			int t;
+			for (t = 0; t < T; ++t) {
+				if (!(t%10)) std::cout << '.'; flush(std::cout);
+				kmeans->tick();
+				if (kmeans->converged()) break;
+			}
+			std::cout << std::endl;
+			std::cout << "Stopped after " << std::min(t + 1, T) << " iterations" << std::endl;
 		}
-		std::cout << std::endl;
 
-		kmeans.print();
-		kmeans.evaluate();
+		kmeans->setLabels(labels);
+		kmeans->print();
+		kmeans->evaluate();
+		kmeans->snapshot(snapshot);
+		delete kmeans;
+		WriteSnapshot();
 	}
 	break;
 	case C_EM_GMM: {
-		std::vector<value_t> & item = d.pop();
-		int D = item.size() - 1; // dimensionality of data samples (length of vector minus field for label)
-		std::cout << "Dimensionality is " << D << std::endl;
-		std::cout << "Item is ";
-		for (int i = 0; i < item.size(); ++i)
-			std::cout << item[i] << ' ';
-		std::cout << std::endl;
-
-		int K = predefined_clusters;
-		ExpectationMaximization expmax(K, D);
-
-		int S = d.size(); // # samples
-		std::cout << "Load all " << S << " samples" << std::endl;
-		for (int s = 0; s < S; ++s) {
-			expmax.addSample(item, item[D], D);
-			item = d.pop();
+		if (d.size() && d.size() * (d.length(0) - 1) * sizeof(value_t) > summary_memory) {
+			ClusterSummaries();
+			break;
 		}
-
-		expmax.init();
+		// the samples without labels in the precision of EM, used by the fits of model selection and by the model
+		std::vector<ExpectationMaximization::value_t> samples;
+		std::vector<size_t> labels;
+		size_t D = CopySamples(d, samples, labels);
+		size_t S = labels.size();
+		std::cout << "Dimensionality is " << D << std::endl;
 
 		int T = 3; // time span
-		std::cout << "We will run for " << T << " time steps (progress shown by dots)" << std::endl;
-		for (int t = 0; t < T; ++t) {
-			expmax.tick();
-			//			if (!(t%10)) {
-			//				std::cout << std::endl;
-			//				expmax.evaluate();
-			//			}
-			//std::cout << '.'; flush(std::cout);
-		}
-		std::cout << std::endl;
+		ExpectationMaximization *expmax;
+		if (!predefined_clusters) {
+			// the best fit is kept as it is, rather than fitted again
+			ModelSelection selection(samples.data(), S, D);
+			selection.setThreadPool(&pool);
+			size_t K = selection.sweepEM(1, max_clusters, T);
+			if (!K) {
+				std::cerr << "Set the number of clusters on the ClusterCount port" << std::endl;
+				break;
+			}
+			selection.print();
+			expmax = selection.releaseEM();
+			std::cout << "Selected " << K << " clusters" << std::endl;
+			expmax->setThreadPool(&pool);
+			expmax->setLabels(labels);
+		} else {
+			expmax = new ExpectationMaximization(predefined_clusters, D);
+			expmax->setThreadPool(&pool);
+
+			std::cout << "Use all " << S << " samples" << std::endl;
+			expmax->setData(samples.data(), S);
+			expmax->setLabels(labels);
 
-		expmax.evaluate();
-		expmax.print();
+			expmax->init();
+			expmax->setTracking(true);
+
+			std::cout << "We will run for " << T << " time steps" << std::endl;
+			for (int t = 0; t < T; ++t) {
+				expmax->tick();
+				std::cout << "Step " << t << ", log-likelihood is " << expmax->log_likelihood() <<
+						", adjusted Rand index is " << expmax->quality().adjustedRandIndex() << std::endl;
+			}
+			std::cout << std::endl;
+		}
 
+		expmax->evaluate();
+		expmax->print();
+		expmax->snapshot(snapshot);
+		delete expmax;
+		WriteSnapshot();
 	}
 	break;
 	}
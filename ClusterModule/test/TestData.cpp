@@ -0,0 +1,85 @@
+/**
+ * @brief TestData.cpp
+ * @file TestData.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2013 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    Clustering
+ */
+
+
+#include <data.hpp>
+#include <fstream>
+#include <sstream>
+#include "gtest/gtest.h"
+
+namespace {
+
+/**
+ * A data file of more than a few chunks is parsed into the cache and then mapped, the next time the cache is mapped
+ * directly. Both give the same vectors as parsing the file from a stream.
+ */
+TEST(DataTest, CacheRoundTrip) {
+	std::string file = testing::TempDir() + "TestData.data";
+	remove((file + ".cache").c_str());
+	std::ostringstream text;
+	const size_t lines = 200000;
+	for (size_t i = 0; i < lines; ++i) {
+		// rows of different lengths, with comma and whitespace separators, and an empty line now and then
+		text << i << ", " << i * 0.25 << '\t' << -double(i) << "e-3";
+		if (i % 3 == 0) text << ",7";
+		text << (i % 1000 == 999 ? "\n\n" : "\n");
+	}
+	std::ofstream(file.c_str()) << text.str();
+
+	data<float> expected;
+	std::istringstream stream(text.str());
+	stream >> expected;
+	ASSERT_EQ(lines, expected.size());
+	EXPECT_FALSE(expected.mapped());
+
+	ThreadPool pool(4);
+	for (int run = 0; run < 2; ++run) {
+		data<float> d;
+		ASSERT_TRUE(d.load(file, &pool)) << "run " << run;
+		EXPECT_TRUE(d.mapped());
+		ASSERT_EQ(lines, d.size());
+		for (size_t i = 0; i < lines; ++i) {
+			ASSERT_EQ(expected.length(i), d.length(i)) << "row " << i;
+			for (size_t j = 0; j < d.length(i); ++j) {
+				ASSERT_EQ(expected.row(i)[j], d.row(i)[j]) << "row " << i;
+			}
+		}
+	}
+	remove(file.c_str());
+	remove((file + ".cache").c_str());
+}
+
+//! An empty file gives no vectors
+TEST(DataTest, EmptyFile) {
+	std::string file = testing::TempDir() + "TestDataEmpty.data";
+	std::ofstream(file.c_str()).close();
+	for (int run = 0; run < 2; ++run) {
+		data<float> d;
+		ASSERT_TRUE(d.load(file));
+		EXPECT_EQ(0u, d.size());
+	}
+	remove(file.c_str());
+	remove((file + ".cache").c_str());
+}
+
+}
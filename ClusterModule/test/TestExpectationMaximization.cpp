@@ -0,0 +1,87 @@
+/**
+ * @brief TestExpectationMaximization.cpp
+ * @file TestExpectationMaximization.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2013 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    Clustering
+ */
+
+
+#include <ExpectationMaximization.h>
+#include <random>
+#include "gtest/gtest.h"
+
+namespace {
+
+/**
+ * With one component the M-step estimates the mean and the covariance matrix of all samples, whatever the initial
+ * values are. A full covariance matrix is the sample covariance matrix, a diagonal one its diagonal, and a spherical
+ * one the average of its diagonal. The diagonal and spherical matrices come from the O(d) statistics in the M-step,
+ * the full one from the scatter matrix, so this checks both against a direct calculation.
+ */
+TEST(ExpectationMaximizationTest, CovarianceTypes) {
+	const int N = 5000, D = 4;
+	std::mt19937 generator(1);
+	std::normal_distribution<float> normal(0, 1);
+	std::vector<std::vector<float> > rows(N, std::vector<float>(D));
+	for (int i = 0; i < N; ++i) {
+		// correlated dimensions with different variances, away from the origin
+		float z = normal(generator);
+		for (int d = 0; d < D; ++d) rows[i][d] = 10 * d + (d + 1) * normal(generator) + z;
+	}
+
+	Eigen::VectorXd mean = Eigen::VectorXd::Zero(D);
+	for (int i = 0; i < N; ++i) {
+		for (int d = 0; d < D; ++d) mean[d] += rows[i][d];
+	}
+	mean /= N;
+	Eigen::MatrixXd covariance = Eigen::MatrixXd::Zero(D, D);
+	for (int i = 0; i < N; ++i) {
+		Eigen::VectorXd diff(D);
+		for (int d = 0; d < D; ++d) diff[d] = rows[i][d] - mean[d];
+		covariance += diff * diff.transpose();
+	}
+	covariance /= N;
+
+	for (int type = 0; type < NUMBER_OF_COVARIANCE_TYPES; ++type) {
+		ExpectationMaximization em(1, D, (CovarianceType)type);
+		for (int i = 0; i < N; ++i) em.addSample(rows[i], 0);
+		em.init();
+		em.tick();
+		EXPECT_TRUE(em.clusterMean(0).isApprox(mean, 1e-9)) << "covariance type " << type;
+
+		Eigen::MatrixXd expected;
+		switch (type) {
+		case COV_FULL:
+			expected = covariance;
+			break;
+		case COV_DIAGONAL:
+			expected = covariance.diagonal().asDiagonal();
+			break;
+		case COV_SPHERICAL:
+			expected = Eigen::MatrixXd::Identity(D, D) * covariance.trace() / D;
+			break;
+		}
+		Eigen::MatrixXd estimated = em.clusterCovariance(0).matrix();
+		EXPECT_EQ(type, em.clusterCovariance(0).structure());
+		EXPECT_TRUE(estimated.isApprox(expected, 1e-9)) << "covariance type " << type << ":" << std::endl <<
+				estimated << std::endl << "expected:" << std::endl << expected;
+	}
+}
+
+}
@@ -0,0 +1,179 @@
+/**
+ * @brief TestKMeans.cpp
+ * @file TestKMeans.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2013 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    Clustering
+ */
+
+#include <kMeans.h>
+#include <random>
+#include "gtest/gtest.h"
+
+namespace {
+
+/**
+ * Samples around K random centres, all shifted by "offset" in every dimension, so they are far from the origin
+ * compared to their spread. The initial means are samples of different clusters.
+ */
+class UncentredData {
+public:
+	UncentredData(int N, int D, int K, float offset, float separation): N(N), D(D), K(K) {
+		std::mt19937 generator(1);
+		std::normal_distribution<float> normal(0, 1);
+		std::vector<std::vector<float> > centres(K, std::vector<float>(D));
+		for (int k = 0; k < K; ++k) {
+			for (int d = 0; d < D; ++d) centres[k][d] = separation * normal(generator);
+		}
+		rows.resize(N, std::vector<float>(D));
+		for (int i = 0; i < N; ++i) {
+			for (int d = 0; d < D; ++d) rows[i][d] = offset + centres[i % K][d] + normal(generator);
+		}
+		initial_means.resize(K, D);
+		for (int k = 0; k < K; ++k) {
+			for (int d = 0; d < D; ++d) initial_means(k, d) = rows[k * 7][d];
+		}
+	}
+
+	//! Add the samples to "kmeans" and start from the initial means
+	void fill(KMeans & kmeans) {
+		for (int i = 0; i < N; ++i) kmeans.addSample(rows[i], i % K, D);
+		kmeans.init(initial_means);
+	}
+
+	//! Number of samples that are not assigned to the nearest mean, by distances in double precision
+	int misassigned(const KMeans & kmeans) const {
+		const KMeans::sample_matrix_t & means = kmeans.clusterMeans();
+		int count = 0;
+		for (int i = 0; i < N; ++i) {
+			int nearest_k = 0;
+			double nearest = std::numeric_limits<double>::max();
+			for (int k = 0; k < K; ++k) {
+				double dist = 0;
+				for (int d = 0; d < D; ++d) {
+					double diff = double(rows[i][d]) - means(k, d);
+					dist += diff * diff;
+				}
+				if (dist < nearest) {
+					nearest = dist;
+					nearest_k = k;
+				}
+			}
+			if ((size_t)nearest_k != kmeans.clusterAssignments()[i]) count++;
+		}
+		return count;
+	}
+
+	int N, D, K;
+	std::vector<std::vector<float> > rows;
+	KMeans::sample_matrix_t initial_means;
+};
+
+//! Run till convergence, returns the number of ticks, or T+1 if it did not converge
+int run(KMeans & kmeans, int T) {
+	for (int t = 0; t < T; ++t) {
+		kmeans.tick();
+		if (kmeans.converged()) return t + 1;
+	}
+	return T + 1;
+}
+
+/**
+ * Lloyd's iteration with the matrix product (see KMeans::assign_block) on data far from the origin. It should
+ * converge, and assign every sample to the mean that is nearest by exact distances.
+ */
+TEST(KMeansTest, LloydOnUncentredData) {
+	const int T = 400;
+	for (int K = 10; K <= 50; K += 40) {
+		UncentredData data(20000, 8, K, 1000, 5);
+		KMeans kmeans(K, data.D);
+		kmeans.setAssignMethod(KMeans::A_LLOYD);
+		data.fill(kmeans);
+		EXPECT_LE(run(kmeans, T), T);
+		// the assignments of the tick after the last update are compared with the means they were made for
+		kmeans.tick();
+		EXPECT_EQ(0, data.misassigned(kmeans)) << "with K=" << K;
+	}
+}
+
+/**
+ * Hamerly's and Elkan's method skip distances with bounds, but decide with the same distance as Lloyd's iteration,
+ * so from the same initial means they should take the same number of ticks and end with the same assignments and
+ * means, also on data far from the origin, and with overlapping clusters that have many near ties.
+ */
+TEST(KMeansTest, BoundedMethodsAsLloyd) {
+	const int T = 1000;
+	const float offsets[] = { 0, 1000, 100000 };
+	for (int o = 0; o < 3; ++o) {
+		for (int K = 10; K <= 50; K += 40) {
+			UncentredData data(10000, 8, K, offsets[o], 2);
+			KMeans lloyd(K, data.D);
+			lloyd.setAssignMethod(KMeans::A_LLOYD);
+			data.fill(lloyd);
+			int ticks = run(lloyd, T);
+			EXPECT_LE(ticks, T);
+			for (int method = KMeans::A_HAMERLY; method < KMeans::NUMBER_OF_ASSIGN_METHODS; ++method) {
+				KMeans bounded(K, data.D);
+				bounded.setAssignMethod((KMeans::AssignMethod)method);
+				data.fill(bounded);
+				EXPECT_EQ(ticks, run(bounded, T)) << "method " << method << ", offset " << offsets[o] << ", K=" << K;
+				EXPECT_TRUE(lloyd.clusterAssignments() == bounded.clusterAssignments());
+				EXPECT_TRUE(lloyd.clusterMeans() == bounded.clusterMeans());
+			}
+		}
+	}
+}
+
+
+/**
+ * Samples on an integer grid, with initial means on grid points as well, so many samples are at exactly the same
+ * distance of two means. All methods take the mean with the lowest index on such a tie, and the bounds of Hamerly's
+ * and Elkan's method should not skip a mean that is at the same distance as the assigned one.
+ */
+TEST(KMeansTest, BoundedMethodsOnTies) {
+	const int T = 100, D = 2, S = 12;
+	for (int K = 2; K <= 8; K *= 2) {
+		std::vector<std::vector<float> > rows;
+		for (int x = 0; x < S; ++x) {
+			for (int y = 0; y < S; ++y) rows.push_back(std::vector<float>{ float(x), float(y) });
+		}
+		KMeans::sample_matrix_t initial_means(K, D);
+		for (int k = 0; k < K; ++k) {
+			initial_means(k, 0) = 2 * (k % 4);
+			initial_means(k, 1) = 2 * (k / 4);
+		}
+		KMeans lloyd(K, D), hamerly(K, D), elkan(K, D);
+		KMeans *kmeans[3] = { &lloyd, &hamerly, &elkan };
+		for (int method = KMeans::A_LLOYD; method < KMeans::NUMBER_OF_ASSIGN_METHODS; ++method) {
+			kmeans[method]->setAssignMethod((KMeans::AssignMethod)method);
+			for (size_t i = 0; i < rows.size(); ++i) kmeans[method]->addSample(rows[i], 0, D);
+			kmeans[method]->init(initial_means);
+		}
+		for (int t = 0; t < T && !lloyd.converged(); ++t) {
+			for (int method = KMeans::A_LLOYD; method < KMeans::NUMBER_OF_ASSIGN_METHODS; ++method) {
+				kmeans[method]->tick();
+			}
+			EXPECT_TRUE(lloyd.clusterAssignments() == hamerly.clusterAssignments()) << "tick " << t << ", K=" << K;
+			EXPECT_TRUE(lloyd.clusterAssignments() == elkan.clusterAssignments()) << "tick " << t << ", K=" << K;
+			EXPECT_TRUE(lloyd.clusterMeans() == hamerly.clusterMeans()) << "tick " << t << ", K=" << K;
+			EXPECT_TRUE(lloyd.clusterMeans() == elkan.clusterMeans()) << "tick " << t << ", K=" << K;
+		}
+	}
+}
+
+}
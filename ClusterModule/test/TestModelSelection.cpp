@@ -0,0 +1,110 @@
+/**
+ * @brief TestModelSelection.cpp
+ * @file TestModelSelection.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2013 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    Clustering
+ */
+
+
+#include <ModelSelection.h>
+#include <random>
+#include "gtest/gtest.h"
+
+namespace {
+
+//! Samples around K well separated centres in D dimensions, one sample per row, in the given precision
+template<typename T>
+std::vector<T> clusters(int N, int D, int K) {
+	std::mt19937 generator(1);
+	std::normal_distribution<T> normal(0, 1);
+	std::vector<T> x(N * D);
+	for (int i = 0; i < N; ++i) {
+		for (int d = 0; d < D; ++d) x[i * D + d] = 20 * ((i % K) == d % K) + normal(generator);
+	}
+	return x;
+}
+
+/**
+ * The fits of a sweep run concurrently, each with its own random generator, so the outcome is the same as without a
+ * thread pool. The best fit can be taken over and is the one with the selected number of clusters.
+ */
+TEST(ModelSelectionTest, SweepKMeansOnThreads) {
+	const int N = 3000, D = 3, K = 3;
+	std::vector<float> x = clusters<float>(N, D, K);
+	ThreadPool pool(4);
+	ModelSelection serial(x.data(), N, D), parallel(x.data(), N, D);
+	parallel.setThreadPool(&pool);
+	EXPECT_EQ(K, serial.sweepKMeans(1, 8));
+	EXPECT_EQ(K, parallel.sweepKMeans(1, 8));
+	ASSERT_EQ(serial.results().size(), parallel.results().size());
+	for (size_t f = 0; f < serial.results().size(); ++f) {
+		EXPECT_EQ(serial.results()[f].value, parallel.results()[f].value) << "fit " << f;
+	}
+
+	KMeans *best = parallel.releaseKMeans();
+	ASSERT_TRUE(best != NULL);
+	EXPECT_EQ(NULL, parallel.kmeans());
+	EXPECT_EQ(K, best->clusterMeans().rows());
+	EXPECT_TRUE(best->converged());
+	delete best;
+}
+
+/**
+ * A sample of weight w counts as w samples: the scores on weighted samples are those on the samples repeated, as long
+ * as the fits end in the same clusters. That is the case for one cluster and for the true number of well separated
+ * clusters, other numbers have several local optima.
+ */
+TEST(ModelSelectionTest, WeightedSamples) {
+	const int N = 1000, D = 3, K = 3, W = 3;
+	std::vector<float> x = clusters<float>(N, D, K), weights(N, W), repeated;
+	for (int w = 0; w < W; ++w) repeated.insert(repeated.end(), x.begin(), x.end());
+	ModelSelection weighted(x.data(), N, D, weights.data()), plain(repeated.data(), N * W, D);
+	EXPECT_EQ(K, weighted.sweepKMeans(1, 5));
+	EXPECT_EQ(K, plain.sweepKMeans(1, 5));
+	const size_t fits[] = { 0, K - 1 };
+	for (size_t f : fits) {
+		EXPECT_NEAR(plain.results()[f].value, weighted.results()[f].value, 1e-6 * std::abs(plain.results()[f].value))
+				<< "fit " << f;
+	}
+	EXPECT_EQ(K, weighted.xmeans(1, 8));
+}
+
+/**
+ * EM on samples in its own precision uses them without a copy, and the best fit can be taken over.
+ */
+TEST(ModelSelectionTest, SweepEMOnThreads) {
+	const int N = 3000, D = 3, K = 3;
+	std::vector<double> x = clusters<double>(N, D, K);
+	ThreadPool pool(4);
+	ModelSelection serial(x.data(), N, D), parallel(x.data(), N, D);
+	parallel.setThreadPool(&pool);
+	size_t selected = serial.sweepEM(1, 6, 20);
+	EXPECT_EQ(selected, parallel.sweepEM(1, 6, 20));
+	for (size_t f = 0; f < serial.results().size(); ++f) {
+		EXPECT_EQ(serial.results()[f].value, parallel.results()[f].value) << "fit " << f;
+	}
+
+	ExpectationMaximization *best = parallel.releaseEM();
+	ASSERT_TRUE(best != NULL);
+	EXPECT_EQ(NULL, parallel.em());
+	EXPECT_EQ(parallel.results()[selected - 1].parameters, best->parameters());
+	delete best;
+}
+
+}
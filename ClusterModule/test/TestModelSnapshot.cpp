@@ -0,0 +1,153 @@
+/**
+ * @brief TestModelSnapshot.cpp
+ * @file TestModelSnapshot.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2013 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    Clustering
+ */
+
+
+#include <kMeans.h>
+#include <ExpectationMaximization.h>
+#include <ModelSnapshot.hpp>
+#include <cstdio>
+#include <random>
+#include "gtest/gtest.h"
+
+namespace {
+
+const int N = 2000, D = 3, K = 3;
+
+//! Samples around K centres in D dimensions, that overlap a bit, one sample per row
+std::vector<double> samples() {
+	std::mt19937 generator(1);
+	std::normal_distribution<double> normal(0, 1);
+	std::vector<double> x(N * D);
+	for (int i = 0; i < N; ++i) {
+		for (int d = 0; d < D; ++d) x[i * D + d] = 3 * ((i % K) == d % K) + (d + 1) * normal(generator);
+	}
+	return x;
+}
+
+/**
+ * A snapshot of k-means that is written and loaded (memory-mapped) classifies every sample as the model.
+ */
+TEST(ModelSnapshotTest, KMeansRoundTrip) {
+	std::vector<double> x = samples();
+	std::vector<float> y(x.begin(), x.end());
+	KMeans kmeans(K, D);
+	kmeans.setData(y.data(), N);
+	kmeans.setSeed(1);
+	kmeans.init();
+	for (int t = 0; t < 100 && !kmeans.converged(); ++t) kmeans.tick();
+
+	std::string file = testing::TempDir() + "TestModelSnapshotKMeans.model";
+	ModelSnapshot written, loaded;
+	kmeans.snapshot(written);
+	ASSERT_TRUE(written.write(file));
+	ASSERT_TRUE(loaded.load(file));
+	EXPECT_EQ(ModelSnapshot::SNAPSHOT_MEANS, loaded.kind());
+	EXPECT_EQ((size_t)K, loaded.clusters());
+	EXPECT_EQ((size_t)D, loaded.dimension());
+	for (int i = 0; i < N; ++i) {
+		ASSERT_EQ(kmeans.classify(&y[i * D]), loaded.classify(&y[i * D])) << "sample " << i;
+	}
+	remove(file.c_str());
+}
+
+/**
+ * A snapshot of EM classifies every sample as the model, for every type of covariance matrix.
+ */
+TEST(ModelSnapshotTest, ExpectationMaximizationRoundTrip) {
+	std::vector<double> x = samples();
+	std::string file = testing::TempDir() + "TestModelSnapshotEM.model";
+	for (int type = 0; type < NUMBER_OF_COVARIANCE_TYPES; ++type) {
+		ExpectationMaximization em(K, D, (CovarianceType)type);
+		em.setData(x.data(), N);
+		em.setSeed(1);
+		em.init();
+		for (int t = 0; t < 10; ++t) em.tick();
+
+		ModelSnapshot written, loaded;
+		em.snapshot(written);
+		ASSERT_TRUE(written.write(file));
+		ASSERT_TRUE(loaded.load(file));
+		EXPECT_EQ(ModelSnapshot::SNAPSHOT_MIXTURE, loaded.kind());
+		EXPECT_EQ((size_t)K, loaded.clusters());
+		for (int i = 0; i < N; ++i) {
+			ASSERT_EQ(em.classify(&x[i * D]), loaded.classify(&x[i * D])) << "sample " << i << ", type " << type;
+		}
+	}
+	remove(file.c_str());
+}
+
+//! The header of a snapshot file, as in ModelSnapshot
+class RawSnapshot: public ModelSnapshot {
+public:
+	typedef ModelSnapshot::Header Header;
+
+	//! Write a header with the given fields, followed by "values" zeros
+	static void write(const std::string & file, SnapshotKind kind, uint32_t lines, uint64_t dimension, size_t values) {
+		Header h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, "AIMMODEL", 8);
+		h.version = snapshot_version;
+		h.value_size = sizeof(value_t);
+		h.kind = kind;
+		h.covariance_type = COV_SPHERICAL;
+		h.lines = lines;
+		h.clusters = 1;
+		h.dimension = dimension;
+		FILE *f = fopen(file.c_str(), "wb");
+		fwrite(&h, sizeof(h), 1, f);
+		std::vector<value_t> zeros(values, 0);
+		if (values) fwrite(zeros.data(), sizeof(value_t), values, f);
+		fclose(f);
+	}
+};
+
+/**
+ * Snapshots of which the header is consistent with the file size, but that can not be used, are rejected: dimension 0,
+ * and lines in another dimension than 2 or with means.
+ */
+TEST(ModelSnapshotTest, RejectInvalid) {
+	std::string file = testing::TempDir() + "TestModelSnapshotInvalid.model";
+	ModelSnapshot snapshot;
+
+	RawSnapshot::write(file, ModelSnapshot::SNAPSHOT_MEANS, 0, 2, 2);
+	EXPECT_TRUE(snapshot.load(file));
+
+	RawSnapshot::write(file, ModelSnapshot::SNAPSHOT_MEANS, 0, 0, 0);
+	EXPECT_FALSE(snapshot.load(file));
+	EXPECT_FALSE(snapshot.loaded());
+
+	// log weight, log normalization, mean (D), line (D), and one inverse variance
+	RawSnapshot::write(file, ModelSnapshot::SNAPSHOT_MIXTURE, 1, 2, 2 + 2 * 2 + 1);
+	EXPECT_TRUE(snapshot.load(file));
+	RawSnapshot::write(file, ModelSnapshot::SNAPSHOT_MIXTURE, 1, 3, 2 + 2 * 3 + 1);
+	EXPECT_FALSE(snapshot.load(file));
+	RawSnapshot::write(file, ModelSnapshot::SNAPSHOT_MEANS, 1, 2, 2);
+	EXPECT_FALSE(snapshot.load(file));
+
+	// truncated
+	RawSnapshot::write(file, ModelSnapshot::SNAPSHOT_MEANS, 0, 2, 1);
+	EXPECT_FALSE(snapshot.load(file));
+	remove(file.c_str());
+}
+
+}
@@ -26,16 +26,21 @@
 #define DATADECORATOR_H_
 
 // General files
-#include <map>
+#include <vector>
+#include <utility>
+#include <iostream>
 
 /* **************************************************************************************
  * Interface of DataContainer
  * **************************************************************************************/
 
-enum DataType { DT_MAP, DT_F2DARRAY };
+enum DataType { DT_HISTOGRAM, DT_F2DARRAY };
 
 typedef double DataDecoratorType;
 
+//! (value, count) pairs sorted by value, with one pair per value, the same layout as EventCounter::Events
+typedef std::vector<std::pair<DataDecoratorType,int> > DataDecoratorHistogram;
+
 /**
  * A "container" class that does not contain data itself, but which can point to different
  * types of data structures. This container is meant to be used in cases where power law
@@ -54,8 +59,8 @@ public:
 	//! Sets the data type
 	inline void SetType(DataType dataType) { this->dataType = dataType; }
 
-	//! Point towards data in the form of a map
-	inline void SetData(std::map<DataDecoratorType,int> & data) { this->map_data = &data; dataType = DT_MAP; }
+	//! Point towards data in the form of a histogram
+	inline void SetData(DataDecoratorHistogram & data) { this->histogram_data = &data; dataType = DT_HISTOGRAM; }
 
 	//! Point towards data in the form of an array
 	inline void SetData(float *data, int len) { float_data = data; float_data_len = len; dataType = DT_F2DARRAY; }
@@ -85,7 +90,7 @@ public:
 	//! ID idem
 	inline int GetID() { return id; }
 
-	//! Apply bins to the data (in DT_MAP case)
+	//! Apply bins to the data (in DT_HISTOGRAM case)
 	void ApplyBins(int no_bins, DataDecoratorType min, DataDecoratorType max);
 private:
 	int id;
@@ -93,8 +98,8 @@ private:
 	//! Type of data that will be stored
 	DataType dataType;
 
-	//! Data in the form of a map
-	std::map<DataDecoratorType,int> * map_data;
+	//! Data in the form of a histogram
+	DataDecoratorHistogram * histogram_data;
 
 	//! An array of data
 	float *float_data;
@@ -26,7 +26,8 @@
 #define EVENTCOUNTER_H_
 
 // General files
-#include <map>
+#include <vector>
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <iterator>
@@ -37,55 +38,64 @@
 
 /**
  * Count events of a given "type" (might e.g. be size)
+ *
+ * The counts are stored in one array of (type, count) pairs, sorted by type. Events of a type that is larger than
+ * all types so far, or equal to the last one, are added in O(1). Other events are appended and merged into the
+ * sorted part once there are as many of them as there are sorted ones, so adding is O(log n) amortized, and the
+ * events can be indexed and binned in a single pass over contiguous memory.
  */
 template <typename T>
 class EventCounter {
 public:
+	typedef std::vector<std::pair<T,int> > Events;
+
 	//! Construct an event counter
-	EventCounter() { events.clear(); }
+	EventCounter(): sorted(0) {}
 
 	//! Add one event of given type
 	void AddEvent(const T type) {
-		typename std::map<T,int>::iterator f = events.find(type);
-		if (f == events.end()) {
-			events.insert(std::make_pair<T,int>(type, 1));
-		} else {
-			(*f).second++;
-		}
+		AddEvent(type, 1);
 	}
 
 	//! Add "freq" events of a given type
 	void AddEvent(const T type, int freq) {
-		typename std::map<T,int>::iterator f = events.find(type);
-		if (f == events.end()) {
-			events.insert(std::make_pair<T,int>(type, freq));
-		} else {
-			(*f).second += freq;
+		if (!events.empty() && events.back().first == type) {
+			events.back().second += freq;
+			return;
+		}
+		bool in_order = (sorted == events.size()) && (events.empty() || events.back().first < type);
+		events.push_back(std::pair<T,int>(type, freq));
+		if (in_order) {
+			sorted++;
+		} else if (events.size() - sorted > std::max(sorted, (size_t)1024)) {
+			Sort();
 		}
 	}
 
-	//! Take the existing events and put them in bins
+	//! Take the existing events and put them in bins, in one pass over the events and one over the bins
 	void Bin(int no_bins, T min, T max) {
-		typename std::map<T,int>::iterator f;
 		if (events.empty()) return;
-		EventCounter binned_cntr;
+		Sort();
 
 		T delta = (max - min) / no_bins;
 		std::cout << "Delta is " << delta << std::endl;
-		for (f = events.begin(); f != events.end(); ++f) {
-			T value = (*f).first;
+		std::vector<int> counts(no_bins + 1, 0);
+		std::vector<bool> used(no_bins + 1, false);
+		for (typename Events::const_iterator f = events.begin(); f != events.end(); ++f) {
+			T value = f->first;
 			int bin_id = 0;
 			if (value >= min) bin_id = (value - min) / delta;
 			if (value > max) bin_id = no_bins;
-			T bin_value = min + delta * bin_id;
-//			std::cout << "Bin id is " << bin_id << "(" << value << "-" << min << ") /" << no_bins << " and bin value thus: " << bin_value << std::endl;
-			binned_cntr.AddEvent(bin_value, (*f).second);
+			bin_id = std::max(0, std::min(bin_id, no_bins));
+			counts[bin_id] += f->second;
+			used[bin_id] = true;
 		}
 		int size = events.size();
 		events.clear();
-		for (f = binned_cntr.getEvents().begin(); f != binned_cntr.getEvents().end(); ++f) {
-			AddEvent(f->first, f->second);
+		for (int bin_id = 0; bin_id <= no_bins; ++bin_id) {
+			if (used[bin_id]) events.push_back(std::pair<T,int>(min + delta * bin_id, counts[bin_id]));
 		}
+		sorted = events.size();
 		std::cerr << "Goes from size " << size << " to " << events.size() << std::endl;
 		if (events.size() < 10) {
 			std::cerr << "Maybe use more than " << no_bins << " bins" << std::endl;
@@ -96,7 +106,8 @@ public:
 
 	//! Print
 	void Print(int print_list = 0) {
-		typename std::map<T,int>::iterator f;
+		typename Events::const_iterator f;
+		Sort();
 
 		int line_items = 20; int i = 0;
 
@@ -126,11 +137,37 @@ public:
 
 	}
 
-	//! Get events
-	std::map<T, int> & getEvents() { return events; }
+	//! Get events, sorted by type and with one entry per type
+	const Events & getEvents() {
+		Sort();
+		return events;
+	}
 private:
-	//! Probably a sparse vector is the best, but to stay in STL, we will use a map
-	std::map<T, int> events;
+	//! Compare on type only
+	static bool less_type(const std::pair<T,int> & a, const std::pair<T,int> & b) {
+		return a.first < b.first;
+	}
+
+	//! Merge the appended events into the sorted ones, and sum the counts of equal types
+	void Sort() {
+		if (sorted == events.size()) return;
+		std::sort(events.begin() + sorted, events.end(), less_type);
+		std::inplace_merge(events.begin(), events.begin() + sorted, events.end(), less_type);
+		size_t j = 0;
+		for (size_t i = 0; i < events.size(); ++i) {
+			if (j && events[j-1].first == events[i].first) {
+				events[j-1].second += events[i].second;
+			} else {
+				events[j++] = events[i];
+			}
+		}
+		events.resize(j);
+		sorted = j;
+	}
+
+	//! The events, sorted by type up to "sorted", and in order of arrival after that
+	Events events;
+	size_t sorted;
 };
 
 #endif /* EVENTCOUNTER_H_ */
@@ -27,6 +27,8 @@
 
 #include <defs.h>
 
+#include <cstddef>
+
 namespace dobots {
 
 enum ILVQ_DistanceMetric { IDM_EUCLIDEAN, IDM_DOTPRODUCT, IDM_TYPES };
@@ -49,9 +51,18 @@ public:
 	//! Decrease distance (by updating prototype)
 	void decreaseDistance(ILVQ_PROTOTYPE & prototype, const ILVQ_ASPECT & input, ILVQ_TYPE mu);
 
+	//! Increase the distance for a prototype stored as an array of input.size() values
+	void increaseDistance(ILVQ_TYPE *prototype, const ILVQ_ASPECT & input, ILVQ_TYPE mu);
+
+	//! Decrease the distance for a prototype stored as an array of input.size() values
+	void decreaseDistance(ILVQ_TYPE *prototype, const ILVQ_ASPECT & input, ILVQ_TYPE mu);
+
 protected:
 	//! For debugging purposes
 	void print(ILVQ_ASPECT & vector);
+
+	//! For debugging purposes, an array of "size" values
+	void print(const ILVQ_TYPE *vector, size_t size);
 private:
 };
 
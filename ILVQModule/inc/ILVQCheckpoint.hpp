@@ -0,0 +1,258 @@
+/**
+ * @brief Checkpoint of an ILVQ_XSZ network in a versioned binary file that can be memory-mapped
+ * @file ILVQCheckpoint.hpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author     Anne C. van Rossum
+ * @date       Oct 15, 2026
+ * @project    Replicator FP7
+ * @company    Almende B.V.
+ * @case       Machine learning (fit for Surveyeor robots)
+ */
+
+
+#ifndef ILVQCHECKPOINT_HPP_
+#define ILVQCHECKPOINT_HPP_
+
+#include <defs.h>
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace dobots {
+
+/**
+ * The complete state of an incremental network, in a binary file:
+ *
+ *   header        magic "ILVQ_XSZ", format version, size of a value, dimension, padded dimension (stride), and the
+ *                 number of rows, classes, edges, and free rows, followed by the parameters of the network
+ *   rows          the prototype vectors, one padded row of "stride" values per row of the PrototypeArena
+ *   rows nodes    per row: label, winner count, threshold, and whether the row contains a prototype
+ *   classes       per class: label, number of prototypes, and the sum and number of edge lengths within the class
+ *   edges         per edge: source row, target row, age, and length, grouped by source in the order of its edges
+ *   free rows     the rows that will be reused by the next prototypes, in order
+ *
+ * The header has a size that is a multiple of the row alignment and every section a multiple of eight bytes, so in
+ * a mapped file the rows are aligned just as in the arena, and the whole prototype block can be copied at once.
+ *
+ * A checkpoint is filled by ILVQ_XSZ::checkpoint(), which only copies memory. Writing it to disk with write() does
+ * not touch the network, so it can be done on another thread while training goes on. It is written to a temporary
+ * file that is renamed, so a half written checkpoint is never read. It is loaded by memory-mapping the file and
+ * checking the header and the file size, and ILVQ_XSZ::restore() copies the sections into the network, which is
+ * O(file size).
+ */
+class ILVQCheckpoint {
+public:
+	struct Node {
+		int32_t class_id;
+		int32_t winner_count;
+		ILVQ_TYPE T_s;
+		int32_t alive;
+	};
+
+	struct Class {
+		int32_t class_id;
+		int32_t prototype_count;
+		int32_t within_count;
+		int32_t reserved;
+		double within_sum;
+	};
+
+	struct Edge {
+		int32_t source;
+		int32_t target;
+		int32_t age;
+		ILVQ_TYPE length;
+	};
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t value_size;
+		uint64_t dimension;
+		uint64_t stride;
+		uint64_t rows;
+		uint64_t classes;
+		uint64_t edges;
+		uint64_t free_rows;
+		int32_t age_old;
+		int32_t lambda;
+		int32_t lambda_i;
+		ILVQ_TYPE mu1;
+		ILVQ_TYPE mu2;
+		uint32_t reserved[3];
+	};
+
+	ILVQCheckpoint(): data(NULL), mapping(NULL), mapping_size(0) {
+		clear();
+	}
+
+	~ILVQCheckpoint() {
+		unmap();
+	}
+
+	//! Forget the checkpoint
+	void clear() {
+		unmap();
+		buffer.clear();
+		data = NULL;
+		memset(&header_, 0, sizeof(header_));
+	}
+
+	/**
+	 * Start a checkpoint with the given sizes, the parameters are set in header(), and the sections are filled
+	 * through rows(), nodes(), classes(), edges(), and freeRows().
+	 */
+	void create(size_t dimension, size_t stride, size_t rows, size_t classes, size_t edges, size_t free_rows) {
+		clear();
+		memcpy(header_.magic, "ILVQ_XSZ", 8);
+		header_.version = checkpoint_version;
+		header_.value_size = sizeof(ILVQ_TYPE);
+		header_.dimension = dimension;
+		header_.stride = stride;
+		header_.rows = rows;
+		header_.classes = classes;
+		header_.edges = edges;
+		header_.free_rows = free_rows;
+		// in units of double to keep the class records aligned
+		buffer.assign((size() + sizeof(double) - 1) / sizeof(double), 0);
+		data = (char*)&buffer[0];
+	}
+
+	/**
+	 * Write the checkpoint to "file". Returns false (and reports it) if it cannot be written.
+	 */
+	bool write(const std::string & file) const {
+		if (!loaded()) return false;
+		std::string temporary = file + ".tmp";
+		FILE *f = fopen(temporary.c_str(), "wb");
+		bool success = (f != NULL);
+		if (success) {
+			size_t count = size() - sizeof(Header);
+			success = fwrite(&header_, sizeof(Header), 1, f) == 1 &&
+					fwrite(data + sizeof(Header), 1, count, f) == count;
+			success = (fclose(f) == 0) && success;
+			success = success && (rename(temporary.c_str(), file.c_str()) == 0);
+			if (!success) remove(temporary.c_str());
+		}
+		if (!success) {
+			std::cerr << "Could not write checkpoint " << file << std::endl;
+		}
+		return success;
+	}
+
+	/**
+	 * Map the checkpoint in "file". Returns false if it does not exist, or if it is not a checkpoint of this version
+	 * with the same value type, in which case the checkpoint is cleared.
+	 */
+	bool load(const std::string & file) {
+		clear();
+		int fd = open(file.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat info;
+		Header h;
+		if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(h) || read(fd, &h, sizeof(h)) != sizeof(h)) {
+			close(fd);
+			return false;
+		}
+		header_ = h;
+		if (memcmp(h.magic, "ILVQ_XSZ", 8) || h.version != checkpoint_version ||
+				h.value_size != sizeof(ILVQ_TYPE) || h.stride < h.dimension || (size_t)info.st_size != size()) {
+			close(fd);
+			std::cerr << "File " << file << " is not an ILVQ checkpoint of version " << checkpoint_version << std::endl;
+			clear();
+			return false;
+		}
+		void *addr = mmap(NULL, size(), PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (addr == MAP_FAILED) {
+			clear();
+			return false;
+		}
+		mapping = addr;
+		mapping_size = size();
+		data = (char*)addr;
+		return true;
+	}
+
+	//! Returns true if there is a checkpoint, created or loaded
+	inline bool loaded() const { return data != NULL; }
+
+	inline Header & header() { return header_; }
+
+	inline const Header & header() const { return header_; }
+
+	//! The prototype block, rows() * stride values
+	inline ILVQ_TYPE *rows() { return (ILVQ_TYPE*)(data + rows_offset()); }
+	inline const ILVQ_TYPE *rows() const { return (const ILVQ_TYPE*)(data + rows_offset()); }
+
+	inline Node *nodes() { return (Node*)(data + nodes_offset()); }
+	inline const Node *nodes() const { return (const Node*)(data + nodes_offset()); }
+
+	inline Class *classes() { return (Class*)(data + classes_offset()); }
+	inline const Class *classes() const { return (const Class*)(data + classes_offset()); }
+
+	inline Edge *edges() { return (Edge*)(data + edges_offset()); }
+	inline const Edge *edges() const { return (const Edge*)(data + edges_offset()); }
+
+	inline int32_t *freeRows() { return (int32_t*)(data + free_rows_offset()); }
+	inline const int32_t *freeRows() const { return (const int32_t*)(data + free_rows_offset()); }
+
+	//! Size of the file in bytes
+	inline size_t size() const { return free_rows_offset() + header_.free_rows * sizeof(int32_t); }
+
+private:
+	// the sections can be memory-mapped, hence no copies
+	ILVQCheckpoint(const ILVQCheckpoint &);
+	ILVQCheckpoint & operator=(const ILVQCheckpoint &);
+
+	static const uint32_t checkpoint_version = 1;
+
+	inline size_t rows_offset() const { return sizeof(Header); }
+	inline size_t nodes_offset() const { return rows_offset() + header_.rows * header_.stride * sizeof(ILVQ_TYPE); }
+	inline size_t classes_offset() const { return nodes_offset() + header_.rows * sizeof(Node); }
+	inline size_t edges_offset() const { return classes_offset() + header_.classes * sizeof(Class); }
+	inline size_t free_rows_offset() const { return edges_offset() + header_.edges * sizeof(Edge); }
+
+	void unmap() {
+		if (mapping) munmap(mapping, mapping_size);
+		mapping = NULL;
+		mapping_size = 0;
+	}
+
+	Header header_;
+
+	//! The file when created (not mapped), the header in it is only written by write()
+	std::vector<double> buffer;
+
+	//! Start of the file, in the buffer or in the mapping
+	char *data;
+
+	//! The memory-mapped checkpoint, if any
+	void *mapping;
+	size_t mapping_size;
+};
+
+}
+
+#endif /* ILVQCHECKPOINT_HPP_ */
@@ -16,6 +16,11 @@
 #include <ILVQModule.h>
 
 #include <ILVQ_XSZ.h>
+#include <ILVQCheckpoint.hpp>
+#include <ThreadPool.hpp>
+
+#include <string>
+#include <thread>
 
 namespace rur {
 
@@ -36,9 +41,33 @@ public:
 	//! As soon as Stop() returns "true", the ILVQModuleMain will stop the module
 	bool Stop();
 private:
+	//! Take a checkpoint of the network and write it to checkpoint_file on another thread
+	void WriteCheckpoint();
+
+	//! Maximum number of test samples that are classified together in one tick
+	static const size_t ILVQ_BATCH = 4096;
+
 	dobots::ILVQ_XSZ *ilvq;
 
 	int sample_dimension;
+
+	//! Threads for classifying the test samples
+	ThreadPool pool;
+
+	//! Test samples of the current tick, row after row, and their labels
+	std::vector<float> test_values;
+	std::vector<int> test_labels;
+
+	//! Number of training samples after which a checkpoint is written
+	static const size_t ILVQ_CHECKPOINT_INTERVAL = 100000;
+
+	//! The network is continued from checkpoint_file at startup, and written to it every interval
+	std::string checkpoint_file;
+	dobots::ILVQCheckpoint checkpoint;
+
+	//! Thread that writes the last checkpoint, and the number of training samples since that checkpoint
+	std::thread writer;
+	size_t trained;
 };
 
 }
@@ -27,34 +27,50 @@
 
 #include <defs.h>
 #include <ILVQ.h>
+#include <PrototypeArena.hpp>
+#include <PrototypeIndex.hpp>
+#include <PrototypeGraph.hpp>
+#include <PrototypeSnapshot.hpp>
+#include <ILVQCheckpoint.hpp>
+#include <ThreadPool.hpp>
 
 #include <map>
+#include <vector>
 #include <set>
-#include <list>
 #include <algorithm>
 
 namespace dobots {
 
-struct ILVQ_XSZ_CONNECTION;
-
-typedef std::list<ILVQ_XSZ_CONNECTION*> ILVQ_XSZ_CONNECTIONS;
+/**
+ * Bookkeeping per class, kept up to date on every change of an edge, so the threshold of a prototype can be
+ * calculated without going through the whole graph.
+ */
+struct ILVQ_XSZ_CLASS {
+	ILVQ_XSZ_CLASS(): prototype_count(0), within_sum(0), within_count(0) {}
+	int prototype_count; // number of prototypes with this class
+	double within_sum; // sum of the lengths of the edges going out of prototypes of this class
+	int within_count; // and the number of those edges
+	std::multiset<ILVQ_TYPE> between; // the lengths of the edges going into prototypes of this class
+};
 
 struct ILVQ_XSZ_PROTOTYPE {
-	ILVQ_PROTOTYPE *prototype;
+	ILVQ_PROTOTYPE_INDEX id; // row in the prototype arena
 	ILVQ_TYPE T_s; // state
 	int winner_count; //M_s
 	ILVQ_CLASS_REPRESENTATION class_id; // class represented by index/id (not distributed)
-	ILVQ_XSZ_CONNECTIONS *outgoing_connections;
+	ILVQ_XSZ_CLASS *statistics; // bookkeeping of class_id
 };
 
-struct ILVQ_XSZ_CONNECTION {
-	ILVQ_XSZ_PROTOTYPE *s1;
-	ILVQ_XSZ_PROTOTYPE *s2;
-	int age;
+/**
+ * Winner and runner-up. They are handles rather than pointers into the vector with prototypes, which is resized
+ * when a prototype is added, and of which a row is reused when a prototype is removed. The edges between prototypes
+ * (with their age) are stored in the PrototypeGraph.
+ */
+struct ILVQ_XSZ_PROTOTYPE_PAIR {
+	ILVQ_PROTOTYPE_HANDLE s1;
+	ILVQ_PROTOTYPE_HANDLE s2;
 };
 
-typedef ILVQ_XSZ_CONNECTION ILVQ_XSZ_PROTOTYPE_PAIR;
-
 /**
  * First, I picked this one: "Rapid Online Learning of Objects in a Biologically Motivated
  * Recognition Architecture" by Kirstein, Wersing, Körner (2005). However, it is vague at many
@@ -82,6 +98,40 @@ public:
 
 	ILVQ_CLASS_REPRESENTATION classify(ILVQ_ASPECT & input);
 
+	/**
+	 * Classify "count" inputs at once, stored row after row in "inputs". The labels are written to "labels", and
+	 * the squared distances to the winners to "distances" if it is not NULL. The result is the same as that of
+	 * classify() for every input. Without prototypes the label is -1 and the distance the maximum value. A large
+	 * batch is classified in parallel, if there is a thread pool, against a snapshot of the prototypes, which is
+	 * only taken again if add() has been called since the last batch. A small batch after add() is classified
+	 * against the prototypes themselves, on the calling thread.
+	 */
+	void classify(const ILVQ_TYPE *inputs, size_t count, ILVQ_CLASS_REPRESENTATION *labels,
+			ILVQ_TYPE *distances = NULL);
+
+	/**
+	 * Copy the current prototypes into a snapshot. The snapshot does not refer to the network, so it can be used
+	 * to classify on another thread while training goes on with add() on this one.
+	 */
+	void snapshot(PrototypeSnapshot & snapshot) const;
+
+	/**
+	 * Copy the complete state of the network into a checkpoint, which can then be written to disk on another thread
+	 * while training continues. O(prototypes + edges), there is no computation, only copying.
+	 */
+	void checkpoint(ILVQCheckpoint & checkpoint) const;
+
+	/**
+	 * Continue from a checkpoint, loaded from disk or taken from another network. Only possible for a network that
+	 * has not been trained yet. Returns false if it is not, or if the checkpoint does not fit this build.
+	 */
+	bool restore(const ILVQCheckpoint & checkpoint);
+
+	//! Classify batches in parallel on the given pool, not owned, with NULL everything runs on the calling thread
+	void setThreadPool(ThreadPool *pool) {
+		this->pool = pool;
+	}
+
 	int getPrototypeCount();
 
 protected: // everything that is protected can use ILVQ_XSZ_PROTOTYPE instead of ILVQ_PROTOTYPE
@@ -91,12 +141,12 @@ protected: // everything that is protected can use ILVQ_XSZ_PROTOTYPE instead of
 	void getClosePrototypes(const ILVQ_ASPECT & input, ILVQ_XSZ_PROTOTYPE_PAIR & winners);
 
 	/**
-	 * Calculate
+	 * Whether the input should become a new prototype. The input is the one getClosePrototypes() has just been
+	 * called with, which is still in "query".
 	 */
-	bool isNewPrototype(const ILVQ_ASPECT & input, ILVQ_CLASS_REPRESENTATION & class_rep,
-			const ILVQ_XSZ_PROTOTYPE_PAIR & winners);
+	bool isNewPrototype(ILVQ_CLASS_REPRESENTATION & class_rep, const ILVQ_XSZ_PROTOTYPE_PAIR & winners);
 
-	//! Slow searching for class id through prototype set
+	//! True if there is no prototype with this class
 	bool isNewClass(ILVQ_CLASS_REPRESENTATION & class_rep);
 
 	//! Add edge (plus update ages and winner count)
@@ -113,16 +163,44 @@ protected: // everything that is protected can use ILVQ_XSZ_PROTOTYPE instead of
 	void updateThreshold(ILVQ_XSZ_PROTOTYPE &winner);
 
 	/**
-	 * Delete all edges with age > AgeOld.
+	 * Delete all edges with age >= AgeOld. Only the edges of the winner age, so only those have to be checked.
 	 */
-	void deleteEdges();
+	void deleteEdges(ILVQ_XSZ_PROTOTYPE &winner);
 
 	//! Delete the unconnected and sparse connected
 	void deleteNodes();
 
 protected:
 	//! Delete edges leading to given node (used by deleteNodes)
-	void deleteEdges(ILVQ_XSZ_PROTOTYPE* target);
+	void deleteIncomingEdges(ILVQ_XSZ_PROTOTYPE &target);
+
+	//! Delete edges leaving the given node (used by deleteNodes)
+	void deleteOutgoingEdges(ILVQ_XSZ_PROTOTYPE &source);
+
+	//! Batched classify() against the arena and index of the network, rather than against a snapshot
+	void classifyLive(const ILVQ_TYPE *inputs, size_t count, ILVQ_CLASS_REPRESENTATION *labels,
+			ILVQ_TYPE *distances);
+
+	//! Store a copy of the input as a new prototype
+	ILVQ_XSZ_PROTOTYPE *addPrototype(const ILVQ_ASPECT & input, ILVQ_CLASS_REPRESENTATION & class_rep);
+
+	//! The prototype of the handle, or NULL if there is none or it has been removed since the handle was obtained
+	ILVQ_XSZ_PROTOTYPE *prototype(const ILVQ_PROTOTYPE_HANDLE & h);
+
+	//! Remove a prototype (its edges should be removed already)
+	void removePrototype(ILVQ_XSZ_PROTOTYPE *p);
+
+	//! Remove an edge from the graph and from the class bookkeeping
+	void deleteEdge(ILVQ_EDGE_INDEX e);
+
+	//! Add the length of an edge to the class bookkeeping
+	void countEdge(PrototypeGraph::Edge & edge);
+
+	//! Remove the length of an edge from the class bookkeeping
+	void uncountEdge(const PrototypeGraph::Edge & edge);
+
+	//! The prototype has moved, update the lengths of all its edges
+	void updateEdges(ILVQ_XSZ_PROTOTYPE &p);
 private:
 	//! Global variable that removes old edges
 	int ageOld;
@@ -139,11 +217,33 @@ private:
 	//! Debug setting
 	char debug;
 
-	//! Contains all prototypes (G)
-	std::set<ILVQ_XSZ_PROTOTYPE*> prototypes;
+	//! The vectors of all prototypes, the index of a row is the id of the prototype
+	PrototypeArena arena;
+
+	//! Contains all prototypes (G), indexed by id, only valid for rows that are alive in the arena
+	std::vector<ILVQ_XSZ_PROTOTYPE> prototypes;
+
+	//! The edges between the prototypes
+	PrototypeGraph graph;
+
+	//! Bookkeeping for every class that has been seen
+	std::map<ILVQ_CLASS_REPRESENTATION, ILVQ_XSZ_CLASS> classes;
+
+	//! Search tree over the arena for the winner and runner-up
+	PrototypeIndex index;
+
+	//! Padded and aligned copy of the current input, so it can be compared against the arena
+	ILVQ_TYPE *query;
 
 	//! Temporary field, not meant to be accessed directly, just memory allocations
 	ILVQ_XSZ_PROTOTYPE_PAIR temp_winners;
+
+	//! Snapshot for batched classification, and whether the prototypes changed since it has been taken
+	PrototypeSnapshot batch;
+	bool modified;
+
+	//! Pool for batched classification
+	ThreadPool *pool;
 };
 
 }
@@ -0,0 +1,293 @@
+/**
+ * @brief Contiguous storage of prototype vectors with stable integer identifiers
+ * @file PrototypeArena.hpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author     Anne C. van Rossum
+ * @date       Oct 15, 2026
+ * @project    Replicator FP7
+ * @company    Almende B.V.
+ * @case       Machine learning (fit for Surveyeor robots)
+ */
+
+
+#ifndef PROTOTYPEARENA_HPP_
+#define PROTOTYPEARENA_HPP_
+
+#include <defs.h>
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <assert.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+namespace dobots {
+
+/**
+ * The squared Euclidean distance between two rows with a length that is a multiple of eight. The partial sums are
+ * kept per lane, in eight accumulators, and only added at the end. This plain loop can be vectorized by the
+ * compiler for any value type.
+ */
+template<typename T>
+inline T squared_distance_kernel(const T *a, const T *b, size_t size) {
+	T sum[8];
+	std::fill(sum, sum + 8, T(0));
+	for (size_t i = 0; i < size; i += 8) {
+		for (size_t j = 0; j < 8; ++j) {
+			T d = a[i+j] - b[i+j];
+			sum[j] += d * d;
+		}
+	}
+	return ((sum[0] + sum[4]) + (sum[2] + sum[6])) + ((sum[1] + sum[5]) + (sum[3] + sum[7]));
+}
+
+#if defined(__SSE__)
+/**
+ * The same kernel for floats with SSE intrinsics, for aligned rows. Lanes 0-3 and 4-7 are kept in two registers
+ * and the partial sums are added in the same order as above.
+ */
+inline float squared_distance_kernel(const float *a, const float *b, size_t size) {
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	for (size_t i = 0; i < size; i += 8) {
+		__m128 d0 = _mm_sub_ps(_mm_load_ps(a + i), _mm_load_ps(b + i));
+		__m128 d1 = _mm_sub_ps(_mm_load_ps(a + i + 4), _mm_load_ps(b + i + 4));
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(d0, d0));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(d1, d1));
+	}
+	__m128 sum = _mm_add_ps(sum0, sum1);
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum);
+}
+#endif
+
+/**
+ * All prototype vectors are stored in one block of memory, row after row. Every row is padded with zeros to a
+ * multiple of ILVQ_LANES values and starts at an address aligned to ILVQ_ALIGNMENT bytes, so a whole row can be
+ * handled with aligned vector loads without a scalar tail. A row is identified by its index, which stays the same
+ * for as long as the prototype lives, also when the block grows. Rows of removed prototypes are put on a free list
+ * and are reused by the next insert().
+ *
+ * The distance kernel runs over all rows in order and hence through memory linearly. It is the hot loop of
+ * ILVQ_XSZ, which has to find the winner and runner-up among all prototypes for every sample.
+ */
+class PrototypeArena {
+public:
+	//! Number of values a row is padded to (8 floats fill one AVX register, or two SSE registers)
+	static const size_t ILVQ_LANES = 8;
+
+	//! Alignment of every row in bytes
+	static const size_t ILVQ_ALIGNMENT = 32;
+
+	PrototypeArena(): values(NULL), dim(0), row_size(0), rows(0), reserved(0), count(0) {}
+
+	~PrototypeArena() {
+		release(values);
+	}
+
+	//! Set the dimension of the vectors, only possible as long as the arena is empty
+	void setDimension(size_t dimension) {
+		assert (!rows);
+		dim = dimension;
+		row_size = padded(dimension);
+	}
+
+	//! Dimension of the vectors
+	inline size_t dimension() const { return dim; }
+
+	//! Number of values in a row, the dimension plus the padding
+	inline size_t stride() const { return row_size; }
+
+	//! Number of prototypes that are stored
+	inline size_t size() const { return count; }
+
+	//! Number of rows in use, alive or on the free list, indices are always smaller than this
+	inline size_t end() const { return rows; }
+
+	//! True if the row with the given index contains a prototype
+	inline bool alive(ILVQ_PROTOTYPE_INDEX id) const {
+		return id >= 0 && (size_t)id < rows && used[id];
+	}
+
+	//! Start of row "id"
+	inline ILVQ_TYPE *operator[](ILVQ_PROTOTYPE_INDEX id) { return values + id * row_size; }
+
+	inline const ILVQ_TYPE *operator[](ILVQ_PROTOTYPE_INDEX id) const { return values + id * row_size; }
+
+	/**
+	 * Store a copy of the given vector and return its index. A free row is reused if there is one, otherwise a
+	 * row is added at the end. If the block is full, it doubles in size.
+	 */
+	ILVQ_PROTOTYPE_INDEX insert(const ILVQ_ASPECT & vector) {
+		assert (vector.size() == dim);
+		return insert(&vector[0]);
+	}
+
+	//! Store a copy of an array of dimension() values, see above
+	ILVQ_PROTOTYPE_INDEX insert(const ILVQ_TYPE *vector) {
+		ILVQ_PROTOTYPE_INDEX id;
+		if (!free_rows.empty()) {
+			id = free_rows.back();
+			free_rows.pop_back();
+		} else {
+			if (rows == reserved) reserve(reserved ? 2 * reserved : 16);
+			id = rows++;
+			used.push_back(false);
+		}
+		ILVQ_TYPE *row = (*this)[id];
+		std::copy(vector, vector + dim, row);
+		std::fill(row + dim, row + row_size, ILVQ_TYPE(0));
+		used[id] = true;
+		count++;
+		return id;
+	}
+
+	//! Remove the prototype with the given index, its row will be reused
+	void erase(ILVQ_PROTOTYPE_INDEX id) {
+		assert (alive(id));
+		used[id] = false;
+		free_rows.push_back(id);
+		count--;
+	}
+
+	/**
+	 * Fill an empty arena with "rows" padded rows that are copied from "block" at once. The rows listed in "free"
+	 * do not contain a prototype, and are reused in that order, see freeRows().
+	 */
+	void assign(const ILVQ_TYPE *block, size_t rows, const ILVQ_PROTOTYPE_INDEX *free, size_t free_count) {
+		assert (!this->rows);
+		if (!rows) return;
+		reserve(rows);
+		std::memcpy(values, block, rows * row_size * sizeof(ILVQ_TYPE));
+		this->rows = rows;
+		used.assign(rows, true);
+		free_rows.assign(free, free + free_count);
+		for (size_t i = 0; i < free_count; ++i) used[free[i]] = false;
+		count = rows - free_count;
+	}
+
+	//! The rows without a prototype, the last one is reused first
+	inline const std::vector<ILVQ_PROTOTYPE_INDEX> & freeRows() const { return free_rows; }
+
+	//! Remove all prototypes, after which the dimension can be set again
+	void clear() {
+		release(values);
+		values = NULL;
+		rows = reserved = count = 0;
+		used.clear();
+		free_rows.clear();
+	}
+
+	/**
+	 * Copy a vector into a padded row outside of the arena, such as one obtained from allocate(), so it can be
+	 * compared against the rows.
+	 */
+	void pad(const ILVQ_ASPECT & vector, ILVQ_TYPE *row) const {
+		if (vector.size() != dim) {
+			std::cerr << "Input size " << vector.size() << " while prototype size " << dim << std::endl;
+			assert (vector.size() == dim);
+		}
+		std::copy(vector.begin(), vector.end(), row);
+		std::fill(row + dim, row + row_size, ILVQ_TYPE(0));
+	}
+
+	/**
+	 * The squared Euclidean distance between a padded row "x" and every row in the arena. The result for row i is
+	 * written to distances[i], for i in [0,end()). Rows without a prototype get the maximum value.
+	 */
+	void distances(const ILVQ_TYPE *x, ILVQ_TYPE *distances) const {
+		const ILVQ_TYPE *row = values;
+		for (size_t i = 0; i < rows; ++i, row += row_size) {
+			distances[i] = used[i] ? squared_distance(x, row, row_size) : std::numeric_limits<ILVQ_TYPE>::max();
+		}
+	}
+
+	//! The squared Euclidean distance between a padded row "x" and row "id"
+	inline ILVQ_TYPE distance(const ILVQ_TYPE *x, ILVQ_PROTOTYPE_INDEX id) const {
+		return squared_distance(x, (*this)[id], row_size);
+	}
+
+	//! The squared Euclidean distance between the rows "id0" and "id1"
+	inline ILVQ_TYPE distance(ILVQ_PROTOTYPE_INDEX id0, ILVQ_PROTOTYPE_INDEX id1) const {
+		return squared_distance((*this)[id0], (*this)[id1], row_size);
+	}
+
+	//! Allocate an aligned row of "size" values, free with release()
+	static ILVQ_TYPE *allocate(size_t size) {
+		void *ptr = NULL;
+		if (posix_memalign(&ptr, ILVQ_ALIGNMENT, size * sizeof(ILVQ_TYPE))) {
+			std::cerr << "Could not allocate " << size << " prototype values" << std::endl;
+			assert (false);
+		}
+		return (ILVQ_TYPE*)ptr;
+	}
+
+	static void release(ILVQ_TYPE *ptr) {
+		free(ptr);
+	}
+
+	//! The dimension rounded up to a multiple of ILVQ_LANES
+	static inline size_t padded(size_t dimension) {
+		return (dimension + ILVQ_LANES - 1) / ILVQ_LANES * ILVQ_LANES;
+	}
+
+	//! The squared Euclidean distance between two aligned rows of "size" values, a multiple of ILVQ_LANES
+	static inline ILVQ_TYPE squared_distance(const ILVQ_TYPE *a, const ILVQ_TYPE *b, size_t size) {
+		return squared_distance_kernel(a, b, size);
+	}
+
+private:
+	//! Copying would leave two arenas with the same block
+	PrototypeArena(const PrototypeArena &);
+	PrototypeArena & operator=(const PrototypeArena &);
+
+	//! Make room for "capacity" rows, the existing rows are moved to the new block
+	void reserve(size_t capacity) {
+		ILVQ_TYPE *block = allocate(capacity * row_size);
+		if (values) std::memcpy(block, values, rows * row_size * sizeof(ILVQ_TYPE));
+		release(values);
+		values = block;
+		reserved = capacity;
+	}
+
+	//! The block with all rows
+	ILVQ_TYPE *values;
+
+	//! Dimension, and the padded dimension
+	size_t dim;
+	size_t row_size;
+
+	//! Rows in use, rows allocated, and number of prototypes
+	size_t rows;
+	size_t reserved;
+	size_t count;
+
+	//! Whether a row contains a prototype
+	std::vector<bool> used;
+
+	//! Rows that can be reused
+	std::vector<ILVQ_PROTOTYPE_INDEX> free_rows;
+};
+
+}
+
+#endif /* PROTOTYPEARENA_HPP_ */
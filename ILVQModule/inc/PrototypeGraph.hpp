@@ -0,0 +1,203 @@
+/**
+ * @brief Pooled, bidirectional adjacency structure for the edges between prototypes
+ * @file PrototypeGraph.hpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author     Anne C. van Rossum
+ * @date       Oct 15, 2026
+ * @project    Replicator FP7
+ * @company    Almende B.V.
+ * @case       Machine learning (fit for Surveyeor robots)
+ */
+
+
+#ifndef PROTOTYPEGRAPH_HPP_
+#define PROTOTYPEGRAPH_HPP_
+
+#include <defs.h>
+
+#include <vector>
+#include <assert.h>
+
+namespace dobots {
+
+//! Index of an edge in the pool
+typedef int ILVQ_EDGE_INDEX;
+
+//! A prototype index together with the generation of its row, so a stale reference can be detected
+struct ILVQ_PROTOTYPE_HANDLE {
+	ILVQ_PROTOTYPE_INDEX index;
+	unsigned int generation;
+};
+
+/**
+ * Directed edges between prototypes, where the prototypes are identified by their row in the PrototypeArena.
+ *
+ * The edges are allocated from slabs of ILVQ_SLAB edges that are never moved or freed while the graph exists, a
+ * deleted edge is put on a free list and is used again for the next edge. Every edge is in two intrusive doubly
+ * linked lists: the outgoing edges of its source and the incoming edges of its target. Hence adding or deleting an
+ * edge is O(1), and visiting or deleting all edges of a prototype is O(degree), without going through the rest of
+ * the graph.
+ *
+ * Each node has a generation that is incremented when the prototype in that row is released, so a handle to a
+ * prototype that has been removed, and of which the row might be used by a new prototype, can be recognized.
+ */
+class PrototypeGraph {
+public:
+	static const ILVQ_EDGE_INDEX NONE = -1;
+
+	//! Number of edges in one slab
+	static const size_t ILVQ_SLAB = 1024;
+
+	struct Edge {
+		ILVQ_PROTOTYPE_INDEX source;
+		ILVQ_PROTOTYPE_INDEX target;
+		int age;
+		ILVQ_TYPE length; // squared distance between source and target as counted by the user of the graph
+		ILVQ_EDGE_INDEX next_out, prev_out; // list of outgoing edges of source (next_out links the free list)
+		ILVQ_EDGE_INDEX next_in, prev_in; // list of incoming edges of target
+	};
+
+	PrototypeGraph(): free_edges(NONE), count(0) {}
+
+	~PrototypeGraph() {
+		for (size_t i = 0; i < slabs.size(); ++i) delete [] slabs[i];
+	}
+
+	//! Make sure there is a node for every index below "size"
+	void resize(size_t size) {
+		if (nodes.size() >= size) return;
+		Node node;
+		node.out = node.in = NONE;
+		node.out_degree = node.in_degree = 0;
+		node.generation = 0;
+		nodes.resize(size, node);
+	}
+
+	//! Number of edges
+	inline size_t size() const { return count; }
+
+	//! Number of edges that fit in the allocated slabs
+	inline size_t capacity() const { return slabs.size() * ILVQ_SLAB; }
+
+	inline Edge & operator[](ILVQ_EDGE_INDEX e) { return slabs[e / ILVQ_SLAB][e % ILVQ_SLAB]; }
+
+	inline const Edge & operator[](ILVQ_EDGE_INDEX e) const { return slabs[e / ILVQ_SLAB][e % ILVQ_SLAB]; }
+
+	//! First outgoing edge of a node, continue with Edge::next_out till NONE
+	inline ILVQ_EDGE_INDEX outgoing(ILVQ_PROTOTYPE_INDEX node) const { return nodes[node].out; }
+
+	//! First incoming edge of a node, continue with Edge::next_in till NONE
+	inline ILVQ_EDGE_INDEX incoming(ILVQ_PROTOTYPE_INDEX node) const { return nodes[node].in; }
+
+	inline int outDegree(ILVQ_PROTOTYPE_INDEX node) const { return nodes[node].out_degree; }
+
+	inline int inDegree(ILVQ_PROTOTYPE_INDEX node) const { return nodes[node].in_degree; }
+
+	//! Add an edge from source to target with age 0, in front of both lists
+	ILVQ_EDGE_INDEX add(ILVQ_PROTOTYPE_INDEX source, ILVQ_PROTOTYPE_INDEX target) {
+		if (free_edges == NONE) grow();
+		ILVQ_EDGE_INDEX e = free_edges;
+		Edge & edge = (*this)[e];
+		free_edges = edge.next_out;
+		edge.source = source;
+		edge.target = target;
+		edge.age = 0;
+		edge.length = ILVQ_TYPE(0);
+		Node & s = nodes[source], & t = nodes[target];
+		edge.prev_out = NONE;
+		edge.next_out = s.out;
+		if (s.out != NONE) (*this)[s.out].prev_out = e;
+		s.out = e;
+		s.out_degree++;
+		edge.prev_in = NONE;
+		edge.next_in = t.in;
+		if (t.in != NONE) (*this)[t.in].prev_in = e;
+		t.in = e;
+		t.in_degree++;
+		count++;
+		return e;
+	}
+
+	//! Take the edge out of both lists and put it on the free list
+	void erase(ILVQ_EDGE_INDEX e) {
+		Edge & edge = (*this)[e];
+		Node & s = nodes[edge.source], & t = nodes[edge.target];
+		if (edge.prev_out != NONE) (*this)[edge.prev_out].next_out = edge.next_out;
+		else s.out = edge.next_out;
+		if (edge.next_out != NONE) (*this)[edge.next_out].prev_out = edge.prev_out;
+		s.out_degree--;
+		if (edge.prev_in != NONE) (*this)[edge.prev_in].next_in = edge.next_in;
+		else t.in = edge.next_in;
+		if (edge.next_in != NONE) (*this)[edge.next_in].prev_in = edge.prev_in;
+		t.in_degree--;
+		edge.next_out = free_edges;
+		free_edges = e;
+		count--;
+	}
+
+	//! The node is not used anymore, it should not have edges left
+	void release(ILVQ_PROTOTYPE_INDEX node) {
+		assert (!nodes[node].out_degree && !nodes[node].in_degree);
+		nodes[node].generation++;
+	}
+
+	//! Handle to the prototype in row "node", or an invalid handle if node is negative
+	inline ILVQ_PROTOTYPE_HANDLE handle(ILVQ_PROTOTYPE_INDEX node) const {
+		ILVQ_PROTOTYPE_HANDLE h;
+		h.index = node;
+		h.generation = node < 0 ? 0 : nodes[node].generation;
+		return h;
+	}
+
+	//! False if the prototype the handle was obtained for has been released
+	inline bool valid(const ILVQ_PROTOTYPE_HANDLE & h) const {
+		return h.index >= 0 && (size_t)h.index < nodes.size() && nodes[h.index].generation == h.generation;
+	}
+
+private:
+	//! Copying would share the slabs
+	PrototypeGraph(const PrototypeGraph &);
+	PrototypeGraph & operator=(const PrototypeGraph &);
+
+	struct Node {
+		ILVQ_EDGE_INDEX out, in;
+		int out_degree, in_degree;
+		unsigned int generation;
+	};
+
+	//! Allocate another slab and put its edges on the free list
+	void grow() {
+		ILVQ_EDGE_INDEX first = capacity();
+		slabs.push_back(new Edge[ILVQ_SLAB]);
+		for (ILVQ_EDGE_INDEX e = first + ILVQ_SLAB - 1; e >= first; --e) {
+			(*this)[e].next_out = free_edges;
+			free_edges = e;
+		}
+	}
+
+	std::vector<Edge*> slabs;
+
+	std::vector<Node> nodes;
+
+	//! First edge on the free list
+	ILVQ_EDGE_INDEX free_edges;
+
+	//! Number of edges in use
+	size_t count;
+};
+
+}
+
+#endif /* PROTOTYPEGRAPH_HPP_ */
@@ -0,0 +1,414 @@
+/**
+ * @brief Dynamic k-d tree over the prototype arena for the winner and runner-up search
+ * @file PrototypeIndex.hpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author     Anne C. van Rossum
+ * @date       Oct 15, 2026
+ * @project    Replicator FP7
+ * @company    Almende B.V.
+ * @case       Machine learning (fit for Surveyeor robots)
+ */
+
+
+#ifndef PROTOTYPEINDEX_HPP_
+#define PROTOTYPEINDEX_HPP_
+
+#include <defs.h>
+#include <PrototypeArena.hpp>
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <assert.h>
+
+namespace dobots {
+
+/**
+ * A k-d tree over the rows of a PrototypeArena that finds the two prototypes closest to an input. The leaves hold
+ * buckets of row indices. A leaf that gets too full is split at the median of the dimension in which its
+ * prototypes are spread the most. Every node hence stands for a box ("cell") bounded by the split planes above it,
+ * and a subtree is skipped when the distance from the input to its cell is larger than the current runner-up.
+ *
+ * The index supports the three things that happen to prototypes in ILVQ: they are added, removed, and moved a bit
+ * toward or away from an input. After a move the prototype is looked up again from the root, and only if it has
+ * left the cell of its leaf it is taken out and inserted again. After as many changes as there are prototypes, or
+ * if insertions made the tree too deep, the tree is built again from scratch, which is O(n log n). Hence all
+ * updates are O(log n) amortized, and so is a query, as long as the prototypes lie on a manifold of a not too high
+ * dimension. In the worst case, uniform noise in many dimensions, a query visits every leaf, and nearest() falls
+ * back to a plain scan over the arena.
+ *
+ * The result is exactly the same as that of a linear scan over the arena in order of row index: the same kernel is
+ * used for the distances, and ties are broken in favour of the lowest row index.
+ */
+class PrototypeIndex {
+public:
+	//! Number of queries over which the cost of the tree is measured
+	static const size_t ILVQ_PROBE = 256;
+
+	PrototypeIndex(const PrototypeArena & arena, size_t leaf_size = 16): arena(arena), leaf_size(leaf_size),
+			count(0), changes(0), depth_limit(8), scanning(false), queries(0), evaluations(0) {
+		clear();
+	}
+
+	//! Number of prototypes in the index
+	inline size_t size() const { return count; }
+
+	//! Add row "id" of the arena to the index
+	void insert(ILVQ_PROTOTYPE_INDEX id) {
+		if (leaves.size() < arena.end()) {
+			leaves.resize(arena.end(), NONE);
+			slots.resize(arena.end(), NONE);
+		}
+		assert (leaves[id] == NONE);
+		int depth = 0;
+		int n = find(arena[id], depth);
+		add(n, id);
+		count++;
+		if (nodes[n].bucket.size() > leaf_size) split(n);
+		if (++changes > std::max(count, leaf_size) || depth > depth_limit) rebuild();
+	}
+
+	//! Remove row "id" of the arena from the index
+	void erase(ILVQ_PROTOTYPE_INDEX id) {
+		remove(id);
+		count--;
+		if (++changes > std::max(count, leaf_size)) rebuild();
+	}
+
+	//! Row "id" of the arena has been changed, put it in the right leaf again
+	void move(ILVQ_PROTOTYPE_INDEX id) {
+		int depth = 0;
+		int n = find(arena[id], depth);
+		if (n == leaves[id]) return;
+		remove(id);
+		add(n, id);
+		if (nodes[n].bucket.size() > leaf_size) split(n);
+		if (++changes > std::max(count, leaf_size) || depth > depth_limit) rebuild();
+	}
+
+	/**
+	 * The closest and second closest prototype to the padded row "x", with their squared distances. If there are
+	 * less than two prototypes, the missing ones are set to -1.
+	 *
+	 * In many dimensions hardly any cell can be skipped and the tree only adds overhead. Hence, the number of
+	 * distances computed per query is tracked, and if the tree computes more than half of them over ILVQ_PROBE
+	 * queries, the next 16 ILVQ_PROBE queries scan the arena instead. Both give the same result.
+	 */
+	void nearest(const ILVQ_TYPE *x, ILVQ_PROTOTYPE_INDEX & first, ILVQ_TYPE & first_distance,
+			ILVQ_PROTOTYPE_INDEX & second, ILVQ_TYPE & second_distance) {
+		size_t computed = nearest(x, scanning, first, first_distance, second, second_distance);
+		if (scanning) {
+			if (++queries == 16 * ILVQ_PROBE) {
+				scanning = false;
+				queries = evaluations = 0;
+			}
+		} else {
+			evaluations += computed;
+			if (++queries == ILVQ_PROBE) {
+				scanning = evaluations > queries * count / 2;
+				queries = evaluations = 0;
+			}
+		}
+	}
+
+	/**
+	 * The same, through the tree or by a scan over the arena, without any bookkeeping so it can be called from
+	 * several threads at once. Returns the number of distances that have been computed.
+	 */
+	size_t nearest(const ILVQ_TYPE *x, bool scan, ILVQ_PROTOTYPE_INDEX & first, ILVQ_TYPE & first_distance,
+			ILVQ_PROTOTYPE_INDEX & second, ILVQ_TYPE & second_distance) const {
+		Search search;
+		search.x = x;
+		search.offsets.assign(arena.dimension(), ILVQ_TYPE(0));
+		search.first = search.second = -1;
+		search.first_distance = search.second_distance = std::numeric_limits<ILVQ_TYPE>::max();
+		// the distance to a cell and the distance to a prototype are summed in a different order, so the pruning
+		// has a relative margin for the rounding errors of both
+		search.slack = ILVQ_TYPE(1) - 4 * (arena.dimension() + 1) * std::numeric_limits<ILVQ_TYPE>::epsilon();
+		search.evaluations = 0;
+		if (scan) {
+			scan_all(search);
+		} else if (count) {
+			visit(0, ILVQ_TYPE(0), search);
+		}
+		first = search.first;
+		first_distance = search.first_distance;
+		second = search.second;
+		second_distance = search.second_distance;
+		return search.evaluations;
+	}
+
+	//! Remove all prototypes from the index, for when the arena has been cleared
+	void reset() {
+		leaves.clear();
+		slots.clear();
+		clear();
+		count = changes = 0;
+		scanning = false;
+		queries = evaluations = 0;
+	}
+
+	//! Build the tree again from all rows that are in the index
+	void rebuild() {
+		std::vector<ILVQ_PROTOTYPE_INDEX> ids;
+		ids.reserve(count);
+		for (size_t i = 0; i < leaves.size(); ++i) {
+			if (leaves[i] != NONE) ids.push_back(i);
+		}
+		clear();
+		if (!ids.empty()) build(0, ids.begin(), ids.end());
+		changes = 0;
+		depth_limit = 2 * log2(count / leaf_size + 1) + 8;
+	}
+
+private:
+	enum { NONE = -1 };
+
+	//! An inner node has two children, a leaf has a bucket of row indices
+	struct Node {
+		int dimension;
+		ILVQ_TYPE split;
+		int children[2];
+		std::vector<ILVQ_PROTOTYPE_INDEX> bucket;
+	};
+
+	//! State of one query, on the stack, so queries can run in parallel
+	struct Search {
+		const ILVQ_TYPE *x;
+		std::vector<ILVQ_TYPE> offsets;
+		ILVQ_TYPE slack;
+		ILVQ_PROTOTYPE_INDEX first, second;
+		ILVQ_TYPE first_distance, second_distance;
+		size_t evaluations;
+	};
+
+	inline static bool is_leaf(const Node & node) { return node.children[0] == NONE; }
+
+	inline static int log2(size_t n) {
+		int l = 0;
+		while (n >>= 1) l++;
+		return l;
+	}
+
+	//! Remove all nodes and leave an empty root leaf
+	void clear() {
+		nodes.clear();
+		nodes.push_back(leaf());
+		std::fill(leaves.begin(), leaves.end(), NONE);
+		std::fill(slots.begin(), slots.end(), NONE);
+	}
+
+	static Node leaf() {
+		Node node;
+		node.dimension = 0;
+		node.split = ILVQ_TYPE(0);
+		node.children[0] = node.children[1] = NONE;
+		return node;
+	}
+
+	//! The leaf of which the cell contains "x", and its depth
+	int find(const ILVQ_TYPE *x, int & depth) const {
+		int n = 0;
+		for (depth = 0; !is_leaf(nodes[n]); ++depth) {
+			n = nodes[n].children[x[nodes[n].dimension] < nodes[n].split ? 0 : 1];
+		}
+		return n;
+	}
+
+	inline void add(int n, ILVQ_PROTOTYPE_INDEX id) {
+		leaves[id] = n;
+		slots[id] = nodes[n].bucket.size();
+		nodes[n].bucket.push_back(id);
+	}
+
+	//! Take "id" out of its bucket, the last element of the bucket takes its place
+	void remove(ILVQ_PROTOTYPE_INDEX id) {
+		assert (leaves[id] != NONE);
+		std::vector<ILVQ_PROTOTYPE_INDEX> & bucket = nodes[leaves[id]].bucket;
+		ILVQ_PROTOTYPE_INDEX last = bucket.back();
+		bucket[slots[id]] = last;
+		slots[last] = slots[id];
+		bucket.pop_back();
+		leaves[id] = slots[id] = NONE;
+	}
+
+	/**
+	 * Choose a split for the prototypes in [begin,end): the dimension with the largest spread and, in that
+	 * dimension, a value close to the median such that both sides are non-empty. Returns false if all prototypes
+	 * are at the same position.
+	 */
+	template<typename Iterator>
+	bool choose(Iterator begin, Iterator end, int & dimension, ILVQ_TYPE & split) const {
+		ILVQ_TYPE spread = ILVQ_TYPE(0);
+		dimension = 0;
+		for (size_t d = 0; d < arena.dimension(); ++d) {
+			ILVQ_TYPE lo = arena[*begin][d], hi = lo;
+			for (Iterator i = begin; i != end; ++i) {
+				lo = std::min(lo, arena[*i][d]);
+				hi = std::max(hi, arena[*i][d]);
+			}
+			if (hi - lo > spread) {
+				spread = hi - lo;
+				dimension = d;
+			}
+		}
+		if (spread == ILVQ_TYPE(0)) return false;
+		std::vector<ILVQ_TYPE> values;
+		values.reserve(end - begin);
+		for (Iterator i = begin; i != end; ++i) values.push_back(arena[*i][dimension]);
+		std::sort(values.begin(), values.end());
+		// the smallest value that is larger than its predecessor, as close to the median as possible
+		size_t half = values.size() / 2, k;
+		for (k = std::max(half, size_t(1)); k < values.size() && values[k] == values[k-1]; ++k);
+		if (k == values.size()) {
+			for (k = half; values[k] == values[k-1]; --k);
+		}
+		split = values[k];
+		return true;
+	}
+
+	//! Split a leaf with a full bucket into two leaves
+	void split(int n) {
+		std::vector<ILVQ_PROTOTYPE_INDEX> bucket;
+		int dimension;
+		ILVQ_TYPE value;
+		if (!choose(nodes[n].bucket.begin(), nodes[n].bucket.end(), dimension, value)) return;
+		bucket.swap(nodes[n].bucket);
+		int children[2] = { (int)nodes.size(), (int)nodes.size() + 1 };
+		nodes.push_back(leaf());
+		nodes.push_back(leaf());
+		nodes[n].dimension = dimension;
+		nodes[n].split = value;
+		nodes[n].children[0] = children[0];
+		nodes[n].children[1] = children[1];
+		for (size_t i = 0; i < bucket.size(); ++i) {
+			add(children[arena[bucket[i]][dimension] < value ? 0 : 1], bucket[i]);
+		}
+	}
+
+	//! Build the subtree in node "n" for the prototypes in [begin,end)
+	void build(int n, std::vector<ILVQ_PROTOTYPE_INDEX>::iterator begin,
+			std::vector<ILVQ_PROTOTYPE_INDEX>::iterator end) {
+		int dimension;
+		ILVQ_TYPE value;
+		if ((size_t)(end - begin) <= leaf_size || !choose(begin, end, dimension, value)) {
+			for (; begin != end; ++begin) add(n, *begin);
+			return;
+		}
+		std::vector<ILVQ_PROTOTYPE_INDEX>::iterator middle = std::partition(begin, end,
+				below(arena, dimension, value));
+		int children[2] = { (int)nodes.size(), (int)nodes.size() + 1 };
+		nodes.push_back(leaf());
+		nodes.push_back(leaf());
+		nodes[n].dimension = dimension;
+		nodes[n].split = value;
+		nodes[n].children[0] = children[0];
+		nodes[n].children[1] = children[1];
+		build(children[0], begin, middle);
+		build(children[1], middle, end);
+	}
+
+	//! Predicate for a prototype that lies on the lower side of a split
+	class below {
+		const PrototypeArena & arena_;
+		int dimension_;
+		ILVQ_TYPE split_;
+	public:
+		below(const PrototypeArena & arena, int dimension, ILVQ_TYPE split): arena_(arena), dimension_(dimension),
+				split_(split) {}
+		bool operator()(ILVQ_PROTOTYPE_INDEX id) const {
+			return arena_[id][dimension_] < split_;
+		}
+	};
+
+	/**
+	 * Visit node "n" of which the cell is at squared distance "cell" from the input. The side of the split with
+	 * the input is visited first. The other side is further away in one more dimension, the offset in that
+	 * dimension is replaced (Arya and Mount, 1993), and it is visited only if it can contain a closer prototype.
+	 */
+	void visit(int n, ILVQ_TYPE cell, Search & search) const {
+		const Node & node = nodes[n];
+		if (is_leaf(node)) {
+			search.evaluations += node.bucket.size();
+			for (size_t i = 0; i < node.bucket.size(); ++i) {
+				ILVQ_PROTOTYPE_INDEX id = node.bucket[i];
+				consider(id, arena.distance(search.x, id), search);
+			}
+			return;
+		}
+		ILVQ_TYPE offset = search.x[node.dimension] - node.split;
+		int near = offset < 0 ? 0 : 1;
+		visit(node.children[near], cell, search);
+		ILVQ_TYPE previous = search.offsets[node.dimension];
+		ILVQ_TYPE far_cell = cell - previous * previous + offset * offset;
+		if (far_cell * search.slack > search.second_distance) return;
+		search.offsets[node.dimension] = offset;
+		visit(node.children[1 - near], far_cell, search);
+		search.offsets[node.dimension] = previous;
+	}
+
+	//! Compute the distance to all prototypes, in order of row index
+	void scan_all(Search & search) const {
+		for (size_t id = 0; id < leaves.size(); ++id) {
+			if (leaves[id] != NONE) consider(id, arena.distance(search.x, id), search);
+		}
+		search.evaluations += count;
+	}
+
+	//! Keep the two smallest (distance, index) pairs, the same order as the linear scan ends up with
+	inline static void consider(ILVQ_PROTOTYPE_INDEX id, ILVQ_TYPE distance, Search & search) {
+		if (distance < search.first_distance || (distance == search.first_distance && id < search.first)) {
+			search.second = search.first;
+			search.second_distance = search.first_distance;
+			search.first = id;
+			search.first_distance = distance;
+		} else if (distance < search.second_distance || (distance == search.second_distance &&
+				id < search.second)) {
+			search.second = id;
+			search.second_distance = distance;
+		}
+	}
+
+	//! Copying would share the arena, but not keep the index up to date
+	PrototypeIndex(const PrototypeIndex &);
+	PrototypeIndex & operator=(const PrototypeIndex &);
+
+	//! The prototypes
+	const PrototypeArena & arena;
+
+	//! Maximum number of prototypes in a leaf (unless they are all at the same position)
+	size_t leaf_size;
+
+	//! All nodes, the root is node 0
+	std::vector<Node> nodes;
+
+	//! For every row of the arena the leaf it is in, and its position in the bucket of that leaf
+	std::vector<int> leaves;
+	std::vector<int> slots;
+
+	//! Number of prototypes, changes since the last rebuild, and the depth that triggers a rebuild
+	size_t count;
+	size_t changes;
+	int depth_limit;
+
+	//! Whether queries currently scan the arena, and the number of queries and distances since the last decision
+	bool scanning;
+	size_t queries;
+	size_t evaluations;
+};
+
+}
+
+#endif /* PROTOTYPEINDEX_HPP_ */
@@ -0,0 +1,135 @@
+/**
+ * @brief Read-only copy of the prototypes of an ILVQ network for batched, multithreaded classification
+ * @file PrototypeSnapshot.hpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author     Anne C. van Rossum
+ * @date       Oct 15, 2026
+ * @project    Replicator FP7
+ * @company    Almende B.V.
+ * @case       Machine learning (fit for Surveyeor robots)
+ */
+
+
+#ifndef PROTOTYPESNAPSHOT_HPP_
+#define PROTOTYPESNAPSHOT_HPP_
+
+#include <defs.h>
+#include <PrototypeArena.hpp>
+#include <PrototypeIndex.hpp>
+#include <ThreadPool.hpp>
+
+#include <vector>
+#include <algorithm>
+
+namespace dobots {
+
+/**
+ * A copy of the prototype vectors and their labels, with its own search tree. It does not refer to the network it is
+ * taken from, so the network can be trained further while the snapshot classifies, also from another thread.
+ *
+ * The prototypes are stored in the order of their index in the network, so the winner for an input, also in case
+ * of a tie, is the same as the one the network itself would return at the moment the snapshot was taken.
+ *
+ * A batch of inputs is split in chunks of ILVQ_CHUNK inputs that are classified in parallel on a ThreadPool. The
+ * snapshot is only read during classification, every chunk has its own query buffer and its own decision whether
+ * to use the tree or to scan all prototypes (see PrototypeIndex::nearest).
+ */
+class PrototypeSnapshot {
+public:
+	//! Number of inputs in one chunk of a batch
+	static const size_t ILVQ_CHUNK = 256;
+
+	PrototypeSnapshot(): index(arena) {}
+
+	//! Remove all prototypes and set the dimension for the next ones
+	void clear(size_t dimension) {
+		index.reset();
+		arena.clear();
+		arena.setDimension(dimension);
+		labels.clear();
+	}
+
+	//! Add a prototype, an array of dimension() values, with its label
+	void add(const ILVQ_TYPE *prototype, ILVQ_CLASS_REPRESENTATION label) {
+		ILVQ_PROTOTYPE_INDEX id = arena.insert(prototype);
+		index.insert(id);
+		labels.push_back(label);
+	}
+
+	//! Number of prototypes
+	inline size_t size() const { return arena.size(); }
+
+	inline size_t dimension() const { return arena.dimension(); }
+
+	/**
+	 * Classify "count" inputs of dimension() values each, stored row after row in "inputs". The label of the winner
+	 * for input i is written to labels[i], and if "distances" is not NULL, the squared distance to the winner to
+	 * distances[i]. Without prototypes the label is -1 and the distance the maximum value. With a NULL pool
+	 * everything runs on the calling thread.
+	 */
+	void classify(const ILVQ_TYPE *inputs, size_t count, ILVQ_CLASS_REPRESENTATION *labels,
+			ILVQ_TYPE *distances = NULL, ThreadPool *pool = NULL) const {
+		size_t chunks = (count + ILVQ_CHUNK - 1) / ILVQ_CHUNK;
+		ThreadPool::job_t job = [&](size_t c) {
+			size_t begin = c * ILVQ_CHUNK, end = std::min(count, begin + ILVQ_CHUNK);
+			classifyChunk(inputs, begin, end, labels, distances);
+		};
+		if (pool) {
+			pool->run(chunks, job);
+		} else {
+			for (size_t c = 0; c < chunks; ++c) job(c);
+		}
+	}
+
+private:
+	//! Copying would leave the index of the copy pointing to the arena of the original
+	PrototypeSnapshot(const PrototypeSnapshot &);
+	PrototypeSnapshot & operator=(const PrototypeSnapshot &);
+
+	/**
+	 * Classify inputs [begin,end) of the batch. The first ILVQ_PROBE / 8 inputs go through the tree, and if it
+	 * computed more than half of all distances for them, the rest of the chunk scans the prototypes instead.
+	 */
+	void classifyChunk(const ILVQ_TYPE *inputs, size_t begin, size_t end, ILVQ_CLASS_REPRESENTATION *labels,
+			ILVQ_TYPE *distances) const {
+		const size_t D = arena.dimension();
+		ILVQ_TYPE *query = PrototypeArena::allocate(arena.stride());
+		std::fill(query, query + arena.stride(), ILVQ_TYPE(0));
+		const size_t probe = PrototypeIndex::ILVQ_PROBE / 8;
+		size_t evaluations = 0;
+		bool scan = false;
+		for (size_t i = begin; i < end; ++i) {
+			std::copy(inputs + i * D, inputs + (i + 1) * D, query);
+			ILVQ_PROTOTYPE_INDEX first, second;
+			ILVQ_TYPE first_distance, second_distance;
+			evaluations += index.nearest(query, scan, first, first_distance, second, second_distance);
+			if (i - begin + 1 == probe) scan = evaluations > probe * arena.size() / 2;
+			labels[i] = first >= 0 ? this->labels[first] : -1;
+			if (distances) distances[i] = first_distance;
+		}
+		PrototypeArena::release(query);
+	}
+
+	//! The prototypes, and a tree over them
+	PrototypeArena arena;
+	PrototypeIndex index;
+
+	//! Label per prototype
+	std::vector<ILVQ_CLASS_REPRESENTATION> labels;
+};
+
+}
+
+#endif /* PROTOTYPESNAPSHOT_HPP_ */
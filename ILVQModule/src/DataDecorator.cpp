@@ -26,6 +26,8 @@
 #include <iostream>
 #include <locale>
 #include <vector>
+#include <algorithm>
+#include <iomanip>
 #include <assert.h>
 #include <cmath>
 #include <stdio.h>
@@ -39,7 +41,8 @@ using namespace std;
  * Implementation of DataContainer
  * **************************************************************************************/
 
-DataContainer::DataContainer(): id(-1) {
+DataContainer::DataContainer(): id(-1), dataType(DT_HISTOGRAM), histogram_data(NULL), float_data(NULL),
+		float_data_len(0) {
 
 }
 
@@ -54,15 +57,15 @@ DataContainer::~DataContainer() {
  */
 float DataContainer::CalculateSlope() {
 	// alpha estimation = 1 + n [ sum_i^N ln (x_i / (x_min - 1/2) ) ]^-1
-	if (dataType != DT_MAP) return -1.0;
+	if (dataType != DT_HISTOGRAM) return -1.0;
 	float alpha;
 	int x_min = 1; float denom = 1.0 /(x_min - 0.5);
 
 //	int x_max = 10000;
 
 	float sum = 0; int N = 0;
-	std::map<DataDecoratorType,int>::iterator it;
-	for (it = map_data->begin(); it != map_data->end(); ++it) {
+	DataDecoratorHistogram::const_iterator it;
+	for (it = histogram_data->begin(); it != histogram_data->end(); ++it) {
 		int value = it->first;
 		if (value < x_min) continue;
 //		if (value > x_max) continue;
@@ -81,7 +84,7 @@ float DataContainer::CalculateSlope() {
  */
 int DataContainer::size() {
 	switch(dataType) {
-	case DT_MAP: assert (map_data != NULL); return map_data->size();
+	case DT_HISTOGRAM: assert (histogram_data != NULL); return histogram_data->size();
 	case DT_F2DARRAY: return float_data_len;
 	default:
 		cerr << "Size: Unknown data type" << endl;
@@ -96,16 +99,12 @@ float DataContainer::item<float>(int index) {
 }
 
 /**
- * Actually, this function is quite "stupid". A map is not a random access container, so having
- * an index doesn't make sense. A call to item is of order O(N) (and not of order O(1)). However,
- * if it is only used once for plotting or so, everything might be fine.
+ * The histogram is an array, so this is O(1), and iterating over all items by index is O(N).
  */
 template<>
 pair<DataDecoratorType,int> DataContainer::item< pair<DataDecoratorType,int> >(int index) {
-	assert (dataType == DT_MAP);
-	std::map<DataDecoratorType,int>::iterator it( map_data->begin() );
-	std::advance( it, index );
-	return *it;
+	assert (dataType == DT_HISTOGRAM);
+	return (*histogram_data)[index];
 }
 
 /**
@@ -126,16 +125,28 @@ struct colonsep: std::ctype<char> {
 	}
 };
 
+//! Compare histogram entries on value only, for sorting and removing duplicates
+static bool less_value(const pair<DataDecoratorType,int> & a, const pair<DataDecoratorType,int> & b) {
+	return a.first < b.first;
+}
+
+static bool equal_value(const pair<DataDecoratorType,int> & a, const pair<DataDecoratorType,int> & b) {
+	return a.first == b.first;
+}
+
 /**
- * Read data from a file. Only DT_MAP is tested. With an array it is hard to set the
- * size beforehand properly (except if you know what to retrieve).
+ * Read data from a file. Only DT_HISTOGRAM is tested. With an array it is hard to set the
+ * size beforehand properly (except if you know what to retrieve). The lines are appended and
+ * sorted afterwards, only if they were not in order already. Of lines with the same value the
+ * first one is kept.
  */
 void DataContainer::read(std::istream& in) { //, DataDecoratorType resolution) {
 	DataDecoratorType x;
 	switch(dataType) {
-	case DT_MAP:
-		assert (map_data != NULL);
-		map_data->clear();
+	case DT_HISTOGRAM: {
+		assert (histogram_data != NULL);
+		DataDecoratorHistogram & data = *histogram_data;
+		data.clear();
 		int y;
 		in.imbue(std::locale(std::locale(), new colonsep));
 
@@ -144,12 +155,19 @@ void DataContainer::read(std::istream& in) { //, DataDecoratorType resolution) {
 //				int x_ins = (int)(x * resolution);
 //				x = x_ins / (DataDecoratorType)resolution;
 //			}
-			map_data->insert(make_pair<DataDecoratorType,int>(x, y));
+			data.push_back(std::pair<DataDecoratorType,int>(x, y));
 			assert(y != 0);
 //			cout << "x and y: " << x << " and " << y << endl;
 		}
-//		cout << "Read " << map_data->size() << " items" << endl;
+		bool in_order = true;
+		for (size_t i = 1; i < data.size() && in_order; ++i) in_order = data[i-1].first < data[i].first;
+		if (!in_order) {
+			std::stable_sort(data.begin(), data.end(), less_value);
+			data.erase(std::unique(data.begin(), data.end(), equal_value), data.end());
+		}
+//		cout << "Read " << data.size() << " items" << endl;
 		break;
+	}
 	case DT_F2DARRAY:
 		assert (float_data != NULL);
 		int ix;
@@ -171,15 +189,15 @@ void DataContainer::read(std::istream& in) { //, DataDecoratorType resolution) {
 }
 
 /**
- * Write map_data to a file
+ * Write histogram_data to a file
  */
 void DataContainer::write(std::ostream& out) {
-	std::map<DataDecoratorType,int>::const_iterator i;
+	DataDecoratorHistogram::const_iterator i;
 	out << fixed << setprecision (10);
 	switch(dataType) {
-	case DT_MAP:
-		assert (map_data != NULL);
-		for (i = map_data->begin(); i != map_data->end(); ++i) {
+	case DT_HISTOGRAM:
+		assert (histogram_data != NULL);
+		for (i = histogram_data->begin(); i != histogram_data->end(); ++i) {
 			out << i->first << ": " << i->second << "\n";
 		}
 		break;
@@ -193,9 +211,9 @@ void DataContainer::write(std::ostream& out) {
 
 void DataContainer::clear() {
 	switch(dataType) {
-	case DT_MAP:
-		assert (map_data != NULL);
-		map_data->clear();
+	case DT_HISTOGRAM:
+		assert (histogram_data != NULL);
+		histogram_data->clear();
 		break;
 	default:
 		cerr << "Clear: Unknown data type" << endl;
@@ -203,21 +221,19 @@ void DataContainer::clear() {
 }
 
 void DataContainer::ApplyBins(int no_bins, DataDecoratorType min, DataDecoratorType max) {
-	assert (dataType == DT_MAP);
+	assert (dataType == DT_HISTOGRAM);
 
 //	write(std::cout);
 
-	std::map<DataDecoratorType,int>::const_iterator i;
+	// the histogram is sorted, so every entry is appended to the counter in O(1)
+	DataDecoratorHistogram::const_iterator i;
 	EventCounter<DataDecoratorType> ec;
-	for (i = map_data->begin(); i != map_data->end(); ++i) {
+	for (i = histogram_data->begin(); i != histogram_data->end(); ++i) {
 		ec.AddEvent(i->first, i->second);
 	}
 	ec.Bin(no_bins, min, max);
 
-	map_data->clear();
-	for (i = ec.getEvents().begin(); i != ec.getEvents().end(); ++i) {
-		map_data->insert(make_pair<DataDecoratorType,int>(i->first, i->second));
-	}
+	*histogram_data = ec.getEvents();
 
 //	cout << "After bins: " << endl;
 //	write(std::cout);
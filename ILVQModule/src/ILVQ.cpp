@@ -119,9 +119,21 @@ void ILVQ::decreaseDistance(ILVQ_PROTOTYPE & prototype, const ILVQ_ASPECT & inpu
 			op_adjust<ILVQ_TYPE>(-mu));
 }
 
+void ILVQ::increaseDistance(ILVQ_TYPE *prototype, const ILVQ_ASPECT & input, ILVQ_TYPE mu) {
+	std::transform(prototype, prototype + input.size(), input.begin(), prototype, op_adjust<ILVQ_TYPE>(mu));
+}
+
+void ILVQ::decreaseDistance(ILVQ_TYPE *prototype, const ILVQ_ASPECT & input, ILVQ_TYPE mu) {
+	std::transform(prototype, prototype + input.size(), input.begin(), prototype, op_adjust<ILVQ_TYPE>(-mu));
+}
+
 void ILVQ::print(ILVQ_ASPECT & vector) {
+	print(vector.empty() ? NULL : &vector[0], vector.size());
+}
+
+void ILVQ::print(const ILVQ_TYPE *vector, size_t size) {
 	cout << "[";
-	for (unsigned int i = 0; i < vector.size(); ++i) {
+	for (unsigned int i = 0; i < size; ++i) {
 		cout << vector[i] << " ";
 	}
 	cout << "]";
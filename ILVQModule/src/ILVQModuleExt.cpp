@@ -22,14 +22,40 @@ using namespace rur;
 //! Replace with your own code
 ILVQModuleExt::ILVQModuleExt() {
 	ilvq = new dobots::ILVQ_XSZ();
+	ilvq->setThreadPool(&pool);
 	sample_dimension = 0;
+	trained = 0;
+	checkpoint_file = "ilvq.model";
+	if (checkpoint.load(checkpoint_file) && ilvq->restore(checkpoint)) {
+		sample_dimension = checkpoint.header().dimension;
+		std::cout << "Continue with " << ilvq->getPrototypeCount() << " prototypes from checkpoint " <<
+				checkpoint_file << std::endl;
+	}
+	checkpoint.clear();
 }
 
 //! Replace with your own code
 ILVQModuleExt::~ILVQModuleExt() {
+	if (trained) WriteCheckpoint();
+	if (writer.joinable()) writer.join();
 	if (ilvq) delete ilvq;
 }
 
+/**
+ * Only copying the network into the checkpoint stops the training, writing it to disk is done by another thread. A
+ * previous write is waited for first, it had a whole interval of training samples to finish.
+ */
+void ILVQModuleExt::WriteCheckpoint() {
+	if (writer.joinable()) writer.join();
+	ilvq->checkpoint(checkpoint);
+	trained = 0;
+	writer = std::thread([this] {
+		if (checkpoint.write(checkpoint_file)) {
+			std::cout << "Wrote checkpoint to " << checkpoint_file << std::endl;
+		}
+	});
+}
+
 //! Replace with your own code
 void ILVQModuleExt::Tick() {
 	long_seq *train_samples = readTraining(false);
@@ -47,20 +73,31 @@ void ILVQModuleExt::Tick() {
 		dobots::extract_copy(train_samples->begin(), train_samples->end(),
 				train_samples->begin()+sample_dimension, values.begin(), label);
 		ilvq->add(values, label);
+		if (++trained == ILVQ_CHECKPOINT_INTERVAL) WriteCheckpoint();
 	}
-	long_seq *test_samples = readTesting(false);
-	if (test_samples) {
-		if (test_samples->size() != sample_dimension - 1) {
-			std::cerr << "Test sample should be training sample size without the label element, so one less!" << std::endl;
-			return;
+	// all test samples that are waiting are classified in one batch, against the prototypes as they are now
+	test_values.clear();
+	size_t count = 0;
+	for (size_t read = 0; read < ILVQ_BATCH; ++read) {
+		long_seq *test_samples = readTesting(false);
+		if (!test_samples || test_samples->empty()) break;
+		if (test_samples->size() == (size_t)sample_dimension) {
+			test_values.insert(test_values.end(), test_samples->begin(), test_samples->end());
+			count++;
+		} else {
+			std::cerr << "Test sample should be training sample size without the label element, so one less! "
+					"Skipped" << std::endl;
 		}
-		std::vector<float> values;
-		values.resize(sample_dimension,0);
-		std::copy(test_samples->begin(), test_samples->end(), values.begin());
-		int label = ilvq->classify(values);
+		// the port hands out the same buffer again, it is empty until the next sample arrives
+		test_samples->clear();
+	}
+	if (!count) return;
+	test_labels.resize(count);
+	ilvq->classify(&test_values[0], count, &test_labels[0]);
 
-		// write to output
-		writeResult(label);
+	// write to output
+	for (size_t i = 0; i < count; ++i) {
+		writeResult(test_labels[i]);
 	}
 }
 
@@ -39,12 +39,16 @@ ILVQ_XSZ::ILVQ_XSZ(int ageOld, ILVQ_TYPE mu1, ILVQ_TYPE mu2, int lambda): ageOld
 		mu1(mu1),
 		mu2(mu2),
 		lambda(lambda),
-		lambda_i(0) {
+		lambda_i(0),
+		index(arena),
+		query(NULL),
+		modified(false),
+		pool(NULL) {
 	debug = LOG_ERR;
 }
 
 ILVQ_XSZ::~ILVQ_XSZ() {
-
+	PrototypeArena::release(query);
 }
 
 void ILVQ_XSZ::add(ILVQ_ASPECT & input, ILVQ_CLASS_REPRESENTATION & class_rep) {
@@ -53,29 +57,22 @@ void ILVQ_XSZ::add(ILVQ_ASPECT & input, ILVQ_CLASS_REPRESENTATION & class_rep) {
 		print(input);
 		cout << ", class=" << class_rep << endl;
 	}
+	modified = true;
 	getClosePrototypes(input, temp_winners);
-	if (isNewPrototype(input, class_rep, temp_winners)) {
-		ILVQ_XSZ_PROTOTYPE *p = new ILVQ_XSZ_PROTOTYPE();
-		p->T_s = 0;
-		p->class_id = class_rep;
-		p->outgoing_connections = new ILVQ_XSZ_CONNECTIONS();
-		p->prototype = new ILVQ_ASPECT(input);
-		//		*p->prototype = input;
-		assert (p->prototype->size() == input.size());
-		p->winner_count = 0;
-		prototypes.insert(p);
+	if (isNewPrototype(class_rep, temp_winners)) {
+		ILVQ_XSZ_PROTOTYPE *p = addPrototype(input, class_rep);
 		updateThreshold(*p);
-	} else
+	} else {
 		// additional check for emptiness, but should be only the first two times
-		if (temp_winners.s1 && temp_winners.s2) {
-			addEdge(temp_winners.s1, temp_winners.s2);
-			updateLearningRates(*temp_winners.s1);
-			updatePrototype(*temp_winners.s1, input, class_rep);
-			updateThreshold(*temp_winners.s1);
-			deleteEdges();
+		ILVQ_XSZ_PROTOTYPE *s1 = prototype(temp_winners.s1), *s2 = prototype(temp_winners.s2);
+		if (s1 && s2) {
+			addEdge(s1, s2);
+			updateLearningRates(*s1);
+			updatePrototype(*s1, input, class_rep);
+			updateThreshold(*s1);
+			deleteEdges(*s1);
 		}
-	temp_winners.s1 = NULL;
-	temp_winners.s2 = NULL;
+	}
 	if (lambda == lambda_i) {
 		deleteNodes();
 		lambda_i = 0;
@@ -84,77 +81,247 @@ void ILVQ_XSZ::add(ILVQ_ASPECT & input, ILVQ_CLASS_REPRESENTATION & class_rep) {
 }
 
 int ILVQ_XSZ::getPrototypeCount() {
-	return prototypes.size();
+	return arena.size();
+}
+
+/**
+ * The arena gets its dimension from the first prototype. The prototype is stored in a free row of the arena, and
+ * is found back through its row index.
+ */
+ILVQ_XSZ_PROTOTYPE *ILVQ_XSZ::addPrototype(const ILVQ_ASPECT & input, ILVQ_CLASS_REPRESENTATION & class_rep) {
+	if (!query) {
+		arena.setDimension(input.size());
+		query = PrototypeArena::allocate(arena.stride());
+	}
+	ILVQ_PROTOTYPE_INDEX id = arena.insert(input);
+	if (prototypes.size() < arena.end()) {
+		prototypes.resize(arena.end());
+		graph.resize(arena.end());
+	}
+	ILVQ_XSZ_PROTOTYPE *p = &prototypes[id];
+	p->id = id;
+	p->T_s = 0;
+	p->class_id = class_rep;
+	p->statistics = &classes[class_rep];
+	p->statistics->prototype_count++;
+	p->winner_count = 0;
+	index.insert(id);
+	return p;
+}
+
+ILVQ_XSZ_PROTOTYPE *ILVQ_XSZ::prototype(const ILVQ_PROTOTYPE_HANDLE & h) {
+	return graph.valid(h) ? &prototypes[h.index] : NULL;
+}
+
+/**
+ * The row in the arena, the node in the graph, and the struct in "prototypes" are all reused by the next prototype.
+ */
+void ILVQ_XSZ::removePrototype(ILVQ_XSZ_PROTOTYPE *p) {
+	p->statistics->prototype_count--;
+	graph.release(p->id);
+	index.erase(p->id);
+	arena.erase(p->id);
 }
 
 ILVQ_CLASS_REPRESENTATION ILVQ_XSZ::classify(ILVQ_ASPECT & input) {
 	getClosePrototypes(input, temp_winners);
-	return temp_winners.s1->class_id;
+	ILVQ_XSZ_PROTOTYPE *winner = prototype(temp_winners.s1);
+	assert (winner != NULL);
+	return winner->class_id;
 }
 
 /**
- * Returns the two closest prototypes to the given input.
+ * A snapshot costs a copy of all prototypes and a new tree, which only pays off if it is used for many inputs, on
+ * several threads. While the network is being trained it would be taken again for every batch, so then a batch that
+ * is smaller than the number of prototypes, or any batch without a thread pool, goes through the live index instead.
+ */
+void ILVQ_XSZ::classify(const ILVQ_TYPE *inputs, size_t count, ILVQ_CLASS_REPRESENTATION *labels,
+		ILVQ_TYPE *distances) {
+	if (modified && (!pool || count < arena.size())) {
+		classifyLive(inputs, count, labels, distances);
+		return;
+	}
+	if (modified) {
+		snapshot(batch);
+		modified = false;
+	}
+	batch.classify(inputs, count, labels, distances, pool);
+}
+
+void ILVQ_XSZ::classifyLive(const ILVQ_TYPE *inputs, size_t count, ILVQ_CLASS_REPRESENTATION *labels,
+		ILVQ_TYPE *distances) {
+	if (!query) {
+		std::fill(labels, labels + count, -1);
+		if (distances) std::fill(distances, distances + count, numeric_limits<ILVQ_TYPE>::max());
+		return;
+	}
+	const size_t D = arena.dimension();
+	std::fill(query + D, query + arena.stride(), ILVQ_TYPE(0));
+	for (size_t i = 0; i < count; ++i) {
+		std::copy(inputs + i * D, inputs + (i + 1) * D, query);
+		ILVQ_PROTOTYPE_INDEX winner, runnerup;
+		ILVQ_TYPE winner_value, runnerup_value;
+		index.nearest(query, winner, winner_value, runnerup, runnerup_value);
+		labels[i] = winner >= 0 ? prototypes[winner].class_id : -1;
+		if (distances) distances[i] = winner_value;
+	}
+}
+
+/**
+ * The prototypes are added in order of their id, so ties are broken in the same way as by getClosePrototypes().
+ */
+void ILVQ_XSZ::snapshot(PrototypeSnapshot & snapshot) const {
+	snapshot.clear(arena.dimension());
+	for (size_t id = 0; id < arena.end(); ++id) {
+		if (arena.alive(id)) snapshot.add(arena[id], prototypes[id].class_id);
+	}
+}
+
+/**
+ * The edges are written per source in the order of its outgoing edges, and the class statistics as they are, rather
+ * than summed again, so a restored network continues with the same thresholds.
+ */
+void ILVQ_XSZ::checkpoint(ILVQCheckpoint & checkpoint) const {
+	const size_t rows = arena.end();
+	checkpoint.create(arena.dimension(), arena.stride(), rows, classes.size(), graph.size(), arena.freeRows().size());
+	ILVQCheckpoint::Header & header = checkpoint.header();
+	header.age_old = ageOld;
+	header.lambda = lambda;
+	header.lambda_i = lambda_i;
+	header.mu1 = mu1;
+	header.mu2 = mu2;
+	if (rows) std::copy(arena[0], arena[0] + rows * arena.stride(), checkpoint.rows());
+	ILVQCheckpoint::Node *node = checkpoint.nodes();
+	ILVQCheckpoint::Edge *edge = checkpoint.edges();
+	for (size_t id = 0; id < rows; ++id, ++node) {
+		if (!arena.alive(id)) continue;
+		const ILVQ_XSZ_PROTOTYPE & p = prototypes[id];
+		node->class_id = p.class_id;
+		node->winner_count = p.winner_count;
+		node->T_s = p.T_s;
+		node->alive = 1;
+		for (ILVQ_EDGE_INDEX e = graph.outgoing(id); e != PrototypeGraph::NONE; e = graph[e].next_out, ++edge) {
+			edge->source = graph[e].source;
+			edge->target = graph[e].target;
+			edge->age = graph[e].age;
+			edge->length = graph[e].length;
+		}
+	}
+	ILVQCheckpoint::Class *c = checkpoint.classes();
+	for (map<ILVQ_CLASS_REPRESENTATION, ILVQ_XSZ_CLASS>::const_iterator i = classes.begin(); i != classes.end();
+			++i, ++c) {
+		c->class_id = i->first;
+		c->prototype_count = i->second.prototype_count;
+		c->within_count = i->second.within_count;
+		c->within_sum = i->second.within_sum;
+	}
+	std::copy(arena.freeRows().begin(), arena.freeRows().end(), checkpoint.freeRows());
+}
+
+/**
+ * The edges are added in reverse, so every prototype ends up with its outgoing edges in the same order as before.
+ */
+bool ILVQ_XSZ::restore(const ILVQCheckpoint & checkpoint) {
+	if (arena.end() || graph.size() || !classes.empty()) {
+		cerr << "Only a network that has not been trained can be restored from a checkpoint" << endl;
+		return false;
+	}
+	const ILVQCheckpoint::Header & header = checkpoint.header();
+	if (header.stride != PrototypeArena::padded(header.dimension)) {
+		cerr << "Checkpoint has rows of " << header.stride << " values instead of " <<
+				PrototypeArena::padded(header.dimension) << endl;
+		return false;
+	}
+	ageOld = header.age_old;
+	lambda = header.lambda;
+	lambda_i = header.lambda_i;
+	mu1 = header.mu1;
+	mu2 = header.mu2;
+	if (!header.rows) return true;
+	arena.setDimension(header.dimension);
+	query = PrototypeArena::allocate(arena.stride());
+	arena.assign(checkpoint.rows(), header.rows, checkpoint.freeRows(), header.free_rows);
+	prototypes.resize(arena.end());
+	graph.resize(arena.end());
+	const ILVQCheckpoint::Class *c = checkpoint.classes();
+	for (size_t i = 0; i < header.classes; ++i, ++c) {
+		ILVQ_XSZ_CLASS & statistics = classes[c->class_id];
+		statistics.prototype_count = c->prototype_count;
+		statistics.within_count = c->within_count;
+		statistics.within_sum = c->within_sum;
+	}
+	const ILVQCheckpoint::Node *node = checkpoint.nodes();
+	for (size_t id = 0; id < arena.end(); ++id, ++node) {
+		if (!node->alive) continue;
+		ILVQ_XSZ_PROTOTYPE & p = prototypes[id];
+		p.id = id;
+		p.T_s = node->T_s;
+		p.winner_count = node->winner_count;
+		p.class_id = node->class_id;
+		p.statistics = &classes[p.class_id];
+		index.insert(id);
+	}
+	index.rebuild();
+	for (size_t i = header.edges; i > 0; --i) {
+		const ILVQCheckpoint::Edge & edge = checkpoint.edges()[i-1];
+		PrototypeGraph::Edge & e = graph[graph.add(edge.source, edge.target)];
+		e.age = edge.age;
+		e.length = edge.length;
+		prototypes[edge.target].statistics->between.insert(edge.length);
+	}
+	modified = true;
+	return true;
+}
+
+/**
+ * Returns the two closest prototypes to the given input. The index returns the same pair as a scan over all
+ * prototypes in order of their id would.
  */
 void ILVQ_XSZ::getClosePrototypes(const ILVQ_ASPECT & input, ILVQ_XSZ_PROTOTYPE_PAIR & winners) {
-	std::set<ILVQ_XSZ_PROTOTYPE*>::const_iterator it;
 	ILVQ_TYPE winner_value = numeric_limits<ILVQ_TYPE>::max();
 	ILVQ_TYPE runnerup_value = numeric_limits<ILVQ_TYPE>::max();
-	winners.s1 = winners.s2 = NULL;
+	winners.s1 = winners.s2 = graph.handle(-1);
 	if (debug >= LOG_DEBUG) {
-		cout << "Number of prototypes: " << prototypes.size() << endl;
-	}
-	int index = 0;
-	for (it = prototypes.begin(); it != prototypes.end(); ++it) {
-		ILVQ_XSZ_PROTOTYPE *p = *it;
-		ILVQ_TYPE dist = distance(input, *p->prototype, IDM_EUCLIDEAN);
-		if (debug >= LOG_ERR) index++;
-		if (dist < winner_value) {
-			winners.s2 = winners.s1;
-			runnerup_value = winner_value;
-			winners.s1 = p;
-			winner_value = dist;
-			if (debug >= LOG_DEBUG) {
-				cout << "Distance to prototype " << index << " becomes: ";
-				print(*p->prototype);
-				cout << "=" << dist;
-				cout << " and has class id " << winners.s1->class_id << endl;
-			}
-		} else if (dist < runnerup_value) {
-			winners.s2 = p;
-			runnerup_value = dist;
-		}
+		cout << "Number of prototypes: " << arena.size() << endl;
 	}
+	if (!query) return;
+	arena.pad(input, query);
+	ILVQ_PROTOTYPE_INDEX winner, runnerup;
+	index.nearest(query, winner, winner_value, runnerup, runnerup_value);
+	winners.s1 = graph.handle(winner);
+	winners.s2 = graph.handle(runnerup);
 	if (debug >= LOG_INFO) {
-		if (winners.s1 != NULL) {
+		if (winner >= 0) {
 			cout << "Winner is: ";
-			print(*winners.s1->prototype);
+			print(arena[winner], arena.dimension());
 			cout << " with distance=" << winner_value;
-			cout << " and class id " << winners.s1->class_id << endl;
+			cout << " and class id " << prototypes[winner].class_id << endl;
 		}
-		if (winners.s2 != NULL) {
+		if (runnerup >= 0) {
 			cout << "Runner-up is: ";
-			print(*winners.s2->prototype);
+			print(arena[runnerup], arena.dimension());
 			cout << " with distance=" << runnerup_value;
-			cout << " and class id " << winners.s2->class_id << endl;
+			cout << " and class id " << prototypes[runnerup].class_id << endl;
 		}
 	}
 }
 
-bool ILVQ_XSZ::isNewPrototype(const ILVQ_ASPECT & input, ILVQ_CLASS_REPRESENTATION & class_rep,
-		const ILVQ_XSZ_PROTOTYPE_PAIR & winners) {
-	if (!winners.s1 || !winners.s2) {
+bool ILVQ_XSZ::isNewPrototype(ILVQ_CLASS_REPRESENTATION & class_rep, const ILVQ_XSZ_PROTOTYPE_PAIR & winners) {
+	const ILVQ_XSZ_PROTOTYPE *s1 = prototype(winners.s1), *s2 = prototype(winners.s2);
+	if (!s1 || !s2) {
 		if (debug >= LOG_DEBUG)
 			cout << "No two winners available" << endl;
 		return true;
 	}
-	ILVQ_TYPE dT1 = distance(input, *winners.s1->prototype, IDM_EUCLIDEAN);
-	if (dT1 > winners.s1->T_s) {
+	// the input is still in "query", as padded by getClosePrototypes
+	ILVQ_TYPE dT1 = arena.distance(query, s1->id);
+	if (dT1 > s1->T_s) {
 		if (debug >= LOG_DEBUG)
-			cout << "Far enough from winner: " << dT1 << " > " << winners.s1->T_s << endl;
+			cout << "Far enough from winner: " << dT1 << " > " << s1->T_s << endl;
 		return true;
 	}
-	ILVQ_TYPE dT2 = distance(input, *winners.s2->prototype, IDM_EUCLIDEAN);
-	if (dT2 > winners.s2->T_s) return true;
+	ILVQ_TYPE dT2 = arena.distance(query, s2->id);
+	if (dT2 > s2->T_s) return true;
 	if (isNewClass(class_rep)) return true;
 	if (debug >= LOG_INFO) {
 		cout << "Prototype is not new, we will adjust the weights" << endl;
@@ -163,11 +330,8 @@ bool ILVQ_XSZ::isNewPrototype(const ILVQ_ASPECT & input, ILVQ_CLASS_REPRESENTATI
 }
 
 bool ILVQ_XSZ::isNewClass(ILVQ_CLASS_REPRESENTATION & class_rep) {
-	std::set<ILVQ_XSZ_PROTOTYPE*>::const_iterator it;
-	for (it = prototypes.begin(); it != prototypes.end(); ++it) {
-		if ((*it)->class_id == class_rep) return false;
-	}
-	return true;
+	std::map<ILVQ_CLASS_REPRESENTATION, ILVQ_XSZ_CLASS>::const_iterator it = classes.find(class_rep);
+	return (it == classes.end() || !it->second.prototype_count);
 }
 
 /**
@@ -177,29 +341,21 @@ bool ILVQ_XSZ::isNewClass(ILVQ_CLASS_REPRESENTATION & class_rep) {
 void ILVQ_XSZ::addEdge(ILVQ_XSZ_PROTOTYPE *s1, ILVQ_XSZ_PROTOTYPE *s2) {
 	// update edge of outgoing edges
 	//	cout << "Increment age" << endl;
-	ILVQ_XSZ_CONNECTIONS *e = s1->outgoing_connections;
 	bool exist = false;
-	if (e != NULL) {
-		ILVQ_XSZ_CONNECTIONS::const_iterator it_e;
-		for (it_e = e->begin(); it_e != e->end(); ++it_e) {
-			if ((*it_e)->s2 == s2) {
-				exist = true;
-			}
-			(*it_e)->age++;
+	for (ILVQ_EDGE_INDEX e = graph.outgoing(s1->id); e != PrototypeGraph::NONE; e = graph[e].next_out) {
+		if (graph[e].target == s2->id) {
+			exist = true;
 		}
+		graph[e].age++;
 	}
 	// add the edge if it doesn't exist
 	if (!exist) {
-		ILVQ_XSZ_CONNECTION *c = new ILVQ_XSZ_CONNECTION();
-		c->s1 = s1;
-		c->s2 = s2;
-		c->age = 0;
-		s1->outgoing_connections->push_back(c);
+		countEdge(graph[graph.add(s1->id, s2->id)]);
 		if (debug >= LOG_DEBUG) {
 			cout << __func__ << ": Add edge between ";
-			print(*c->s1->prototype);
+			print(arena[s1->id], arena.dimension());
 			cout << " and ";
-			print(*c->s2->prototype);
+			print(arena[s2->id], arena.dimension());
 			cout << endl;
 		}
 	}
@@ -215,24 +371,61 @@ void ILVQ_XSZ::updatePrototype(ILVQ_XSZ_PROTOTYPE &winner, const ILVQ_ASPECT & i
 		ILVQ_CLASS_REPRESENTATION & class_rep) {
 	if (winner.class_id == class_rep) {
 //		ILVQ_TYPE dist_pre = distance(*winner.prototype, input, DM_EUCLIDEAN);
-		decreaseDistance(*winner.prototype, input, mu1);
+		decreaseDistance(arena[winner.id], input, mu1);
+		index.move(winner.id);
+		updateEdges(winner);
 //		ILVQ_TYPE dist_post = distance(*winner.prototype, input, DM_EUCLIDEAN);
 //		cout << "Distance increased with " << dist_post - dist_pre << endl;
-		ILVQ_XSZ_CONNECTIONS &e = *winner.outgoing_connections;
-		ILVQ_XSZ_CONNECTIONS::const_iterator it_e;
-		for (it_e = e.begin(); it_e != e.end(); ++it_e) {
-			increaseDistance(*(*it_e)->s2->prototype, input, mu2);
+		for (ILVQ_EDGE_INDEX e = graph.outgoing(winner.id); e != PrototypeGraph::NONE; e = graph[e].next_out) {
+			ILVQ_PROTOTYPE_INDEX neighbour = graph[e].target;
+			increaseDistance(arena[neighbour], input, mu2);
+			index.move(neighbour);
+			updateEdges(prototypes[neighbour]);
 		}
 	} else {
-		increaseDistance(*winner.prototype, input, mu1);
-		ILVQ_XSZ_CONNECTIONS &e = *winner.outgoing_connections;
-		ILVQ_XSZ_CONNECTIONS::const_iterator it_e;
-		for (it_e = e.begin(); it_e != e.end(); ++it_e) {
-			decreaseDistance(*(*it_e)->s2->prototype, input, mu2);
+		increaseDistance(arena[winner.id], input, mu1);
+		index.move(winner.id);
+		updateEdges(winner);
+		for (ILVQ_EDGE_INDEX e = graph.outgoing(winner.id); e != PrototypeGraph::NONE; e = graph[e].next_out) {
+			ILVQ_PROTOTYPE_INDEX neighbour = graph[e].target;
+			decreaseDistance(arena[neighbour], input, mu2);
+			index.move(neighbour);
+			updateEdges(prototypes[neighbour]);
 		}
 	}
 }
 
+void ILVQ_XSZ::countEdge(PrototypeGraph::Edge & edge) {
+	edge.length = arena.distance(edge.source, edge.target);
+	ILVQ_XSZ_CLASS & source = *prototypes[edge.source].statistics;
+	source.within_sum += edge.length;
+	source.within_count++;
+	prototypes[edge.target].statistics->between.insert(edge.length);
+}
+
+void ILVQ_XSZ::uncountEdge(const PrototypeGraph::Edge & edge) {
+	ILVQ_XSZ_CLASS & source = *prototypes[edge.source].statistics;
+	// start from zero again when there are no edges, so rounding errors do not add up forever
+	source.within_sum = --source.within_count ? source.within_sum - edge.length : 0;
+	std::multiset<ILVQ_TYPE> & between = prototypes[edge.target].statistics->between;
+	between.erase(between.find(edge.length));
+}
+
+/**
+ * Only the edges of a prototype that has been moved change length, so this is all that has to be done to keep the
+ * class bookkeeping up to date, O(degree log E).
+ */
+void ILVQ_XSZ::updateEdges(ILVQ_XSZ_PROTOTYPE &p) {
+	for (ILVQ_EDGE_INDEX e = graph.outgoing(p.id); e != PrototypeGraph::NONE; e = graph[e].next_out) {
+		uncountEdge(graph[e]);
+		countEdge(graph[e]);
+	}
+	for (ILVQ_EDGE_INDEX e = graph.incoming(p.id); e != PrototypeGraph::NONE; e = graph[e].next_in) {
+		uncountEdge(graph[e]);
+		countEdge(graph[e]);
+	}
+}
+
 /**
  * Somewhere the authors describe an adaptive mechanism to adjust the learning rate. It is not
  * entirely clear when to set this. We choose here to set it BEFORE we adjust the winner and
@@ -248,72 +441,39 @@ void ILVQ_XSZ::updateLearningRates(ILVQ_XSZ_PROTOTYPE &winner) {
 	mu2 = mu1 / 100.0;
 }
 
-bool comp_dist(std::pair<ILVQ_TYPE,ILVQ_XSZ_CONNECTION*> p0, std::pair<ILVQ_TYPE,ILVQ_XSZ_CONNECTION*> p1) {
-	return (p0.first < p1.first);
-}
-
 /**
- * Update the threshold T_winner.
+ * Update the threshold T_winner. The threshold depends only on the class of the winner. The "within class"
+ * distance is the average length of the edges that go out of prototypes of this class. The "between class"
+ * distances are the lengths of the edges that go into prototypes of this class, in sorted order. The threshold
+ * becomes the between class distance just before the first one that is larger than the within class distance.
+ * Both are kept up to date in the class bookkeeping, so this is O(log E).
  */
 void ILVQ_XSZ::updateThreshold(ILVQ_XSZ_PROTOTYPE &winner) {
-	ILVQ_CLASS_REPRESENTATION class_id = winner.class_id;
+	const ILVQ_XSZ_CLASS & statistics = *winner.statistics;
 
 	// first calculate the "within class" threshold
-	ILVQ_TYPE T_within = ILVQ_TYPE(0);
-	int within_members = 0;
-	std::set<ILVQ_XSZ_PROTOTYPE*>::const_iterator it;
-	for (it = prototypes.begin(); it != prototypes.end(); ++it) {
-		if ((*it)->class_id == class_id) {
-			ILVQ_XSZ_CONNECTIONS *e = (*it)->outgoing_connections;
-			ILVQ_XSZ_CONNECTIONS::const_iterator it_e;
-			for (it_e = e->begin(); it_e != e->end(); ++it_e, ++within_members) {
-				T_within += distance(*(*it_e)->s1->prototype, *(*it_e)->s2->prototype, IDM_EUCLIDEAN);
-			}
-		}
-	}
-	T_within = T_within / within_members;
+	ILVQ_TYPE T_within = ILVQ_TYPE(statistics.within_sum / statistics.within_count);
 	if (debug >= LOG_DEBUG)
 		cout << __func__ << ": the average within class distance is calculated as " << T_within << endl;
 
-	// then calculate "between class"
-	std::vector<std::pair<ILVQ_TYPE,ILVQ_XSZ_CONNECTION*> > conn;
-	ILVQ_TYPE T_dist = ILVQ_TYPE(0);
-	for (it = prototypes.begin(); it != prototypes.end(); ++it) {
-		ILVQ_XSZ_CONNECTIONS *e = (*it)->outgoing_connections;
-		assert (e);
-		ILVQ_XSZ_CONNECTIONS::const_iterator it_e;
-		for (it_e = e->begin(); it_e != e->end(); ++it_e) {
-			assert ((*it_e)->s1);
-			assert ((*it_e)->s2);
-			assert ((*it_e)->s1->prototype != NULL);
-			assert ((*it_e)->s2->prototype != NULL);
-			if ((*it_e)->s2->class_id == class_id) {
-				T_dist = distance(*(*it_e)->s1->prototype, *(*it_e)->s2->prototype, IDM_EUCLIDEAN);
-				conn.push_back(make_pair<ILVQ_TYPE,ILVQ_XSZ_CONNECTION*>(T_dist,*it_e));
-			}
-		}
-	}
-
-	// sort on distance
-	std::sort(conn.begin(), conn.end(), comp_dist);
+	// then the "between class" distances, already sorted
+	const std::multiset<ILVQ_TYPE> & conn = statistics.between;
 	if (debug >= LOG_DEBUG) {
 		cout << __func__ << ": sorted distances {";
-		for (unsigned int i = 0; i < conn.size(); ++i) {
-			cout << conn[i].first << " ";
+		std::multiset<ILVQ_TYPE>::const_iterator it;
+		for (it = conn.begin(); it != conn.end(); ++it) {
+			cout << *it << " ";
 		}
 		cout << "}" << endl;
 	}
 
-	// loop through distances till the one between is indeed larger than the (averaged) within class distance
+	// the one before the first distance that is larger than the (averaged) within class distance, where the first
+	// and the one but last are the smallest and largest thresholds that can be chosen
 	if (conn.size() > 1) {
-		ILVQ_TYPE T_between = conn[0].first;
-		winner.T_s = T_between;
-		for (unsigned int i = 1; i < conn.size(); ++i) {
-			winner.T_s = T_between;
-			T_between = conn[i].first;
-			if (T_between > T_within)
-				break;
-		}
+		std::multiset<ILVQ_TYPE>::const_iterator T_between = conn.upper_bound(T_within);
+		if (T_between == conn.end()) --T_between;
+		if (T_between != conn.begin()) --T_between;
+		winner.T_s = *T_between;
 	} else {
 		winner.T_s = T_within;
 	}
@@ -321,107 +481,74 @@ void ILVQ_XSZ::updateThreshold(ILVQ_XSZ_PROTOTYPE &winner) {
 	if (debug >= LOG_DEBUG) {
 		cout << __func__ << ": the new threshold for the winner becomes: " << winner.T_s << endl;
 	}
-	// remove the pairs again
-	conn.erase(conn.begin(), conn.end());
 }
 
 /**
- * Helper class to delete old edges
+ * Remove the edge from the graph, its slot in the pool is reused by the next edge.
  */
-class delete_old {
-	int old;
-public:
-	delete_old(int age): old(age) {}
-	bool operator()(ILVQ_XSZ_CONNECTION *c) const {
-		return (c->age >= old);
-	}
-};
+void ILVQ_XSZ::deleteEdge(ILVQ_EDGE_INDEX e) {
+	uncountEdge(graph[e]);
+	graph.erase(e);
+}
 
 /**
- * Delete edges that are too old.
+ * Delete edges that are too old. Ages are only incremented in addEdge, for the edges going out of the winner, so
+ * all other edges are still younger than ageOld.
  */
-void ILVQ_XSZ::deleteEdges() {
-	std::set<ILVQ_XSZ_PROTOTYPE*>::const_iterator it;
-	for (it = prototypes.begin(); it != prototypes.end(); ++it) {
-		ILVQ_XSZ_CONNECTIONS &e = *(*it)->outgoing_connections;
-		e.erase(std::remove_if(e.begin(), e.end(), delete_old(ageOld)), e.end());
+void ILVQ_XSZ::deleteEdges(ILVQ_XSZ_PROTOTYPE &winner) {
+	ILVQ_EDGE_INDEX e = graph.outgoing(winner.id);
+	while (e != PrototypeGraph::NONE) {
+		ILVQ_EDGE_INDEX next = graph[e].next_out;
+		if (graph[e].age >= ageOld) deleteEdge(e);
+		e = next;
 	}
 }
 
-class delete_target {
-	ILVQ_XSZ_PROTOTYPE* target_;
-public:
-	delete_target(ILVQ_XSZ_PROTOTYPE* target): target_(target) {}
-	bool operator()(ILVQ_XSZ_CONNECTION *c) const {
-		return (c->s2 == target_);
-	}
-};
-
-void ILVQ_XSZ::deleteEdges(ILVQ_XSZ_PROTOTYPE* target) {
-	std::set<ILVQ_XSZ_PROTOTYPE*>::const_iterator it;
-	for (it = prototypes.begin(); it != prototypes.end(); ++it) {
-		ILVQ_XSZ_CONNECTIONS &e = *(*it)->outgoing_connections;
-		e.erase(std::remove_if(e.begin(), e.end(), delete_target(target)), e.end());
+void ILVQ_XSZ::deleteIncomingEdges(ILVQ_XSZ_PROTOTYPE &target) {
+	while (graph.incoming(target.id) != PrototypeGraph::NONE) {
+		deleteEdge(graph.incoming(target.id));
 	}
 }
 
-//! Delete node on two conditions
-struct delete_empty_node {
-	bool operator()(ILVQ_XSZ_PROTOTYPE *p) const {
-		return (p->outgoing_connections->empty());
+void ILVQ_XSZ::deleteOutgoingEdges(ILVQ_XSZ_PROTOTYPE &source) {
+	while (graph.outgoing(source.id) != PrototypeGraph::NONE) {
+		deleteEdge(graph.outgoing(source.id));
 	}
-};
-
-class delete_lonely_node {
-	ILVQ_TYPE M_;
-public:
-	delete_lonely_node(ILVQ_TYPE M): M_(M) {}
-	bool operator()(ILVQ_XSZ_PROTOTYPE *p) const {
-		return ((p->outgoing_connections->size() == 1) && (p->winner_count < M_));
-	}
-};
-
-int sum_winner_count(int sum, ILVQ_XSZ_PROTOTYPE *p) {
-	return sum + p->winner_count;
 }
 
 /**
- * Prototypes is a set, so we have to "while through it" and cannot use the erase(remove_if)
- * template.
+ * Delete the prototypes without outgoing edges, and then the prototypes with a single outgoing edge that did not win
+ * often. Prototypes are indexed by their row in the arena, so we go through the rows in order and skip the empty
+ * ones. Removing a prototype and its edges is O(degree).
  */
 void ILVQ_XSZ::deleteNodes() {
-	std::set<ILVQ_XSZ_PROTOTYPE*>::iterator cur, tmp;
-	cur = prototypes.begin();
-	const std::set<ILVQ_XSZ_PROTOTYPE*>::iterator last = prototypes.end();
-	while ((cur = std::find_if(cur, last, delete_empty_node())) != last) {
-		tmp = cur++;
-		assert ((*tmp)->prototype != NULL);
+	for (size_t id = 0; id < prototypes.size(); ++id) {
+		if (!arena.alive(id) || graph.outDegree(id)) continue;
+		ILVQ_XSZ_PROTOTYPE &p = prototypes[id];
 		// should not have edges going in either, but who cares, to be sure:
-		deleteEdges(*tmp);
+		deleteIncomingEdges(p);
 		if (debug >= LOG_DEBUG) {
 			cout << "Delete prototype without connections ";
-			print(*(*tmp)->prototype);
+			print(arena[p.id], arena.dimension());
 			cout << endl;
 		}
-		delete (*tmp)->prototype;
-		prototypes.erase(tmp);
-	}
-	cur = prototypes.begin();
-	ILVQ_TYPE M = std::accumulate(prototypes.begin(), prototypes.end(), 0, sum_winner_count);
-	M /= (prototypes.size()*2.0);
-	while ((cur = std::find_if(cur, last, delete_lonely_node(M))) != last) {
-		tmp = cur++;
-		assert ((*tmp)->prototype != NULL);
-		// delete incoming edges
-		deleteEdges(*tmp);
-		// delete outgoing edges
-		(*tmp)->outgoing_connections->erase((*tmp)->outgoing_connections->begin(), (*tmp)->outgoing_connections->end());
+		removePrototype(&p);
+	}
+	ILVQ_TYPE M = 0;
+	for (size_t id = 0; id < prototypes.size(); ++id) {
+		if (arena.alive(id)) M += prototypes[id].winner_count;
+	}
+	M /= (arena.size()*2.0);
+	for (size_t id = 0; id < prototypes.size(); ++id) {
+		if (!arena.alive(id) || graph.outDegree(id) != 1 || prototypes[id].winner_count >= M) continue;
+		ILVQ_XSZ_PROTOTYPE &p = prototypes[id];
+		deleteIncomingEdges(p);
+		deleteOutgoingEdges(p);
 		if (debug >= LOG_DEBUG) {
 			cout << "Delete prototype with single connection ";
-			print(*(*tmp)->prototype);
+			print(arena[p.id], arena.dimension());
 			cout << endl;
 		}
-		delete (*tmp)->prototype;
-		prototypes.erase(tmp);
+		removePrototype(&p);
 	}
 }
@@ -0,0 +1,112 @@
+/**
+ * @brief TestILVQ.cpp
+ * @file TestILVQ.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    Machine learning (fit for Surveyeor robots)
+ */
+
+
+#include <ILVQ_XSZ.h>
+#include <random>
+#include "gtest/gtest.h"
+
+using namespace dobots;
+
+namespace {
+
+const int D = 3, C = 4;
+
+//! A sample around the corner of the unit cube that belongs to its class
+ILVQ_ASPECT sample(std::mt19937 & generator, int & label) {
+	std::normal_distribution<ILVQ_TYPE> normal(0, 0.3);
+	label = generator() % C;
+	ILVQ_ASPECT x(D);
+	for (int d = 0; d < D; ++d) x[d] = ((label >> d) & 1) + normal(generator);
+	return x;
+}
+
+//! Train a network on n samples
+void train(ILVQ_XSZ & ilvq, std::mt19937 & generator, int n) {
+	for (int i = 0; i < n; ++i) {
+		int label;
+		ILVQ_ASPECT x = sample(generator, label);
+		ilvq.add(x, label);
+	}
+}
+
+//! Classify "count" new samples at once, and check that every label is the one of classify() for that sample alone
+void expectBatchAsSingle(ILVQ_XSZ & ilvq, std::mt19937 & generator, size_t count) {
+	std::vector<ILVQ_ASPECT> inputs;
+	std::vector<ILVQ_TYPE> values;
+	for (size_t i = 0; i < count; ++i) {
+		int label;
+		inputs.push_back(sample(generator, label));
+		values.insert(values.end(), inputs.back().begin(), inputs.back().end());
+	}
+	std::vector<ILVQ_CLASS_REPRESENTATION> labels(count);
+	std::vector<ILVQ_TYPE> distances(count);
+	ilvq.classify(&values[0], count, &labels[0], &distances[0]);
+	for (size_t i = 0; i < count; ++i) {
+		ASSERT_EQ(ilvq.classify(inputs[i]), labels[i]) << "sample " << i << " of " << count;
+		ASSERT_LE(ILVQ_TYPE(0), distances[i]);
+	}
+}
+
+/**
+ * A batch gives the same labels as classify() per input, whether it goes through the live index (small batches after
+ * training, or without a pool) or through a snapshot (large batches, or no training since the last one).
+ */
+TEST(ILVQTest, BatchAsSingle) {
+	std::mt19937 generator(1);
+	ILVQ_XSZ ilvq;
+	train(ilvq, generator, 2000);
+	ASSERT_LT(C, ilvq.getPrototypeCount());
+
+	// no pool, the live index
+	expectBatchAsSingle(ilvq, generator, 1000);
+
+	ThreadPool pool(4);
+	ilvq.setThreadPool(&pool);
+	for (int round = 0; round < 3; ++round) {
+		train(ilvq, generator, 100);
+		// smaller than the number of prototypes, the live index
+		expectBatchAsSingle(ilvq, generator, 1);
+		expectBatchAsSingle(ilvq, generator, ilvq.getPrototypeCount() - 1);
+		// a snapshot, and again without training in between
+		expectBatchAsSingle(ilvq, generator, 10 * ilvq.getPrototypeCount());
+		expectBatchAsSingle(ilvq, generator, 1);
+	}
+}
+
+/**
+ * Without prototypes every input of a batch gets label -1 and the maximum distance.
+ */
+TEST(ILVQTest, BatchWithoutPrototypes) {
+	ILVQ_XSZ ilvq;
+	std::vector<ILVQ_TYPE> values(3 * D, ILVQ_TYPE(0));
+	std::vector<ILVQ_CLASS_REPRESENTATION> labels(3, 0);
+	std::vector<ILVQ_TYPE> distances(3, 0);
+	ilvq.classify(&values[0], 3, &labels[0], &distances[0]);
+	for (int i = 0; i < 3; ++i) {
+		EXPECT_EQ(-1, labels[i]);
+		EXPECT_EQ(std::numeric_limits<ILVQ_TYPE>::max(), distances[i]);
+	}
+}
+
+}
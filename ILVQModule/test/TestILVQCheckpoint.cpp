@@ -0,0 +1,130 @@
+/**
+ * @brief TestILVQCheckpoint.cpp
+ * @file TestILVQCheckpoint.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2012 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    Machine learning (fit for Surveyeor robots)
+ */
+
+
+#include <ILVQ_XSZ.h>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include "gtest/gtest.h"
+
+using namespace dobots;
+
+namespace {
+
+const int D = 3, C = 4;
+
+//! Samples around the corners of the unit cube, with the corner as class, one sample per row
+void samples(std::mt19937 & generator, int n, std::vector<ILVQ_ASPECT> & inputs, std::vector<int> & labels) {
+	std::normal_distribution<ILVQ_TYPE> normal(0, 0.3);
+	for (int i = 0; i < n; ++i) {
+		int label = generator() % C;
+		ILVQ_ASPECT x(D);
+		for (int d = 0; d < D; ++d) x[d] = ((label >> d) & 1) + normal(generator);
+		inputs.push_back(x);
+		labels.push_back(label);
+	}
+}
+
+void train(ILVQ_XSZ & ilvq, std::vector<ILVQ_ASPECT> & inputs, std::vector<int> & labels) {
+	for (size_t i = 0; i < inputs.size(); ++i) ilvq.add(inputs[i], labels[i]);
+}
+
+std::string contents(const std::string & file) {
+	std::ifstream in(file.c_str(), std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+/**
+ * A network restored from a checkpoint file is the same as the network it was taken of: the checkpoint it gives is
+ * the same byte for byte, it classifies the same, and it continues training in the same way, which needs the same
+ * thresholds, edges with their ages, free rows, and position in the clean up interval.
+ */
+TEST(ILVQCheckpointTest, RoundTrip) {
+	std::mt19937 generator(1);
+	std::vector<ILVQ_ASPECT> inputs, more, tests;
+	std::vector<int> labels, more_labels, test_labels;
+	samples(generator, 3000, inputs, labels);
+	samples(generator, 1000, more, more_labels);
+	samples(generator, 1000, tests, test_labels);
+
+	// a lambda that is not a divisor of the number of samples, so the restored network is halfway an interval
+	ILVQ_XSZ original(16, 0.1, 0.001, 7);
+	train(original, inputs, labels);
+
+	std::string file = testing::TempDir() + "TestILVQCheckpoint.ckpt";
+	std::string copy = testing::TempDir() + "TestILVQCheckpointCopy.ckpt";
+	ILVQCheckpoint written, loaded, rewritten;
+	original.checkpoint(written);
+	ASSERT_TRUE(written.write(file));
+	ASSERT_TRUE(loaded.load(file));
+	ILVQ_XSZ restored(16, 0.1, 0.001, 7);
+	ASSERT_TRUE(restored.restore(loaded));
+	loaded.clear();
+
+	restored.checkpoint(rewritten);
+	ASSERT_TRUE(rewritten.write(copy));
+	EXPECT_TRUE(contents(file) == contents(copy));
+
+	ASSERT_EQ(original.getPrototypeCount(), restored.getPrototypeCount());
+	for (size_t i = 0; i < tests.size(); ++i) {
+		ASSERT_EQ(original.classify(tests[i]), restored.classify(tests[i])) << "sample " << i;
+	}
+
+	train(original, more, more_labels);
+	train(restored, more, more_labels);
+	ASSERT_EQ(original.getPrototypeCount(), restored.getPrototypeCount());
+	for (size_t i = 0; i < tests.size(); ++i) {
+		ASSERT_EQ(original.classify(tests[i]), restored.classify(tests[i])) << "sample " << i;
+	}
+	remove(file.c_str());
+	remove(copy.c_str());
+}
+
+/**
+ * Only a network that has not been trained can be restored, and a file that is not a checkpoint is not loaded.
+ */
+TEST(ILVQCheckpointTest, RejectInvalid) {
+	std::mt19937 generator(2);
+	std::vector<ILVQ_ASPECT> inputs;
+	std::vector<int> labels;
+	samples(generator, 100, inputs, labels);
+	ILVQ_XSZ trained;
+	train(trained, inputs, labels);
+
+	ILVQCheckpoint checkpoint;
+	trained.checkpoint(checkpoint);
+	EXPECT_FALSE(trained.restore(checkpoint));
+
+	std::string file = testing::TempDir() + "TestILVQCheckpointInvalid.ckpt";
+	ASSERT_TRUE(checkpoint.write(file));
+	std::string data = contents(file);
+	std::ofstream(file.c_str(), std::ios::binary).write(data.data(), data.size() - 1);
+	EXPECT_FALSE(checkpoint.load(file));
+	std::ofstream(file.c_str(), std::ios::binary) << "ILVQ_XYZ";
+	EXPECT_FALSE(checkpoint.load(file));
+	remove(file.c_str());
+}
+
+}
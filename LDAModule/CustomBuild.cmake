@@ -11,5 +11,15 @@
 
 # Your own changes to the CMake build system such as for example FindEigen to support matrix manipulations
 
-SET(CMAKE_CXX_FLAGS -std=c++11)
+SET(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -std=c++11 -pthread")
 
+# The thread pool (ThreadPool.hpp) is shared with other modules, it is in common/inc next to the modules
+INCLUDE_DIRECTORIES(${CMAKE_CURRENT_LIST_DIR}/../common/inc)
+
+
+# Tests of the samplers (see test/), run with "make test" if Google test is installed
+FIND_PACKAGE(GTest QUIET)
+IF(GTEST_FOUND)
+	enable_testing()
+	ADD_SUBDIRECTORY(test)
+ENDIF()
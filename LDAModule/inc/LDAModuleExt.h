@@ -15,7 +15,8 @@
 
 #include <LDAModule.h>
 #include <tuple-array.hpp>
-#include <nd-array.hpp>
+#include <parallel-lda.hpp>
+#include <alias-lda.hpp>
 
 namespace rur {
 
@@ -47,28 +48,40 @@ public:
 	//! Incorporate a new item in frequency statistics
 	void Count(long_seq & sample);
 
+	//! Give the new (term, document) tokens a topic and resample the topics of all tokens once, on all cores
 	void Gibbs();
+
+	//! The same with Metropolis-Hastings steps and alias tables, for thousands of topics
+	void MetropolisHastings();
 private:
 	//! Variable size data structure to store counts of (terms, documents)
 	tuple_array<int> term_doc_table;
 
-	//! And we have two other tables that store (terms, topics) and (documents, topics)
-	tuple_array<int> term_topic_table, doc_topic_table;
-
-	//! And we sum over all terms per topic
-	std::vector<int> term_count_per_topic, term_count_per_doc;
-
-	//! Used in sampling step
-	std::vector<int> sample_topics;
-
 	//! Number of clusters
 	int K;
 
-	//! Number of words
-	int W;
-
 	//! Hyperparameters
 	double alpha, beta;
+
+	//! Threads for the Gibbs sweeps, declared before lda, which has a partition per thread
+	ThreadPool pool;
+
+	//! The topic assignments of all tokens in term_doc_table and the sparse count tables, over all threads
+	parallel_lda lda;
+
+	//! The topic assignments and count tables of the Metropolis-Hastings sampler, separate from those of lda
+	alias_lda mh_lda;
+
+	//! Mode, 0: accepting inputs, 1: training with Gibbs(), 2: training with MetropolisHastings() (see the Mode port)
+	int mode;
+
+	//! The perplexity is calculated every "lag" Gibbs sweeps, training stops if it changes less than "convergence"
+	int lag;
+	double convergence;
+
+	//! Number of Gibbs sweeps, and the perplexity at the last calculation
+	int sweeps;
+	double perplexity;
 };
 
 }
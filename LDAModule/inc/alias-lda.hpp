@@ -0,0 +1,324 @@
+/**
+ * @file alias-lda.hpp
+ * @brief Metropolis-Hastings sampler for Latent Dirichlet Allocation with alias tables, for many topics
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2014 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 15, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    Artificial Intelligence Framework
+ */
+#ifndef ALIAS_LDA_H_
+#define ALIAS_LDA_H_
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cassert>
+#include <stdint.h>
+
+#include <alias-table.hpp>
+#include <sparse-lda.hpp>
+
+/**
+ * Sampling for LDA with Metropolis-Hastings steps in the manner of LightLDA (Yuan et al., 2015). The target for the
+ * topic k of a token of term w in document d is the same full conditional as for sparse_lda
+ *
+ *   p(k) ~ (n_dk + alpha) (n_wk + beta) / (n_k + V beta)
+ *
+ * but it is never normalized. Instead there are two proposals that each cover one factor, and they are used in turn:
+ *
+ *   document proposal    q_d(k) ~ n_dk + alpha          the topic of a random token in d, or a uniform topic
+ *   word proposal        q_w(k) ~ (n_wk + beta) / (n_k + V beta)
+ *
+ * A draw from the document proposal is O(1) without any table. The word proposal is a mixture of an alias table per
+ * term over the topics it is assigned to, with weights n_wk / (n_k + V beta), and one alias table over all topics with
+ * weights beta / (n_k + V beta). A table is used as it is while the counts change, and is built again after as many
+ * draws as it has entries, so the build cost per draw is O(1) on average. The acceptance test uses the weights the
+ * table has been built with, which keeps the proposal that is corrected for the one that is actually drawn from. As in
+ * LightLDA the tables still depend on earlier states of the chain, so between two builds the sampler is slightly off
+ * from the exact posterior.
+ *
+ * A token costs O(1) for every step, apart from looking up n_wk in the term row, which is sorted by topic and is hence
+ * a binary search. With thousands of topics this is much faster than sparse_lda, which goes through all topics of the
+ * term and the document. The price is that a chain of a few steps per token mixes slower than an exact Gibbs draw.
+ */
+class alias_lda {
+public:
+	/**
+	 * A sampler for "topics" topics, with symmetric Dirichlet priors alpha and beta as for sparse_lda. Every token
+	 * gets "steps" pairs of a document and a word proposal per sweep.
+	 */
+	alias_lda(int topics, double alpha, double beta, int steps = 2, unsigned int seed = 5489u): K(topics),
+			alpha(alpha), beta(beta), steps(steps), vocabulary(0), smoothing_draws(0), generator(seed) {
+		assert (K > 0 && steps > 0);
+		topic_totals.resize(K, 0);
+		doc_dense.resize(K, 0);
+	}
+
+	//! Add a token of "term" in "document", with a random topic
+	void add(int term, int document) {
+		assert (term >= 0 && document >= 0);
+		if ((size_t)term >= term_topics.size()) {
+			term_topics.resize(term + 1);
+			term_frequency.resize(term + 1, 0);
+			word_tables.resize(term + 1);
+		}
+		if ((size_t)document >= doc_tokens.size()) {
+			doc_tokens.resize(document + 1);
+		}
+		if (!term_frequency[term]++) vocabulary++;
+		int topic = std::uniform_int_distribution<int>(0, K - 1)(generator);
+		doc_tokens[document].push_back(terms.size());
+		terms.push_back(term);
+		assignment.push_back(topic);
+		increment(term_topics[term], topic);
+		topic_totals[topic]++;
+	}
+
+	//! Number of tokens
+	inline size_t size() const { return terms.size(); }
+
+	//! Number of topics
+	inline int topics() const { return K; }
+
+	//! Number of different terms
+	inline int terms_in_vocabulary() const { return vocabulary; }
+
+	//! Topic of a token, in the order in which they have been added
+	inline int topic(size_t token) const { return assignment[token]; }
+
+	//! Number of tokens with the given topic
+	inline int topic_total(int topic) const { return topic_totals[topic]; }
+
+	//! The topics of a term with their counts, by increasing topic (not by count as in sparse_lda)
+	inline const sparse_counts & term_row(int term) const { return term_topics[term]; }
+
+	/**
+	 * Sample a new topic for every token, document by document. The table over all topics is built again at the
+	 * start, so it follows a change in the number of terms.
+	 */
+	void sweep() {
+		const double Vbeta = vocabulary * beta;
+		build_smoothing(Vbeta);
+		for (size_t d = 0; d < doc_tokens.size(); ++d) {
+			if (!doc_tokens[d].empty()) sweep_document(d, Vbeta);
+		}
+	}
+
+private:
+	/**
+	 * A stale alias table for the term part of the word proposal: the topics of the term when it was built, with the
+	 * weights n_wk / (n_k + V beta) it has been built with, and the number of draws since then.
+	 */
+	struct word_table {
+		word_table(): draws(0) {}
+		std::vector<int> topics;
+		std::vector<double> weights;
+		alias_table table;
+		size_t draws;
+	};
+
+	//! Resample the topics of all tokens in document "d"
+	void sweep_document(size_t d, double Vbeta) {
+		const std::vector<size_t> & tokens = doc_tokens[d];
+		doc_assignment.resize(tokens.size());
+		for (size_t t = 0; t < tokens.size(); ++t) {
+			doc_assignment[t] = assignment[tokens[t]];
+			doc_dense[doc_assignment[t]]++;
+		}
+		for (size_t t = 0; t < tokens.size(); ++t) {
+			size_t token = tokens[t];
+			int w = terms[token];
+			int s = doc_assignment[t];
+
+			// take the token out of all counts, its topic in doc_assignment is the state of the chain
+			doc_dense[s]--;
+			topic_totals[s]--;
+			decrement(term_topics[w], s);
+
+			// the chain keeps n_ws of its state, so only the proposed topic has to be looked up
+			int term_count = count(term_topics[w], s);
+			for (int step = 0; step < steps; ++step) {
+				s = doc_assignment[t] = propose_from_document(w, s, term_count, Vbeta);
+				s = doc_assignment[t] = propose_from_word(w, s, term_count, Vbeta);
+			}
+			assignment[token] = s;
+
+			doc_dense[s]++;
+			topic_totals[s]++;
+			increment(term_topics[w], s);
+		}
+		for (size_t t = 0; t < tokens.size(); ++t) doc_dense[doc_assignment[t]] = 0;
+	}
+
+	/**
+	 * One step with the document proposal from topic s, with n_ws in "term_count". With probability
+	 * L_d / (L_d + K alpha) it is the topic of a random token in the document, the current token included with topic
+	 * s, otherwise a uniform topic. The factor (n_dk + alpha) cancels, only the word factor is left in the acceptance
+	 * ratio.
+	 */
+	int propose_from_document(int w, int s, int & term_count, double Vbeta) {
+		double length = doc_assignment.size();
+		int t;
+		if (uniform(length + K * alpha) < length) {
+			t = doc_assignment[index(doc_assignment.size())];
+		} else {
+			t = index(K);
+		}
+		if (t == s) return s;
+		int count_t = count(term_topics[w], t);
+		double ratio = (count_t + beta) * (topic_totals[s] + Vbeta) / ((term_count + beta) * (topic_totals[t] + Vbeta));
+		if (!accept(ratio)) return s;
+		term_count = count_t;
+		return t;
+	}
+
+	/**
+	 * One step with the word proposal from topic s, see above. The term table is chosen with probability
+	 * S_w / (S_w + B), with S_w and B the total weights of the term table and of the table over all topics.
+	 */
+	int propose_from_word(int w, int s, int & term_count, double Vbeta) {
+		word_table & word = word_tables[w];
+		if (word.draws >= word.topics.size()) build_word(w, Vbeta);
+		if (smoothing_draws >= (size_t)K) build_smoothing(Vbeta);
+		double sparse = word.topics.empty() ? 0 : word.table.mass();
+		int t;
+		if (uniform(sparse + smoothing.mass()) < sparse) {
+			t = word.topics[word.table.sample(uniform(1))];
+			word.draws++;
+		} else {
+			t = smoothing.sample(uniform(1));
+			smoothing_draws++;
+		}
+		if (t == s) return s;
+		int count_t = count(term_topics[w], t);
+		double target_t = (doc_dense[t] + alpha) * (count_t + beta) / (topic_totals[t] + Vbeta);
+		double target_s = (doc_dense[s] + alpha) * (term_count + beta) / (topic_totals[s] + Vbeta);
+		double ratio = target_t * proposal(word, s) / (target_s * proposal(word, t));
+		if (!accept(ratio)) return s;
+		term_count = count_t;
+		return t;
+	}
+
+	//! The (unnormalized) word proposal for topic k, with the weights the tables have been built with
+	inline double proposal(const word_table & word, int k) const {
+		std::vector<int>::const_iterator i = std::lower_bound(word.topics.begin(), word.topics.end(), k);
+		double q = smoothing_weights[k];
+		if (i != word.topics.end() && *i == k) q += word.weights[i - word.topics.begin()];
+		return q;
+	}
+
+	inline bool accept(double ratio) {
+		return ratio >= 1 || uniform(1) < ratio;
+	}
+
+	//! A uniform random number in [0,range), with the 32 bits of a single draw, which is plenty for a proposal
+	inline double uniform(double range) {
+		return range * (generator() * (1.0 / 4294967296.0));
+	}
+
+	//! A uniform random index in [0,n)
+	inline size_t index(size_t n) {
+		return (size_t)(((uint64_t)generator() * n) >> 32);
+	}
+
+	//! Build the table of term w from its current counts, O(K_w)
+	void build_word(int w, double Vbeta) {
+		word_table & word = word_tables[w];
+		const sparse_counts & row = term_topics[w];
+		word.topics.resize(row.size());
+		word.weights.resize(row.size());
+		for (size_t i = 0; i < row.size(); ++i) {
+			word.topics[i] = row[i].topic;
+			word.weights[i] = row[i].count / (topic_totals[row[i].topic] + Vbeta);
+		}
+		if (!row.empty()) word.table.build(&word.weights[0], row.size(), work);
+		word.draws = 0;
+	}
+
+	//! Build the table over all topics from the current counts, O(K)
+	void build_smoothing(double Vbeta) {
+		smoothing_weights.resize(K);
+		for (int k = 0; k < K; ++k) smoothing_weights[k] = beta / (topic_totals[k] + Vbeta);
+		smoothing.build(&smoothing_weights[0], K, work);
+		smoothing_draws = 0;
+	}
+
+	//! The count of topic k in a row sorted by topic
+	static inline int count(const sparse_counts & row, int k) {
+		sparse_counts::const_iterator i = std::lower_bound(row.begin(), row.end(), k, before);
+		return (i != row.end() && i->topic == k) ? i->count : 0;
+	}
+
+	//! Add one to the count of topic k in a row sorted by topic
+	static void increment(sparse_counts & row, int k) {
+		sparse_counts::iterator i = std::lower_bound(row.begin(), row.end(), k, before);
+		if (i != row.end() && i->topic == k) i->count++;
+		else row.insert(i, topic_count(k, 1));
+	}
+
+	//! Subtract one from the count of topic k in a row sorted by topic, and remove the topic if it becomes zero
+	static void decrement(sparse_counts & row, int k) {
+		sparse_counts::iterator i = std::lower_bound(row.begin(), row.end(), k, before);
+		assert (i != row.end() && i->topic == k);
+		if (!--i->count) row.erase(i);
+	}
+
+	static inline bool before(const topic_count & entry, int k) { return entry.topic < k; }
+
+	//! Number of topics
+	int K;
+
+	//! Hyperparameters
+	double alpha, beta;
+
+	//! Pairs of a document and a word proposal per token per sweep
+	int steps;
+
+	//! Per token: its term and its topic, documents refer to their tokens by index
+	std::vector<int> terms;
+	std::vector<int> assignment;
+	std::vector<std::vector<size_t> > doc_tokens;
+
+	//! Sparse term-topic table, a row per term sorted by topic
+	std::vector<sparse_counts> term_topics;
+
+	//! Number of tokens per topic
+	std::vector<int> topic_totals;
+
+	//! Number of tokens per term, and the number of terms that occur
+	std::vector<int> term_frequency;
+	int vocabulary;
+
+	//! The current document as dense counts, and the topics of its tokens in order
+	std::vector<int> doc_dense;
+	std::vector<int> doc_assignment;
+
+	//! Per term the table for the term part of the word proposal
+	std::vector<word_table> word_tables;
+
+	//! The table over all topics for the beta part of the word proposal, its weights, and the draws since it was built
+	alias_table smoothing;
+	std::vector<double> smoothing_weights;
+	size_t smoothing_draws;
+
+	//! Work array to build the tables
+	std::vector<size_t> work;
+
+	std::mt19937 generator;
+};
+
+#endif /* ALIAS_LDA_H_ */
@@ -0,0 +1,110 @@
+/**
+ * @file alias-table.hpp
+ * @brief Walker's alias method to sample from a discrete distribution in constant time
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2014 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 15, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    Artificial Intelligence Framework
+ */
+#ifndef ALIAS_TABLE_H_
+#define ALIAS_TABLE_H_
+
+#include <vector>
+#include <random>
+#include <cassert>
+
+/**
+ * An alias table over n outcomes with non-negative weights. Building it is O(n) with the method of Vose (1991),
+ * after that an outcome is drawn in O(1): pick a slot uniformly, and return the slot itself or its alias.
+ */
+class alias_table {
+public:
+	alias_table(): total(0) {}
+
+	//! Build the table for the n weights, which should not all be zero
+	void build(const double *weights, size_t n) {
+		std::vector<size_t> work;
+		build(weights, n, work);
+	}
+
+	/**
+	 * The same, with a work array that is kept by the caller, so that building many tables does not allocate. The
+	 * outcomes below the average weight are collected from the front, those above it from the back.
+	 */
+	void build(const double *weights, size_t n, std::vector<size_t> & work) {
+		slots.resize(n);
+		work.resize(n);
+		total = 0;
+		for (size_t i = 0; i < n; ++i) total += weights[i];
+		assert (n && total > 0);
+		size_t small = 0, large = n;
+		for (size_t i = 0; i < n; ++i) {
+			slots[i].threshold = weights[i] * n / total;
+			slots[i].alias = i;
+			if (slots[i].threshold < 1) work[small++] = i;
+			else work[--large] = i;
+		}
+		while (small && large < n) {
+			size_t s = work[--small], l = work[large];
+			slots[s].alias = l;
+			slots[l].threshold -= 1 - slots[s].threshold;
+			if (slots[l].threshold < 1) {
+				large++;
+				work[small++] = l;
+			}
+		}
+		// what is left over is one up to rounding errors
+		for (size_t i = 0; i < small; ++i) slots[work[i]].threshold = 1;
+		for (size_t i = large; i < n; ++i) slots[work[i]].threshold = 1;
+	}
+
+	//! Draw an outcome
+	template<typename RandomGenerator>
+	inline size_t sample(RandomGenerator & generator) const {
+		return sample(std::uniform_real_distribution<double>(0, 1)(generator));
+	}
+
+	//! Draw an outcome with a uniform random number u in [0,1)
+	inline size_t sample(double u) const {
+		u *= slots.size();
+		size_t i = (size_t)u;
+		if (i >= slots.size()) i = slots.size() - 1;
+		return (u - i < slots[i].threshold) ? i : slots[i].alias;
+	}
+
+	//! Number of outcomes
+	inline size_t size() const { return slots.size(); }
+
+	//! Sum of the weights the table has been built with
+	inline double mass() const { return total; }
+
+private:
+	/**
+	 * A slot returns itself with probability "threshold", otherwise its alias. Both are stored together, a draw
+	 * touches only one slot.
+	 */
+	struct slot {
+		double threshold;
+		size_t alias;
+	};
+
+	std::vector<slot> slots;
+
+	double total;
+};
+
+#endif /* ALIAS_TABLE_H_ */
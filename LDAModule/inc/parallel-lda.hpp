@@ -0,0 +1,193 @@
+/**
+ * @file parallel-lda.hpp
+ * @brief Approximate distributed Gibbs sampling for Latent Dirichlet Allocation over a number of threads
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2014 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 15, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    Artificial Intelligence Framework
+ */
+#ifndef PARALLEL_LDA_H_
+#define PARALLEL_LDA_H_
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <cassert>
+
+#include <ThreadPool.hpp>
+#include <sparse-lda.hpp>
+
+/**
+ * AD-LDA, approximate distributed LDA (Newman, Asuncion, Smyth and Welling, 2009). The documents are divided over a
+ * number of partitions, document d goes to partition d mod P. Every partition is a sparse_lda with its own documents
+ * and its own copy of the term-topic counts of the whole corpus. In a sweep the partitions are sampled in parallel,
+ * each against its copy, which only sees the changes of its own tokens. At the end of the sweep the changes of all
+ * partitions are added to the global counts
+ *
+ *   n_wk = g_wk + sum_p (n_wk^p - g_wk)
+ *
+ * with g_wk the counts that were handed out at the start of the sweep, and the result is handed out again. The
+ * sampler is hence not an exact Gibbs sampler, the partitions see each other's changes one sweep late, but with many
+ * tokens per partition the effect on the outcome is negligible. With one partition it is the same as sparse_lda.
+ *
+ * The perplexity over all tokens tells whether the outcome is as good as that of the serial sampler.
+ */
+class parallel_lda {
+public:
+	/**
+	 * A sampler for "topics" topics with symmetric Dirichlet priors alpha and beta as for sparse_lda, over the given
+	 * number of partitions, normally the number of threads in the pool that will run sweep().
+	 */
+	parallel_lda(int topics, double alpha, double beta, size_t partitions, unsigned int seed = 5489u): K(topics),
+			vocabulary(0), tokens(0), modified(false) {
+		assert (K > 0 && partitions > 0);
+		for (size_t p = 0; p < partitions; ++p) {
+			workers.push_back(sparse_lda(K, alpha, beta, seed + p));
+		}
+		topic_totals.resize(K, 0);
+	}
+
+	//! Add a token of "term" in "document", with a random topic, the counts are merged at the next sweep()
+	void add(int term, int document) {
+		assert (term >= 0 && document >= 0);
+		if ((size_t)term >= term_frequency.size()) term_frequency.resize(term + 1, 0);
+		if (!term_frequency[term]++) vocabulary++;
+		size_t P = workers.size();
+		workers[document % P].add(term, document / P);
+		tokens++;
+		modified = true;
+	}
+
+	//! Number of tokens
+	inline size_t size() const { return tokens; }
+
+	//! Number of topics
+	inline int topics() const { return K; }
+
+	//! Number of partitions
+	inline size_t partitions() const { return workers.size(); }
+
+	//! Number of different terms
+	inline int terms_in_vocabulary() const { return vocabulary; }
+
+	//! Sample a new topic for every token, the partitions in parallel, and merge their counts
+	void sweep(ThreadPool & pool) {
+		if (modified) merge(pool);
+		pool.run(workers.size(), [this](size_t p) { workers[p].sweep(); });
+		merge(pool);
+	}
+
+	/**
+	 * The perplexity of all tokens, exp(-sum log p(w|d) / N), see sparse_lda::log_likelihood(). It goes down while
+	 * the sampler converges, and should end up at the same value as with the serial sampler.
+	 */
+	double perplexity(ThreadPool & pool) {
+		if (!tokens) return 0;
+		if (modified) merge(pool);
+		std::vector<double> log_likelihood(workers.size());
+		pool.run(workers.size(), [this, &log_likelihood](size_t p) {
+			log_likelihood[p] = workers[p].log_likelihood();
+		});
+		double sum = 0;
+		for (size_t p = 0; p < workers.size(); ++p) sum += log_likelihood[p];
+		return std::exp(-sum / tokens);
+	}
+
+private:
+	/**
+	 * Add the changes of every partition since the last merge to the global counts, and hand them out again. The
+	 * terms are divided over the threads, each with its own dense row to add the counts in. This costs O(P nnz), with
+	 * nnz the number of non-zero term-topic counts, which is small compared to a sweep.
+	 */
+	void merge(ThreadPool & pool) {
+		modified = false;
+		size_t P = workers.size();
+		// with one partition its counts are the global counts
+		if (P == 1) return;
+		term_topics.resize(term_frequency.size());
+		size_t chunks = pool.size();
+		pool.run(chunks, [this, chunks](size_t c) {
+			size_t first = term_topics.size() * c / chunks, last = term_topics.size() * (c + 1) / chunks;
+			std::vector<int> dense(K, 0);
+			std::vector<int> active;
+			for (size_t w = first; w < last; ++w) merge_row(w, dense, active);
+		});
+		std::vector<int> totals(K, 0);
+		for (int k = 0; k < K; ++k) {
+			totals[k] = -(int)(P - 1) * topic_totals[k];
+			for (size_t p = 0; p < P; ++p) totals[k] += workers[p].topic_total(k);
+			assert (totals[k] >= 0);
+		}
+		topic_totals.swap(totals);
+		pool.run(P, [this](size_t p) {
+			workers[p].share(term_topics, topic_totals, term_frequency, vocabulary);
+		});
+	}
+
+	//! Merge the row of term w, with "dense" all zero for K topics, and leave it like that
+	void merge_row(size_t w, std::vector<int> & dense, std::vector<int> & active) {
+		size_t P = workers.size();
+		sparse_counts & row = term_topics[w];
+		active.clear();
+		for (size_t i = 0; i < row.size(); ++i) {
+			dense[row[i].topic] = -(int)(P - 1) * row[i].count;
+			active.push_back(row[i].topic);
+		}
+		for (size_t p = 0; p < P; ++p) {
+			if (w >= workers[p].term_rows()) continue;
+			const sparse_counts & local = workers[p].term_row(w);
+			for (size_t i = 0; i < local.size(); ++i) {
+				if (!dense[local[i].topic]) active.push_back(local[i].topic);
+				dense[local[i].topic] += local[i].count;
+			}
+		}
+		// a topic can be in the list twice if its sum passed through zero, it is only taken the first time
+		row.clear();
+		for (size_t i = 0; i < active.size(); ++i) {
+			int k = active[i];
+			assert (dense[k] >= 0);
+			if (dense[k]) row.push_back(topic_count(k, dense[k]));
+			dense[k] = 0;
+		}
+		// by decreasing count, as sparse_lda keeps its rows
+		std::sort(row.begin(), row.end(), more);
+	}
+
+	static inline bool more(const topic_count & a, const topic_count & b) { return a.count > b.count; }
+
+	//! Number of topics
+	int K;
+
+	//! The partitions
+	std::vector<sparse_lda> workers;
+
+	//! The global counts as they were handed out at the last merge
+	std::vector<sparse_counts> term_topics;
+	std::vector<int> topic_totals;
+
+	//! Number of tokens per term over all partitions, and the number of terms that occur
+	std::vector<int> term_frequency;
+	int vocabulary;
+
+	//! Number of tokens over all partitions
+	size_t tokens;
+
+	//! Whether tokens have been added since the last merge
+	bool modified;
+};
+
+#endif /* PARALLEL_LDA_H_ */
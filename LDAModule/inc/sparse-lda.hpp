@@ -0,0 +1,356 @@
+/**
+ * @file sparse-lda.hpp
+ * @brief Collapsed Gibbs sampler for Latent Dirichlet Allocation with sparse count tables
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2014 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 15, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    Artificial Intelligence Framework
+ */
+#ifndef SPARSE_LDA_H_
+#define SPARSE_LDA_H_
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+/**
+ * A topic with the number of tokens assigned to it, an entry in a sparse row of a count table.
+ */
+struct topic_count {
+	topic_count(int topic, int count): topic(topic), count(count) {}
+	int topic;
+	int count;
+};
+
+/**
+ * A sparse row of a count table: only the topics with a non-zero count, sorted by decreasing count. The topics that
+ * carry most of the mass come first, so a walk through the row to sample a topic usually stops early.
+ */
+typedef std::vector<topic_count> sparse_counts;
+
+/**
+ * Collapsed Gibbs sampling for LDA, with the bucket decomposition of SparseLDA (Yao, Mimno and McCallum, 2009). The
+ * full conditional for the topic k of a token of term w in document d is
+ *
+ *   p(k) ~ (n_dk + alpha) (n_wk + beta) / (n_k + V beta)
+ *
+ * with n_dk the tokens in d with topic k, n_wk the tokens of w with topic k, n_k all tokens with topic k, and V the
+ * number of terms, all without the token itself. This is split in three buckets:
+ *
+ *   s = sum_k alpha beta / (n_k + V beta)                  smoothing, the same for every token
+ *   r = sum_k n_dk beta / (n_k + V beta)                   document, only the topics that occur in d
+ *   q = sum_k n_wk (alpha + n_dk) / (n_k + V beta)         word, only the topics that w is assigned to
+ *
+ * The bucket s and the coefficients (alpha + n_dk) / (n_k + V beta) of q are updated in O(1) when a count changes, r
+ * is kept up to date while going through a document. Most of the mass is in q, so a token costs O(active topics of
+ * its term and document) rather than O(K). Only a draw in the (small) smoothing bucket goes through all topics.
+ *
+ * The term-topic table is a sparse row per term, the document-topic table a sparse row per document that is expanded
+ * into a dense array while the sampler goes through the tokens of that document.
+ */
+class sparse_lda {
+public:
+	/**
+	 * A sampler for "topics" topics, with symmetric Dirichlet priors alpha on the topics of a document and beta on
+	 * the terms of a topic.
+	 */
+	sparse_lda(int topics, double alpha, double beta, unsigned int seed = 5489u): K(topics), alpha(alpha), beta(beta),
+			vocabulary(0), smoothing(0), document(0), generator(seed) {
+		assert (K > 0);
+		topic_totals.resize(K, 0);
+		denominator.resize(K, 0);
+		coefficient.resize(K, 0);
+		doc_dense.resize(K, 0);
+		doc_active.resize(K, false);
+	}
+
+	//! Add a token of "term" in "document", with a random topic
+	void add(int term, int document) {
+		assert (term >= 0 && document >= 0);
+		if ((size_t)term >= term_topics.size()) {
+			term_topics.resize(term + 1);
+			term_frequency.resize(term + 1, 0);
+		}
+		if ((size_t)document >= doc_topics.size()) {
+			doc_topics.resize(document + 1);
+			doc_tokens.resize(document + 1);
+		}
+		if (!term_frequency[term]++) vocabulary++;
+		int topic = std::uniform_int_distribution<int>(0, K - 1)(generator);
+		doc_tokens[document].push_back(terms.size());
+		terms.push_back(term);
+		assignment.push_back(topic);
+		increment(term_topics[term], topic);
+		increment(doc_topics[document], topic);
+		topic_totals[topic]++;
+	}
+
+	//! Number of tokens
+	inline size_t size() const { return terms.size(); }
+
+	//! Number of topics
+	inline int topics() const { return K; }
+
+	//! Number of different terms
+	inline int terms_in_vocabulary() const { return vocabulary; }
+
+	//! Topic of a token, in the order in which they have been added
+	inline int topic(size_t token) const { return assignment[token]; }
+
+	//! Number of tokens with the given topic
+	inline int topic_total(int topic) const { return topic_totals[topic]; }
+
+	//! The topics of a term with their counts, by decreasing count
+	inline const sparse_counts & term_row(int term) const { return term_topics[term]; }
+
+	//! The topics in a document with their counts, by decreasing count
+	inline const sparse_counts & document_row(int document) const { return doc_topics[document]; }
+
+	//! Number of term rows, one more than the largest term that has been added
+	inline size_t term_rows() const { return term_topics.size(); }
+
+	/**
+	 * Replace the term-topic counts, the topic totals, and the number of tokens per term by those of a larger corpus
+	 * of which this sampler only has some of the documents, see parallel_lda. The next sweep() samples against them.
+	 */
+	void share(const std::vector<sparse_counts> & rows, const std::vector<int> & totals,
+			const std::vector<int> & frequency, int terms) {
+		assert (totals.size() == (size_t)K && rows.size() == frequency.size());
+		term_topics = rows;
+		topic_totals = totals;
+		term_frequency = frequency;
+		vocabulary = terms;
+	}
+
+	/**
+	 * The log-likelihood of the tokens, the sum of log p(w|d) with p(w|d) = sum_k theta_dk phi_kw, estimated from the
+	 * current counts as theta_dk = (n_dk + alpha) / (n_d + K alpha) and phi_kw = (n_wk + beta) / (n_k + V beta). The
+	 * sum over k is split in the same buckets as in sweep(), so this costs about as much as a sweep. The perplexity is
+	 * exp(-log_likelihood() / size()).
+	 */
+	double log_likelihood() const {
+		const double Vbeta = vocabulary * beta;
+		std::vector<double> inverse(K);
+		double smoothing = 0;
+		for (int k = 0; k < K; ++k) {
+			inverse[k] = 1.0 / (topic_totals[k] + Vbeta);
+			smoothing += alpha * beta * inverse[k];
+		}
+		std::vector<int> dense(K, 0);
+		double sum = 0;
+		for (size_t d = 0; d < doc_tokens.size(); ++d) {
+			const std::vector<size_t> & tokens = doc_tokens[d];
+			if (tokens.empty()) continue;
+			const sparse_counts & row = doc_topics[d];
+			double document = 0;
+			for (size_t i = 0; i < row.size(); ++i) {
+				dense[row[i].topic] = row[i].count;
+				document += row[i].count * beta * inverse[row[i].topic];
+			}
+			double length = tokens.size() + K * alpha;
+			for (size_t t = 0; t < tokens.size(); ++t) {
+				const sparse_counts & term_row = term_topics[terms[tokens[t]]];
+				double word = 0;
+				for (size_t i = 0; i < term_row.size(); ++i) {
+					word += term_row[i].count * (alpha + dense[term_row[i].topic]) * inverse[term_row[i].topic];
+				}
+				sum += std::log((smoothing + document + word) / length);
+			}
+			for (size_t i = 0; i < row.size(); ++i) dense[row[i].topic] = 0;
+		}
+		return sum;
+	}
+
+	//! The perplexity of the tokens, see log_likelihood()
+	inline double perplexity() const { return size() ? std::exp(-log_likelihood() / size()) : 0; }
+
+	/**
+	 * Sample a new topic for every token, document by document. The sums that the buckets depend on are calculated
+	 * again at the start, so rounding errors do not accumulate over sweeps.
+	 */
+	void sweep() {
+		const double Vbeta = vocabulary * beta;
+		smoothing = 0;
+		for (int k = 0; k < K; ++k) {
+			denominator[k] = 1.0 / (topic_totals[k] + Vbeta);
+			coefficient[k] = alpha * denominator[k];
+			smoothing += alpha * beta * denominator[k];
+		}
+		for (size_t d = 0; d < doc_tokens.size(); ++d) {
+			if (!doc_tokens[d].empty()) sweep_document(d);
+		}
+	}
+
+private:
+	//! Resample the topics of all tokens in document "d"
+	void sweep_document(size_t d) {
+		const double Vbeta = vocabulary * beta;
+		// expand the document row into a dense array, with the list of topics that occur in the document
+		sparse_counts & row = doc_topics[d];
+		active.clear();
+		document = 0;
+		for (size_t i = 0; i < row.size(); ++i) {
+			int k = row[i].topic;
+			doc_dense[k] = row[i].count;
+			doc_active[k] = true;
+			active.push_back(k);
+			document += row[i].count * beta * denominator[k];
+			coefficient[k] = (alpha + row[i].count) * denominator[k];
+		}
+		const std::vector<size_t> & tokens = doc_tokens[d];
+		for (size_t t = 0; t < tokens.size(); ++t) {
+			size_t token = tokens[t];
+			int w = terms[token];
+			int k = assignment[token];
+
+			// take the token out of all counts
+			change(k, -1, Vbeta);
+			decrement(term_topics[w], k);
+
+			// the word bucket, the mass per topic is kept for the walk below
+			const sparse_counts & term_row = term_topics[w];
+			word_mass.resize(term_row.size());
+			double word = 0;
+			for (size_t i = 0; i < term_row.size(); ++i) {
+				word_mass[i] = term_row[i].count * coefficient[term_row[i].topic];
+				word += word_mass[i];
+			}
+
+			double u = std::uniform_real_distribution<double>(0, smoothing + document + word)(generator);
+			if (u < word) {
+				size_t i = 0;
+				for (; i + 1 < term_row.size() && (u -= word_mass[i]) > 0; ++i);
+				k = term_row[i].topic;
+			} else if ((u -= word) < document) {
+				size_t i = 0;
+				for (; i + 1 < active.size(); ++i) {
+					if ((u -= doc_dense[active[i]] * beta * denominator[active[i]]) <= 0) break;
+				}
+				k = active[i];
+			} else {
+				u -= document;
+				k = 0;
+				for (; k + 1 < K && (u -= alpha * beta * denominator[k]) > 0; ++k);
+			}
+
+			// and put it back with the new topic
+			assignment[token] = k;
+			change(k, +1, Vbeta);
+			increment(term_topics[w], k);
+		}
+		// store the dense counts as sparse row again, and reset the coefficients to those without document
+		row.clear();
+		for (size_t i = 0; i < active.size(); ++i) {
+			int k = active[i];
+			if (doc_dense[k]) row.push_back(topic_count(k, doc_dense[k]));
+			doc_dense[k] = 0;
+			doc_active[k] = false;
+			coefficient[k] = alpha * denominator[k];
+		}
+		sort(row);
+	}
+
+	//! Add "delta" to the counts of topic k in the current document, and update the buckets and coefficients
+	inline void change(int k, int delta, double Vbeta) {
+		smoothing -= alpha * beta * denominator[k];
+		document -= doc_dense[k] * beta * denominator[k];
+		topic_totals[k] += delta;
+		doc_dense[k] += delta;
+		denominator[k] = 1.0 / (topic_totals[k] + Vbeta);
+		smoothing += alpha * beta * denominator[k];
+		document += doc_dense[k] * beta * denominator[k];
+		coefficient[k] = (alpha + doc_dense[k]) * denominator[k];
+		if (!doc_active[k]) {
+			doc_active[k] = true;
+			active.push_back(k);
+		}
+	}
+
+	//! Add one to the count of topic k in a sparse row, and keep it sorted by decreasing count
+	static void increment(sparse_counts & row, int k) {
+		size_t i = 0;
+		while (i < row.size() && row[i].topic != k) ++i;
+		if (i == row.size()) {
+			row.push_back(topic_count(k, 1));
+			return;
+		}
+		row[i].count++;
+		for (; i > 0 && row[i-1].count < row[i].count; --i) std::swap(row[i-1], row[i]);
+	}
+
+	//! Subtract one from the count of topic k in a sparse row, and remove the topic if it becomes zero
+	static void decrement(sparse_counts & row, int k) {
+		size_t i = 0;
+		while (i < row.size() && row[i].topic != k) ++i;
+		assert (i < row.size());
+		if (!--row[i].count) {
+			row.erase(row.begin() + i);
+			return;
+		}
+		for (; i + 1 < row.size() && row[i+1].count > row[i].count; ++i) std::swap(row[i], row[i+1]);
+	}
+
+	//! Sort a sparse row by decreasing count (insertion sort, rows are short and almost sorted)
+	static void sort(sparse_counts & row) {
+		for (size_t i = 1; i < row.size(); ++i) {
+			for (size_t j = i; j > 0 && row[j-1].count < row[j].count; --j) std::swap(row[j-1], row[j]);
+		}
+	}
+
+	//! Number of topics
+	int K;
+
+	//! Hyperparameters
+	double alpha, beta;
+
+	//! Per token: its term and its topic, documents refer to their tokens by index
+	std::vector<int> terms;
+	std::vector<int> assignment;
+	std::vector<std::vector<size_t> > doc_tokens;
+
+	//! Sparse count tables, a row per term and a row per document
+	std::vector<sparse_counts> term_topics;
+	std::vector<sparse_counts> doc_topics;
+
+	//! Number of tokens per topic
+	std::vector<int> topic_totals;
+
+	//! Number of tokens per term, and the number of terms that occur
+	std::vector<int> term_frequency;
+	int vocabulary;
+
+	//! Per topic 1 / (n_k + V beta), and the coefficient (alpha + n_dk) / (n_k + V beta) of the word bucket
+	std::vector<double> denominator;
+	std::vector<double> coefficient;
+
+	//! The smoothing and document buckets
+	double smoothing, document;
+
+	//! The current document as dense counts, and the topics in it (some may have dropped to zero)
+	std::vector<int> doc_dense;
+	std::vector<bool> doc_active;
+	std::vector<int> active;
+
+	//! Mass per entry of the term row of the current token
+	std::vector<double> word_mass;
+
+	std::mt19937 generator;
+};
+
+#endif /* SPARSE_LDA_H_ */
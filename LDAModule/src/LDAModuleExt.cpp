@@ -14,24 +14,18 @@
  */
 
 #include <LDAModuleExt.h>
-#include <Random.h>
+
+#include <iostream>
+#include <cmath>
 
 using namespace rur;
 
 /**
- * The number of to-be-expected clusters is set to K=12.
+ * The number of to-be-expected clusters is set to K=12. The Gibbs sampler gets a partition of the documents for every
+ * hardware thread.
  */
-LDAModuleExt::LDAModuleExt(): K(12) {
-	term_count_per_topic.resize(K);
-	term_count_per_doc.resize(K);
-
-	sample_topics.resize(K);
-
-	alpha = 0.1;
-
-	beta = 0.1;
-
-	W = 0;
+LDAModuleExt::LDAModuleExt(): K(12), alpha(0.1), beta(0.1), lda(K, alpha, beta, pool.size()), mh_lda(K, alpha, beta),
+		mode(0), lag(10), convergence(0), sweeps(0), perplexity(0) {
 }
 
 //! Replace with your own code
@@ -40,89 +34,76 @@ LDAModuleExt::~LDAModuleExt() {
 }
 
 /**
- * 
+ * Samples are counted in every mode. In training mode every tick is one sweep over all tokens so far, with the Gibbs
+ * sampler in mode 1 and with the Metropolis-Hastings sampler in mode 2.
  */
 void LDAModuleExt::Tick() {
 	long_seq *sample = readSample();
-	
+	if (sample) {
+		Count(*sample);
+		sample->clear();
+	}
+	int *new_mode = readMode();
+	if (new_mode) mode = *new_mode;
+	int *new_lag = readLag();
+	if (new_lag) lag = *new_lag;
+	double *new_convergence = readConvergence();
+	if (new_convergence) convergence = *new_convergence;
+	if (mode == 1) Gibbs();
+	else if (mode == 2) MetropolisHastings();
 }
 
 void LDAModuleExt::Count(long_seq & sample) {
 	static const int number_of_elements = 2;
+	if (sample.size() < 4 + number_of_elements) return;
 	if (sample[0] != AIM_PROTOCOL_VERSION) return;
 	if (sample[1] != number_of_elements) return;
 	if (sample[2] != AIM_TYPE_SCALAR) return;
 	if (sample[3] != AIM_TYPE_SCALAR) return;
 	int term = sample[4];
 	int document = sample[5];
+	if (term < 0 || document < 0) return;
 
 	term_doc_table.push(term, document);
-	W++;
 }
 
-
+/**
+ * The sampler keeps its own sparse tables of (term, topic) and (document, topic) counts, see sparse_lda, so a token
+ * costs time in the order of the number of topics of its term and document rather than K. The documents are divided
+ * over the threads, which merge their term-topic counts after every sweep, see parallel_lda.
+ *
+ * Every "lag" sweeps the perplexity over all tokens is written to the console. When it changes less than
+ * "convergence" (if set) since the last time, the module goes back to accepting inputs.
+ */
 void LDAModuleExt::Gibbs() {
-	// create two tables from term_doc_table
-	for (int i = 0; i < term_doc_table.size(); ++i) {
-		int topic = random_value(0, K);
-
+	for (size_t i = lda.size(); i < term_doc_table.size(); ++i) {
 		tuple<int> term_doc = term_doc_table[i];
-		int term = term_doc.elem0;
-		int document = term_doc.elem1;
-
-		term_topic_table.push(term, topic);
-		doc_topic_table.push(document, topic);
-
-		term_count_per_topic[topic]++;
-		term_count_per_doc[document]++;
+		lda.add(term_doc.elem0, term_doc.elem1);
 	}
+	if (!lda.size()) return;
+	lda.sweep(pool);
+	if (lag <= 0 || ++sweeps % lag) return;
+	double previous = perplexity;
+	perplexity = lda.perplexity(pool);
+	std::cout << "Sweep " << sweeps << ": perplexity " << perplexity << " over " << lda.size() << " tokens" << std::endl;
+	if (convergence > 0 && previous > 0 && std::fabs(previous - perplexity) < convergence) {
+		std::cout << "Converged, stop training" << std::endl;
+		mode = 0;
+	}
+}
 
-	// get the corresponding matrices
-	// TODO: check if copy assignment is working properly
-	nd_array<int> term_topic_matrix = term_topic_table.matrix();
-	nd_array<int> doc_topic_matrix = doc_topic_table.matrix();
-
-	// we go again through term + doc table, but we will access counts in above matrices
-	for (int i = 0; i < term_doc_table.size(); ++i) {
+/**
+ * The sampler draws from alias tables that are built again after as many draws as they have entries, with a few
+ * Metropolis-Hastings steps per token, see alias_lda. A token costs O(1) on average, independent of K, so this is the
+ * sampler to use with thousands of topics. With fewer topics Gibbs() is faster and mixes better.
+ */
+void LDAModuleExt::MetropolisHastings() {
+	for (size_t i = mh_lda.size(); i < term_doc_table.size(); ++i) {
 		tuple<int> term_doc = term_doc_table[i];
-		int term = term_doc.elem0;
-		int doc = term_doc.elem1;
-
-		// get also current topic assignment (most convenient from table)
-		tuple<int> term_topic = term_topic_table[i];
-		int topic = term_topic.elem1;
-
-		// decrement counts in matrix
-		term_topic_matrix.add(term, topic, -1);
-		doc_topic_matrix.add(doc, topic, -1);
-
-		term_count_per_topic[topic]--;
-		//term_count_per_doc[document]--;  // fixed
-
-		// N_0: number of instances of word w assigned to topic j, not including current word
-		// N_1: total number of words assigned to topic j, not including current word
-		// N_2: number of words in document d_i assigned to topic j, not including current word
-		// N_3: total number of words in document d_i, not including current word
-
-		int N_3 = term_count_per_doc[doc] - 1;
-		
-		for (int k = 0; k < K; ++k) {
-			int N_0 = term_topic_matrix.get(term, k);
-			int N_1 = term_count_per_topic[k];
-			int N_2 = doc_topic_matrix.get(doc, k);
-
-			sample_topics[k] = ((N_0 + beta) * (N_2 + alpha)) / ((N_1 + W*beta ) * (N_3 + K*alpha));
-		}
-		int index_max = *std::max_element(sample_topics.begin(), sample_topics.end());
-		topic = index_max;
-
-		// add to matrices again
-		term_topic_matrix.add(term, topic, +1);
-		doc_topic_matrix.add(doc, topic, +1);
-
-		term_count_per_topic[topic]++;
-		//term_count_per_doc[document]++;
+		mh_lda.add(term_doc.elem0, term_doc.elem1);
 	}
+	if (!mh_lda.size()) return;
+	mh_lda.sweep();
 }
 
 
@@ -0,0 +1,150 @@
+/**
+ * @brief TestLDA.cpp
+ * @file TestLDA.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2014 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    Artificial Intelligence Framework
+ */
+
+
+#include <sparse-lda.hpp>
+#include <alias-lda.hpp>
+#include <alias-table.hpp>
+#include <cmath>
+#include "gtest/gtest.h"
+
+namespace {
+
+const int K = 3, V = 3, D = 2, N = 6;
+const double alpha = 0.3, beta = 0.2;
+
+//! A corpus of two documents of three tokens, small enough to enumerate all K^N assignments
+const int token_term[N] = {0, 1, 0, 2, 1, 2};
+const int token_document[N] = {0, 0, 0, 1, 1, 1};
+
+//! Unnormalized log of the collapsed posterior of an assignment z
+double log_joint(const int *z) {
+	int nwk[V][K] = {}, ndk[D][K] = {}, nk[K] = {};
+	for (int i = 0; i < N; ++i) {
+		nwk[token_term[i]][z[i]]++;
+		ndk[token_document[i]][z[i]]++;
+		nk[z[i]]++;
+	}
+	double l = 0;
+	for (int k = 0; k < K; ++k) {
+		l += lgamma(V * beta) - lgamma(nk[k] + V * beta);
+		for (int w = 0; w < V; ++w) l += lgamma(nwk[w][k] + beta) - lgamma(beta);
+		for (int d = 0; d < D; ++d) l += lgamma(ndk[d][k] + alpha) - lgamma(alpha);
+	}
+	return l;
+}
+
+/**
+ * The posterior probability that tokens a and b have the same topic. The marginal of a single topic is uniform, as
+ * the topics can be permuted, so this is what tells whether a sampler has the right stationary distribution.
+ */
+double same_topic(int a, int b) {
+	double same = 0, all = 0;
+	int S = 1;
+	for (int i = 0; i < N; ++i) S *= K;
+	for (int s = 0; s < S; ++s) {
+		int z[N];
+		for (int i = 0, x = s; i < N; ++i, x /= K) z[i] = x % K;
+		double p = std::exp(log_joint(z));
+		all += p;
+		if (z[a] == z[b]) same += p;
+	}
+	return same / all;
+}
+
+//! Run the sampler for many sweeps and compare the frequency of equal topics for a few pairs with the posterior
+template<typename Sampler>
+void expectPosterior(Sampler & lda, double tolerance) {
+	for (int i = 0; i < N; ++i) lda.add(token_term[i], token_document[i]);
+	const int pairs[4][2] = {{0, 2}, {0, 3}, {1, 4}, {0, 1}};
+	const int M = 200000;
+	int count[4] = {};
+	for (int m = 0; m < M; ++m) {
+		lda.sweep();
+		for (int p = 0; p < 4; ++p) count[p] += lda.topic(pairs[p][0]) == lda.topic(pairs[p][1]);
+	}
+	for (int p = 0; p < 4; ++p) {
+		EXPECT_NEAR(same_topic(pairs[p][0], pairs[p][1]), count[p] / (double)M, tolerance) << "tokens " <<
+				pairs[p][0] << " and " << pairs[p][1];
+	}
+}
+
+/**
+ * The sparse sampler is an exact collapsed Gibbs sampler, its chain has the posterior as stationary distribution.
+ */
+TEST(LDATest, SparsePosterior) {
+	sparse_lda lda(K, alpha, beta, 11);
+	expectPosterior(lda, 0.01);
+}
+
+/**
+ * The alias sampler uses tables that are a bit stale, so it is only close to the posterior.
+ */
+TEST(LDATest, AliasPosterior) {
+	alias_lda lda(K, alpha, beta, 2, 11);
+	expectPosterior(lda, 0.02);
+}
+
+/**
+ * The counts of the sparse sampler add up to the number of tokens, per term, per document and per topic.
+ */
+TEST(LDATest, SparseCounts) {
+	sparse_lda lda(K, alpha, beta, 11);
+	for (int i = 0; i < N; ++i) lda.add(token_term[i], token_document[i]);
+	for (int s = 0; s < 10; ++s) {
+		lda.sweep();
+		int total = 0;
+		for (int k = 0; k < K; ++k) total += lda.topic_total(k);
+		EXPECT_EQ(N, total);
+		for (int w = 0; w < V; ++w) {
+			int row = 0;
+			for (size_t i = 0; i < lda.term_row(w).size(); ++i) row += lda.term_row(w)[i].count;
+			EXPECT_EQ(2, row);
+		}
+		for (int d = 0; d < D; ++d) {
+			int row = 0;
+			for (size_t i = 0; i < lda.document_row(d).size(); ++i) row += lda.document_row(d)[i].count;
+			EXPECT_EQ(3, row);
+		}
+	}
+	EXPECT_EQ(V, lda.terms_in_vocabulary());
+}
+
+/**
+ * An alias table draws every outcome with a frequency proportional to its weight, also for zero weights.
+ */
+TEST(LDATest, AliasTable) {
+	const double weights[6] = {0.5, 3, 0, 1, 0.25, 2.25};
+	alias_table table;
+	table.build(weights, 6);
+	EXPECT_EQ(6u, table.size());
+	EXPECT_DOUBLE_EQ(7, table.mass());
+	std::mt19937 generator(1);
+	const int M = 700000;
+	int count[6] = {};
+	for (int m = 0; m < M; ++m) count[table.sample(generator)]++;
+	EXPECT_EQ(0, count[2]);
+	for (int i = 0; i < 6; ++i) EXPECT_NEAR(weights[i] / 7, count[i] / (double)M, 0.003) << "outcome " << i;
+}
+
+}
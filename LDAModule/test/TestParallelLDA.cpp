@@ -0,0 +1,104 @@
+/**
+ * @brief TestParallelLDA.cpp
+ * @file TestParallelLDA.cpp
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object to this software being used by the military, in factory
+ * farming, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2014 Anne van Rossum <anne@almende.com>
+ *
+ * @author  Anne C. van Rossum
+ * @date    Oct 16, 2026
+ * @project Replicator FP7
+ * @company Almende B.V.
+ * @case    Artificial Intelligence Framework
+ */
+
+
+#include <parallel-lda.hpp>
+#include <algorithm>
+#include <random>
+#include "gtest/gtest.h"
+
+namespace {
+
+const int K = 20;
+const double alpha = 0.1, beta = 0.01;
+
+/**
+ * A corpus of documents that each mix two of K topics, where topic t has its own block of terms. The tokens are in
+ * random order, rather than document after document.
+ */
+void corpus(std::vector<int> & terms, std::vector<int> & documents) {
+	const int D = 400, L = 100, V = 20 * K;
+	std::mt19937 generator(1);
+	std::vector<std::pair<int,int> > tokens;
+	for (int d = 0; d < D; ++d) {
+		int a = generator() % K, b = generator() % K;
+		for (int l = 0; l < L; ++l) {
+			int t = (generator() % 2) ? a : b;
+			tokens.push_back(std::make_pair(t * (V / K) + generator() % (V / K), d));
+		}
+	}
+	std::shuffle(tokens.begin(), tokens.end(), generator);
+	for (size_t i = 0; i < tokens.size(); ++i) {
+		terms.push_back(tokens[i].first);
+		documents.push_back(tokens[i].second);
+	}
+}
+
+/**
+ * With one partition there is nothing to merge, and the sampler is the serial one with the same seed.
+ */
+TEST(ParallelLDATest, OnePartitionAsSerial) {
+	std::vector<int> terms, documents;
+	corpus(terms, documents);
+	ThreadPool pool(2);
+	sparse_lda serial(K, alpha, beta, 3);
+	parallel_lda parallel(K, alpha, beta, 1, 3);
+	for (size_t i = 0; i < terms.size(); ++i) {
+		serial.add(terms[i], documents[i]);
+		parallel.add(terms[i], documents[i]);
+	}
+	EXPECT_EQ(serial.size(), parallel.size());
+	EXPECT_EQ(serial.terms_in_vocabulary(), parallel.terms_in_vocabulary());
+	for (int s = 0; s < 5; ++s) {
+		serial.sweep();
+		parallel.sweep(pool);
+		EXPECT_DOUBLE_EQ(serial.perplexity(), parallel.perplexity(pool));
+	}
+}
+
+/**
+ * With several partitions the sampler is only approximate, but it converges to the same perplexity as the serial one.
+ */
+TEST(ParallelLDATest, PerplexityAsSerial) {
+	std::vector<int> terms, documents;
+	corpus(terms, documents);
+	ThreadPool pool(4);
+	sparse_lda serial(K, alpha, beta, 3);
+	parallel_lda parallel(K, alpha, beta, 4, 3);
+	for (size_t i = 0; i < terms.size(); ++i) {
+		serial.add(terms[i], documents[i]);
+		parallel.add(terms[i], documents[i]);
+	}
+	EXPECT_EQ(serial.size(), parallel.size());
+	double initial = parallel.perplexity(pool);
+	EXPECT_NEAR(serial.perplexity(), initial, 0.05 * initial);
+	for (int s = 0; s < 100; ++s) {
+		serial.sweep();
+		parallel.sweep(pool);
+	}
+	double expected = serial.perplexity(), perplexity = parallel.perplexity(pool);
+	EXPECT_LT(perplexity, initial / 2);
+	EXPECT_NEAR(expected, perplexity, 0.05 * expected);
+}
+
+}
@@ -0,0 +1,137 @@
+/**
+ * @file ThreadPool.hpp
+ * @brief A pool of worker threads that process a job split in chunks
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software being used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2014 Anne van Rossum <anne@dobots.nl>
+ *
+ * @author  Anne van Rossum
+ * @date    Oct 15, 2026
+ * @company DoBots
+ * @case    Unsupervised learning
+ */
+
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+/**
+ * The pool runs one job at a time. A job is a function that is called once for each chunk index in [0, chunks). The
+ * chunks are handed out to the workers (and the calling thread) in order of request, so which thread processes which
+ * chunk is not fixed. Algorithms that need results that do not depend on the number of threads should therefore write
+ * their results per chunk and combine them afterwards in chunk order.
+ *
+ * The function run() must not be called from within a job on the same pool.
+ */
+class ThreadPool {
+public:
+	typedef std::function<void(size_t)> job_t;
+
+	/**
+	 * Create a pool with "threads" threads in total, the calling thread included. With 0 the number of hardware
+	 * threads is used, with 1 every job is run on the calling thread.
+	 */
+	ThreadPool(size_t threads = 0): job(NULL), job_chunks(0), next_chunk(0), pending(0), generation(0), stop(false) {
+		if (!threads) threads = std::thread::hardware_concurrency();
+		if (!threads) threads = 1;
+		for (size_t t = 1; t < threads; ++t) {
+			workers.push_back(std::thread(&ThreadPool::loop, this));
+		}
+	}
+
+	~ThreadPool() {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			stop = true;
+		}
+		start_condition.notify_all();
+		for (size_t t = 0; t < workers.size(); ++t) {
+			workers[t].join();
+		}
+	}
+
+	//! Total number of threads that work on a job, including the calling thread
+	inline size_t size() const { return workers.size() + 1; }
+
+	/**
+	 * Call task(c) for every chunk c in [0, chunks) and return when all chunks are done.
+	 */
+	void run(size_t chunks, const job_t & task) {
+		if (workers.empty() || chunks <= 1) {
+			for (size_t c = 0; c < chunks; ++c) task(c);
+			return;
+		}
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			job = &task;
+			job_chunks = chunks;
+			next_chunk = 0;
+			pending = workers.size();
+			generation++;
+		}
+		start_condition.notify_all();
+		work();
+		std::unique_lock<std::mutex> lock(mutex);
+		done_condition.wait(lock, [this] { return pending == 0; });
+		job = NULL;
+	}
+
+private:
+	//! Process chunks of the current job till there are none left
+	void work() {
+		size_t c;
+		while ((c = next_chunk++) < job_chunks) {
+			(*job)(c);
+		}
+	}
+
+	void loop() {
+		size_t seen = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			start_condition.wait(lock, [this, &seen] { return stop || generation != seen; });
+			if (stop) return;
+			seen = generation;
+			lock.unlock();
+			work();
+			lock.lock();
+			if (--pending == 0) done_condition.notify_one();
+		}
+	}
+
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable start_condition;
+	std::condition_variable done_condition;
+
+	//! The current job, its number of chunks, and the next chunk to hand out
+	const job_t *job;
+	size_t job_chunks;
+	std::atomic<size_t> next_chunk;
+
+	//! Number of workers that did not yet finish the current job
+	size_t pending;
+
+	//! Incremented for every job, so workers can tell a new job from a spurious wake-up
+	size_t generation;
+
+	bool stop;
+};
+
+#endif /* THREADPOOL_HPP_ */